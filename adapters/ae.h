@@ -38,6 +38,47 @@ static int redisAeAttach_link(redisAsyncContext *ac, void *base) {
     return redisAeAttach((aeEventLoop *)base, ac);
 }
 
+static int redisAeTimer_cb(aeEventLoop *loop, long long id, void *data) {
+    redisClusterAsyncContext *acc = (redisClusterAsyncContext *)data;
+    (void)loop;
+    (void)id;
+
+    /* The timer is removed when returning AE_NOMORE */
+    hi_free(acc->timer);
+    acc->timer = NULL;
+    redisClusterAsyncHandleTimer(acc);
+    return AE_NOMORE;
+}
+
+static int redisAeTimer_link(redisClusterAsyncContext *acc, int64_t usec) {
+    aeEventLoop *loop = (aeEventLoop *)acc->adapter;
+    long long *id = (long long *)acc->timer;
+
+    /* Timers are one-shot, a rescheduled timer replaces the pending one */
+    if (id != NULL) {
+        aeDeleteTimeEvent(loop, *id);
+        hi_free(id);
+        acc->timer = NULL;
+    }
+    if (usec < 0) {
+        return REDIS_OK;
+    }
+
+    id = (long long *)hi_malloc(sizeof(*id));
+    if (id == NULL) {
+        return REDIS_ERR;
+    }
+
+    *id = aeCreateTimeEvent(loop, (usec + 999) / 1000, redisAeTimer_cb, acc,
+                            NULL);
+    if (*id == AE_ERR) {
+        hi_free(id);
+        return REDIS_ERR;
+    }
+    acc->timer = id;
+    return REDIS_OK;
+}
+
 static int redisClusterAeAttach(aeEventLoop *loop,
                                 redisClusterAsyncContext *acc) {
 
@@ -47,6 +88,7 @@ static int redisClusterAeAttach(aeEventLoop *loop,
 
     acc->adapter = loop;
     acc->attach_fn = redisAeAttach_link;
+    acc->timer_fn = redisAeTimer_link;
 
     return REDIS_OK;
 }
@@ -38,6 +38,40 @@ static int redisLibeventAttach_link(redisAsyncContext *ac, void *base) {
     return redisLibeventAttach(ac, (struct event_base *)base);
 }
 
+static void redisLibeventTimer_cb(evutil_socket_t fd, short event,
+                                  void *arg) {
+    (void)fd;
+    (void)event;
+    redisClusterAsyncHandleTimer((redisClusterAsyncContext *)arg);
+}
+
+static int redisLibeventTimer_link(redisClusterAsyncContext *acc,
+                                   int64_t usec) {
+    struct event *ev = (struct event *)acc->timer;
+    struct timeval tv;
+
+    if (usec < 0) {
+        if (ev != NULL) {
+            event_free(ev);
+            acc->timer = NULL;
+        }
+        return REDIS_OK;
+    }
+
+    if (ev == NULL) {
+        ev = evtimer_new((struct event_base *)acc->adapter,
+                         redisLibeventTimer_cb, acc);
+        if (ev == NULL) {
+            return REDIS_ERR;
+        }
+        acc->timer = ev;
+    }
+
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
+    return evtimer_add(ev, &tv) == 0 ? REDIS_OK : REDIS_ERR;
+}
+
 static int redisClusterLibeventAttach(redisClusterAsyncContext *acc,
                                       struct event_base *base) {
 
@@ -47,6 +81,7 @@ static int redisClusterLibeventAttach(redisClusterAsyncContext *acc,
 
     acc->adapter = base;
     acc->attach_fn = redisLibeventAttach_link;
+    acc->timer_fn = redisLibeventTimer_link;
 
     return REDIS_OK;
 }
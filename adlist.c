@@ -43,18 +43,24 @@ hilist *listCreate(void) {
 
     if ((list = hi_malloc(sizeof(*list))) == NULL)
         return NULL;
+    listInit(list);
+    return list;
+}
+
+/* Initialize an empty list that is not allocated by listCreate(), for
+ * example one on the stack. It is emptied with listEmpty(). */
+void listInit(hilist *list) {
     list->head = list->tail = NULL;
     list->len = 0;
     list->dup = NULL;
     list->free = NULL;
     list->match = NULL;
-    return list;
 }
 
-/* Free the whole list.
+/* Remove all the elements from the list without destroying the list itself.
  *
  * This function can't fail. */
-void listRelease(hilist *list) {
+void listEmpty(hilist *list) {
     unsigned long len;
     listNode *current, *next;
 
@@ -67,6 +73,15 @@ void listRelease(hilist *list) {
         hi_free(current);
         current = next;
     }
+    list->head = list->tail = NULL;
+    list->len = 0;
+}
+
+/* Free the whole list.
+ *
+ * This function can't fail. */
+void listRelease(hilist *list) {
+    listEmpty(list);
     hi_free(list);
 }
 
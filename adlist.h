@@ -71,6 +71,8 @@ typedef struct hilist {
 
 /* Prototypes */
 hilist *listCreate(void);
+void listInit(hilist *list);
+void listEmpty(hilist *list);
 void listRelease(hilist *list);
 hilist *listAddNodeHead(hilist *list, void *value);
 hilist *listAddNodeTail(hilist *list, void *value);
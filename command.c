@@ -1,9 +1,10 @@
 #include <ctype.h>
 #include <errno.h>
 #include <hiredis/alloc.h>
-#include <strings.h>
 
 #include "command.h"
+#include "command_verbs.h"
+#include "dict.h"
 #include "hiarray.h"
 #include "hiutil.h"
 
@@ -270,151 +271,111 @@ static int redis_argeval(struct cmd *r) {
     return 0;
 }
 
-static inline cmd_type_t redis_parse_cmd_verb(const char *m, int len) {
-    // clang-format off
-    switch (len) {
-    case 3:
-        return !strncasecmp(m, "get", 3) ? CMD_REQ_REDIS_GET :
-               !strncasecmp(m, "set", 3) ? CMD_REQ_REDIS_SET :
-               !strncasecmp(m, "ttl", 3) ? CMD_REQ_REDIS_TTL :
-               !strncasecmp(m, "del", 3) ? CMD_REQ_REDIS_DEL :
-                                           CMD_UNKNOWN;
-    case 4:
-        return !strncasecmp(m, "pttl", 4) ? CMD_REQ_REDIS_PTTL :
-               !strncasecmp(m, "decr", 4) ? CMD_REQ_REDIS_DECR :
-               !strncasecmp(m, "dump", 4) ? CMD_REQ_REDIS_DUMP :
-               !strncasecmp(m, "hdel", 4) ? CMD_REQ_REDIS_HDEL :
-               !strncasecmp(m, "hget", 4) ? CMD_REQ_REDIS_HGET :
-               !strncasecmp(m, "hlen", 4) ? CMD_REQ_REDIS_HLEN :
-               !strncasecmp(m, "hset", 4) ? CMD_REQ_REDIS_HSET :
-               !strncasecmp(m, "incr", 4) ? CMD_REQ_REDIS_INCR :
-               !strncasecmp(m, "llen", 4) ? CMD_REQ_REDIS_LLEN :
-               !strncasecmp(m, "lpop", 4) ? CMD_REQ_REDIS_LPOP :
-               !strncasecmp(m, "lrem", 4) ? CMD_REQ_REDIS_LREM :
-               !strncasecmp(m, "lset", 4) ? CMD_REQ_REDIS_LSET :
-               !strncasecmp(m, "rpop", 4) ? CMD_REQ_REDIS_RPOP :
-               !strncasecmp(m, "sadd", 4) ? CMD_REQ_REDIS_SADD :
-               !strncasecmp(m, "spop", 4) ? CMD_REQ_REDIS_SPOP :
-               !strncasecmp(m, "srem", 4) ? CMD_REQ_REDIS_SREM :
-               !strncasecmp(m, "type", 4) ? CMD_REQ_REDIS_TYPE :
-               !strncasecmp(m, "mget", 4) ? CMD_REQ_REDIS_MGET :
-               !strncasecmp(m, "mset", 4) ? CMD_REQ_REDIS_MSET :
-               !strncasecmp(m, "zadd", 4) ? CMD_REQ_REDIS_ZADD :
-               !strncasecmp(m, "zrem", 4) ? CMD_REQ_REDIS_ZREM :
-               !strncasecmp(m, "eval", 4) ? CMD_REQ_REDIS_EVAL :
-               !strncasecmp(m, "sort", 4) ? CMD_REQ_REDIS_SORT :
-               !strncasecmp(m, "ping", 4) ? CMD_REQ_REDIS_PING :
-               !strncasecmp(m, "quit", 4) ? CMD_REQ_REDIS_QUIT :
-               !strncasecmp(m, "auth", 4) ? CMD_REQ_REDIS_AUTH :
-                                            CMD_UNKNOWN;
-    case 5:
-        return !strncasecmp(m, "hkeys", 5) ? CMD_REQ_REDIS_HKEYS :
-               !strncasecmp(m, "hmget", 5) ? CMD_REQ_REDIS_HMGET :
-               !strncasecmp(m, "hmset", 5) ? CMD_REQ_REDIS_HMSET :
-               !strncasecmp(m, "hvals", 5) ? CMD_REQ_REDIS_HVALS :
-               !strncasecmp(m, "hscan", 5) ? CMD_REQ_REDIS_HSCAN :
-               !strncasecmp(m, "lpush", 5) ? CMD_REQ_REDIS_LPUSH :
-               !strncasecmp(m, "ltrim", 5) ? CMD_REQ_REDIS_LTRIM :
-               !strncasecmp(m, "rpush", 5) ? CMD_REQ_REDIS_RPUSH :
-               !strncasecmp(m, "scard", 5) ? CMD_REQ_REDIS_SCARD :
-               !strncasecmp(m, "sdiff", 5) ? CMD_REQ_REDIS_SDIFF :
-               !strncasecmp(m, "setex", 5) ? CMD_REQ_REDIS_SETEX :
-               !strncasecmp(m, "setnx", 5) ? CMD_REQ_REDIS_SETNX :
-               !strncasecmp(m, "smove", 5) ? CMD_REQ_REDIS_SMOVE :
-               !strncasecmp(m, "sscan", 5) ? CMD_REQ_REDIS_SSCAN :
-               !strncasecmp(m, "zcard", 5) ? CMD_REQ_REDIS_ZCARD :
-               !strncasecmp(m, "zrank", 5) ? CMD_REQ_REDIS_ZRANK :
-               !strncasecmp(m, "zscan", 5) ? CMD_REQ_REDIS_ZSCAN :
-               !strncasecmp(m, "pfadd", 5) ? CMD_REQ_REDIS_PFADD :
-                                             CMD_UNKNOWN;
-    case 6:
-        return !strncasecmp(m, "append", 6) ? CMD_REQ_REDIS_APPEND :
-               !strncasecmp(m, "decrby", 6) ? CMD_REQ_REDIS_DECRBY :
-               !strncasecmp(m, "exists", 6) ? CMD_REQ_REDIS_EXISTS :
-               !strncasecmp(m, "expire", 6) ? CMD_REQ_REDIS_EXPIRE :
-               !strncasecmp(m, "getbit", 6) ? CMD_REQ_REDIS_GETBIT :
-               !strncasecmp(m, "getset", 6) ? CMD_REQ_REDIS_GETSET :
-               !strncasecmp(m, "psetex", 6) ? CMD_REQ_REDIS_PSETEX :
-               !strncasecmp(m, "hsetnx", 6) ? CMD_REQ_REDIS_HSETNX :
-               !strncasecmp(m, "incrby", 6) ? CMD_REQ_REDIS_INCRBY :
-               !strncasecmp(m, "lindex", 6) ? CMD_REQ_REDIS_LINDEX :
-               !strncasecmp(m, "lpushx", 6) ? CMD_REQ_REDIS_LPUSHX :
-               !strncasecmp(m, "lrange", 6) ? CMD_REQ_REDIS_LRANGE :
-               !strncasecmp(m, "rpushx", 6) ? CMD_REQ_REDIS_RPUSHX :
-               !strncasecmp(m, "setbit", 6) ? CMD_REQ_REDIS_SETBIT :
-               !strncasecmp(m, "sinter", 6) ? CMD_REQ_REDIS_SINTER :
-               !strncasecmp(m, "strlen", 6) ? CMD_REQ_REDIS_STRLEN :
-               !strncasecmp(m, "sunion", 6) ? CMD_REQ_REDIS_SUNION :
-               !strncasecmp(m, "zcount", 6) ? CMD_REQ_REDIS_ZCOUNT :
-               !strncasecmp(m, "zrange", 6) ? CMD_REQ_REDIS_ZRANGE :
-               !strncasecmp(m, "zscore", 6) ? CMD_REQ_REDIS_ZSCORE :
-                                              CMD_UNKNOWN;
-    case 7:
-        return !strncasecmp(m, "persist", 7) ? CMD_REQ_REDIS_PERSIST :
-               !strncasecmp(m, "pexpire", 7) ? CMD_REQ_REDIS_PEXPIRE :
-               !strncasecmp(m, "hexists", 7) ? CMD_REQ_REDIS_HEXISTS :
-               !strncasecmp(m, "hgetall", 7) ? CMD_REQ_REDIS_HGETALL :
-               !strncasecmp(m, "hincrby", 7) ? CMD_REQ_REDIS_HINCRBY :
-               !strncasecmp(m, "linsert", 7) ? CMD_REQ_REDIS_LINSERT :
-               !strncasecmp(m, "zincrby", 7) ? CMD_REQ_REDIS_ZINCRBY :
-               !strncasecmp(m, "evalsha", 7) ? CMD_REQ_REDIS_EVALSHA :
-               !strncasecmp(m, "restore", 7) ? CMD_REQ_REDIS_RESTORE :
-               !strncasecmp(m, "pfcount", 7) ? CMD_REQ_REDIS_PFCOUNT :
-               !strncasecmp(m, "pfmerge", 7) ? CMD_REQ_REDIS_PFMERGE :
-                                               CMD_UNKNOWN;
-    case 8:
-        return !strncasecmp(m, "expireat", 8) ? CMD_REQ_REDIS_EXPIREAT :
-               !strncasecmp(m, "bitcount", 8) ? CMD_REQ_REDIS_BITCOUNT :
-               !strncasecmp(m, "getrange", 8) ? CMD_REQ_REDIS_GETRANGE :
-               !strncasecmp(m, "setrange", 8) ? CMD_REQ_REDIS_SETRANGE :
-               !strncasecmp(m, "smembers", 8) ? CMD_REQ_REDIS_SMEMBERS :
-               !strncasecmp(m, "zrevrank", 8) ? CMD_REQ_REDIS_ZREVRANK :
-                                                CMD_UNKNOWN;
-    case 9:
-        return !strncasecmp(m, "pexpireat", 9) ? CMD_REQ_REDIS_PEXPIREAT :
-               !strncasecmp(m, "rpoplpush", 9) ? CMD_REQ_REDIS_RPOPLPUSH :
-               !strncasecmp(m, "sismember", 9) ? CMD_REQ_REDIS_SISMEMBER :
-               !strncasecmp(m, "zrevrange", 9) ? CMD_REQ_REDIS_ZREVRANGE :
-               !strncasecmp(m, "zlexcount", 9) ? CMD_REQ_REDIS_ZLEXCOUNT :
-                                                 CMD_UNKNOWN;
-    case 10:
-        return !strncasecmp(m, "sdiffstore", 10) ? CMD_REQ_REDIS_SDIFFSTORE :
-                                                   CMD_UNKNOWN;
-    case 11:
-        return !strncasecmp(m, "incrbyfloat", 11) ? CMD_REQ_REDIS_INCRBYFLOAT :
-               !strncasecmp(m, "sinterstore", 11) ? CMD_REQ_REDIS_SINTERSTORE :
-               !strncasecmp(m, "srandmember", 11) ? CMD_REQ_REDIS_SRANDMEMBER :
-               !strncasecmp(m, "sunionstore", 11) ? CMD_REQ_REDIS_SUNIONSTORE :
-               !strncasecmp(m, "zinterstore", 11) ? CMD_REQ_REDIS_ZINTERSTORE :
-               !strncasecmp(m, "zunionstore", 11) ? CMD_REQ_REDIS_ZUNIONSTORE :
-               !strncasecmp(m, "zrangebylex", 11) ? CMD_REQ_REDIS_ZRANGEBYLEX :
-                                                    CMD_UNKNOWN;
-    case 12:
-        return !strncasecmp(m, "hincrbyfloat", 12) ?
-                   CMD_REQ_REDIS_HINCRBYFLOAT :
-                   CMD_UNKNOWN;
-    case 13:
-        return !strncasecmp(m, "zrangebyscore", 13) ?
-                   CMD_REQ_REDIS_ZRANGEBYSCORE :
-                   CMD_UNKNOWN;
-    case 14:
-        return !strncasecmp(m, "zremrangebylex", 14) ?
-                   CMD_REQ_REDIS_ZREMRANGEBYLEX :
-                   CMD_UNKNOWN;
-    case 15:
-        return !strncasecmp(m, "zremrangebyrank", 15) ?
-                   CMD_REQ_REDIS_ZREMRANGEBYRANK :
-                   CMD_UNKNOWN;
-    case 16:
-        return !strncasecmp(m, "zremrangebyscore", 16) ?
-                   CMD_REQ_REDIS_ZREMRANGEBYSCORE :
-               !strncasecmp(m, "zrevrangebyscore", 16) ?
-                   CMD_REQ_REDIS_ZREVRANGEBYSCORE :
-                   CMD_UNKNOWN;
+/*
+ * Return true, if the redis command only reads data and can be served by a
+ * replica in READONLY mode, otherwise return false
+ */
+static int redis_readonly(struct cmd *r) {
+    switch (r->type) {
+    case CMD_REQ_REDIS_EXISTS:
+    case CMD_REQ_REDIS_PTTL:
+    case CMD_REQ_REDIS_TTL:
+    case CMD_REQ_REDIS_TYPE:
+    case CMD_REQ_REDIS_DUMP:
+
+    case CMD_REQ_REDIS_BITCOUNT:
+    case CMD_REQ_REDIS_GET:
+    case CMD_REQ_REDIS_GETBIT:
+    case CMD_REQ_REDIS_GETRANGE:
+    case CMD_REQ_REDIS_MGET:
+    case CMD_REQ_REDIS_STRLEN:
+
+    case CMD_REQ_REDIS_HEXISTS:
+    case CMD_REQ_REDIS_HGET:
+    case CMD_REQ_REDIS_HGETALL:
+    case CMD_REQ_REDIS_HKEYS:
+    case CMD_REQ_REDIS_HLEN:
+    case CMD_REQ_REDIS_HMGET:
+    case CMD_REQ_REDIS_HSCAN:
+    case CMD_REQ_REDIS_HVALS:
+
+    case CMD_REQ_REDIS_LINDEX:
+    case CMD_REQ_REDIS_LLEN:
+    case CMD_REQ_REDIS_LRANGE:
+
+    case CMD_REQ_REDIS_PFCOUNT:
+
+    case CMD_REQ_REDIS_SCARD:
+    case CMD_REQ_REDIS_SDIFF:
+    case CMD_REQ_REDIS_SINTER:
+    case CMD_REQ_REDIS_SISMEMBER:
+    case CMD_REQ_REDIS_SMEMBERS:
+    case CMD_REQ_REDIS_SRANDMEMBER:
+    case CMD_REQ_REDIS_SUNION:
+    case CMD_REQ_REDIS_SSCAN:
+
+    case CMD_REQ_REDIS_ZCARD:
+    case CMD_REQ_REDIS_ZCOUNT:
+    case CMD_REQ_REDIS_ZLEXCOUNT:
+    case CMD_REQ_REDIS_ZRANGE:
+    case CMD_REQ_REDIS_ZRANGEBYLEX:
+    case CMD_REQ_REDIS_ZRANGEBYSCORE:
+    case CMD_REQ_REDIS_ZRANK:
+    case CMD_REQ_REDIS_ZREVRANGE:
+    case CMD_REQ_REDIS_ZREVRANGEBYSCORE:
+    case CMD_REQ_REDIS_ZREVRANK:
+    case CMD_REQ_REDIS_ZSCORE:
+    case CMD_REQ_REDIS_ZSCAN:
+        return 1;
+
     default:
+        break;
+    }
+
+    return 0;
+}
+
+/* Hash of a command name, the same for any case of its letters. Must be kept
+ * identical to verb_hash() in gen_command_verbs.py. */
+static inline uint32_t cmd_verb_hash(const char *m, int len) {
+    uint32_t h = CMD_VERB_SEED;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ ((uint8_t)m[i] | 0x20)) * 16777619U;
+    }
+    return h ^ (h >> 16);
+}
+
+/* Look up the command type of a command name using the perfect hash in
+ * command_verbs.h. Only the one command name in the slot it hashes to is
+ * compared. */
+static inline cmd_type_t redis_parse_cmd_verb(const char *m, int len) {
+    const char *name;
+    uint32_t h, slot;
+    cmd_type_t type;
+    int i;
+
+    if (len <= 0 || len > CMD_VERB_MAX_LEN) {
         return CMD_UNKNOWN;
     }
-    // clang-format on
+
+    h = cmd_verb_hash(m, len);
+    slot = (h >> 8) ^ cmd_verb_displacement[h % CMD_VERB_BUCKETS];
+    type = cmd_verb_slot[slot % CMD_VERB_SLOTS];
+    if (type == CMD_UNKNOWN) {
+        return CMD_UNKNOWN;
+    }
+
+    /* The names are lowercase letters, which a letter of either case equals
+     * when its case bit is set. A shorter name ends in a mismatch. */
+    name = cmd_verb_name[type];
+    for (i = 0; i < len; i++) {
+        if (((uint8_t)m[i] | 0x20) != (uint8_t)name[i]) {
+            return CMD_UNKNOWN;
+        }
+    }
+    return name[len] == '\0' ? type : CMD_UNKNOWN;
 }
 
 /*
@@ -584,6 +545,7 @@ void redis_parse_cmd(struct cmd *r) {
             if (r->type == CMD_UNKNOWN) {
                 goto error;
             }
+            r->readonly = redis_readonly(r);
 
             state = SW_CMD_TYPE_LF;
             break;
@@ -707,12 +669,13 @@ void redis_parse_cmd(struct cmd *r) {
                     }
                     state = SW_KEY_LEN;
                 } else if (redis_argkvx(r)) {
-                    if (rnarg == 0) {
-                        goto done;
-                    }
+                    /* Also a single key without a value */
                     if (r->narg % 2 == 0) {
                         goto error;
                     }
+                    if (rnarg == 0) {
+                        goto done;
+                    }
                     state = SW_ARG1_LEN;
                 } else if (redis_argeval(r)) {
                     if (rnarg == 0) {
@@ -1176,30 +1139,368 @@ oom:
     r->result = CMD_PARSE_ENOMEM;
 }
 
-struct cmd *command_get() {
-    struct cmd *command;
-    command = hi_malloc(sizeof(struct cmd));
-    if (command == NULL) {
+/*
+ * Classify a command formatted from the given arguments like
+ * redis_parse_cmd() does, but take the command name and the keys from the
+ * arguments instead of scanning the formatted command. The command must hold
+ * exactly these arguments as formatted by redisFormatCommandArgv(), so the
+ * position of each key follows from the lengths of the arguments before it.
+ */
+void redis_parse_cmd_argv(struct cmd *r, int argc, const char **argv,
+                          const size_t *argvlen) {
+    struct keypos *kpos;
+    char *p;
+    uint32_t nkey;
+    size_t j;
+    int len, i, first_key, last_key, step;
+
+    ASSERT(r->cmd != NULL && r->clen > 0);
+
+    if (argc < 1 || argvlen[0] == 0) {
+        goto error;
+    }
+
+    r->narg_start = r->cmd;
+    r->narg_end = r->cmd + 1 + uint_len(argc);
+    r->narg = (uint32_t)argc;
+
+    r->type = redis_parse_cmd_verb(argv[0], (int)argvlen[0]);
+    if (r->type == CMD_UNKNOWN) {
+        goto error;
+    }
+    r->readonly = redis_readonly(r);
+
+    first_key = 1;
+    last_key = 1;
+    step = 1;
+
+    /* Like a parsed command, a command without arguments has no keys */
+    if (redis_argz(r) || argc == 1) {
+        goto done;
+    } else if (redis_arg0(r)) {
+        if (argc != 2) {
+            goto error;
+        }
+    } else if (redis_arg1(r)) {
+        if (argc != 3) {
+            goto error;
+        }
+    } else if (redis_arg2(r)) {
+        if (argc != 4) {
+            goto error;
+        }
+    } else if (redis_arg3(r)) {
+        if (argc != 5) {
+            goto error;
+        }
+    } else if (redis_argn(r)) {
+        /* The key is followed by any number of arguments */
+    } else if (redis_argx(r)) {
+        last_key = argc - 1;
+    } else if (redis_argkvx(r)) {
+        if (argc % 2 == 0) {
+            goto error;
+        }
+        last_key = argc - 2;
+        step = 2;
+    } else if (redis_argeval(r)) {
+        /* The script and the number of keys, which can not be 0, come
+         * before the key. As in redis_parse_cmd() the first key is used. */
+        if (argc < 4 || argvlen[2] == 0) {
+            goto error;
+        }
+        for (nkey = 0, j = 0; j < argvlen[2]; j++) {
+            if (!isdigit(argv[2][j])) {
+                goto error;
+            }
+            nkey = nkey * 10 + (uint32_t)(argv[2][j] - '0');
+        }
+        if (nkey == 0) {
+            goto error;
+        }
+        first_key = 3;
+        last_key = 3;
+    } else {
+        goto error;
+    }
+
+    /* Skip "*<argc>\r\n", then "$<len>\r\n<arg>\r\n" for each argument */
+    p = r->narg_end + CRLF_LEN;
+    for (i = 0; i <= last_key; i++) {
+        p += 1 + uint_len(argvlen[i]) + CRLF_LEN;
+
+        if (i >= first_key && (i - first_key) % step == 0) {
+            kpos = hiarray_push(r->keys);
+            if (kpos == NULL) {
+                goto oom;
+            }
+            kpos->start = p;
+            kpos->end = p + argvlen[i];
+        }
+
+        p += argvlen[i] + CRLF_LEN;
+    }
+
+    ASSERT(p <= r->cmd + r->clen);
+
+done:
+    ASSERT(r->type > CMD_UNKNOWN && r->type < CMD_SENTINEL);
+    r->result = CMD_PARSE_OK;
+    return;
+
+error:
+    r->result = CMD_PARSE_ERROR;
+    errno = EINVAL;
+    if (r->errstr == NULL) {
+        r->errstr = hi_malloc(100 * sizeof(*r->errstr));
+        if (r->errstr == NULL) {
+            goto oom;
+        }
+    }
+
+    len = _scnprintf(r->errstr, 100,
+                     "Parse command error. Cmd type: %d, arguments: %d.",
+                     r->type, argc);
+    r->errstr[len] = '\0';
+    return;
+
+oom:
+    r->result = CMD_PARSE_ENOMEM;
+}
+
+/* Parse "<prefix><number>\r\n" at p. Returns the position after it and sets
+ * the number, or returns NULL if malformed. */
+static char *redis_cmd_parse_len(char *p, char *end, char prefix,
+                                 uint32_t *len) {
+    char *digits;
+    uint32_t n = 0;
+
+    if (p >= end || *p != prefix) {
+        return NULL;
+    }
+
+    for (digits = ++p; p < end && isdigit(*p); p++) {
+        if (n > (UINT32_MAX - 9) / 10) {
+            return NULL;
+        }
+        n = n * 10 + (uint32_t)(*p - '0');
+    }
+
+    if (p == digits || end - p < (long)CRLF_LEN || p[0] != CR || p[1] != LF) {
+        return NULL;
+    }
+
+    *len = n;
+    return p + CRLF_LEN;
+}
+
+/* Parse the bulk string argument at p, skipping its content by its length.
+ * Returns the position of the next argument and sets the argument, or
+ * returns NULL if malformed. */
+static char *redis_cmd_parse_arg(char *p, char *end, char **arg,
+                                 uint32_t *len) {
+    p = redis_cmd_parse_len(p, end, '$', len);
+    if (p == NULL || (uint32_t)(end - p) < *len + CRLF_LEN || p[*len] != CR ||
+        p[*len + 1] != LF) {
+        return NULL;
+    }
+
+    *arg = p;
+    return p + *len + CRLF_LEN;
+}
+
+/* Look up the key spec of a command, or of a subcommand when sub is given,
+ * by its lowercase name. */
+static struct cmd_key_spec *redis_cmd_key_spec(dict *specs, const char *name,
+                                               uint32_t len, const char *sub,
+                                               uint32_t sub_len) {
+    char buf[CMD_KEY_SPEC_NAME_MAX + 1];
+    dictEntry *de;
+    uint32_t i, n = 0;
+
+    if (len > CMD_KEY_SPEC_NAME_MAX ||
+        (sub != NULL && sub_len >= CMD_KEY_SPEC_NAME_MAX - len)) {
         return NULL;
     }
 
+    /* A NUL would end the name early and match another command */
+    for (i = 0; i < len; i++) {
+        if (name[i] == '\0') {
+            return NULL;
+        }
+        buf[n++] = (char)tolower((unsigned char)name[i]);
+    }
+    if (sub != NULL) {
+        buf[n++] = '|';
+        for (i = 0; i < sub_len; i++) {
+            if (sub[i] == '\0') {
+                return NULL;
+            }
+            buf[n++] = (char)tolower((unsigned char)sub[i]);
+        }
+    }
+    buf[n] = '\0';
+
+    de = dictFind(specs, buf);
+    return de != NULL ? dictGetEntryVal(de) : NULL;
+}
+
+/*
+ * Classify a command that redis_parse_cmd() does not know, using a table of
+ * key specs learned from the COMMAND command. The table maps lowercase
+ * command names, and "command|subcommand" names, to struct cmd_key_spec.
+ *
+ * Only the first key is taken, which decides the slot, like for the
+ * compiled-in commands that take several keys but are not split by slot.
+ * The arguments before the key are skipped by their lengths. A command
+ * missing from the table is left as it is.
+ */
+void redis_parse_cmd_key_spec(struct cmd *r, dict *specs) {
+    struct cmd_key_spec *spec, *sub_spec;
+    struct keypos *kpos;
+    char *p, *end, *verb, *arg, *sub;
+    uint32_t narg, verb_len, len, sub_len, i, nkey;
+    int errlen;
+
+    ASSERT(r->cmd != NULL && r->clen > 0 && hiarray_n(r->keys) == 0);
+
+    end = r->cmd + r->clen;
+
+    p = redis_cmd_parse_len(r->cmd, end, '*', &narg);
+    if (p == NULL || narg == 0) {
+        return;
+    }
+    r->narg_start = r->cmd;
+    r->narg_end = p - CRLF_LEN;
+    r->narg = narg;
+
+    p = redis_cmd_parse_arg(p, end, &verb, &verb_len);
+    if (p == NULL) {
+        return;
+    }
+
+    spec = redis_cmd_key_spec(specs, verb, verb_len, NULL, 0);
+    if (spec == NULL) {
+        return;
+    }
+    if (spec->subcommands && narg > 1 &&
+        redis_cmd_parse_arg(p, end, &sub, &sub_len) != NULL) {
+        sub_spec = redis_cmd_key_spec(specs, verb, verb_len, sub, sub_len);
+        if (sub_spec != NULL) {
+            spec = sub_spec;
+        }
+    }
+
+    r->readonly = spec->readonly;
+
+    if ((spec->arity > 0 && narg != (uint32_t)spec->arity) ||
+        (spec->arity < 0 && narg < (uint32_t)-spec->arity)) {
+        goto error;
+    }
+
+    /* p is at argument i */
+    i = 1;
+
+    if (spec->keynum_index > 0) {
+        for (; i <= (uint32_t)spec->keynum_index; i++) {
+            if (i >= narg) {
+                goto error;
+            }
+            p = redis_cmd_parse_arg(p, end, &arg, &len);
+            if (p == NULL) {
+                goto error;
+            }
+        }
+
+        for (nkey = 0; len > 0; arg++, len--) {
+            if (!isdigit(*arg) || nkey > (UINT32_MAX - 9) / 10) {
+                goto error;
+            }
+            nkey = nkey * 10 + (uint32_t)(*arg - '0');
+        }
+        if (nkey == 0) {
+            goto done;
+        }
+    }
+
+    if (spec->first_key <= 0) {
+        goto done;
+    }
+
+    for (; i <= (uint32_t)spec->first_key; i++) {
+        if (i >= narg) {
+            goto error;
+        }
+        p = redis_cmd_parse_arg(p, end, &arg, &len);
+        if (p == NULL) {
+            goto error;
+        }
+    }
+
+    kpos = hiarray_push(r->keys);
+    if (kpos == NULL) {
+        goto oom;
+    }
+    kpos->start = arg;
+    kpos->end = arg + len;
+
+done:
+    r->result = CMD_PARSE_OK;
+    return;
+
+error:
+    r->result = CMD_PARSE_ERROR;
+    errno = EINVAL;
+    if (r->errstr == NULL) {
+        r->errstr = hi_malloc(100 * sizeof(*r->errstr));
+        if (r->errstr == NULL) {
+            goto oom;
+        }
+    }
+
+    errlen = _scnprintf(r->errstr, 100,
+                        "Parse command error. Command: %.*s, arguments: %u.",
+                        (int)(verb_len < 32 ? verb_len : 32), verb, narg);
+    r->errstr[errlen] = '\0';
+    return;
+
+oom:
+    r->result = CMD_PARSE_ENOMEM;
+}
+
+/* Set the fields of a new or emptied command, except its key array. A
+ * command on the stack is given caller provided keys and must not be passed
+ * to command_destroy(). */
+void command_init(struct cmd *command) {
     command->id = ++cmd_id;
     command->result = CMD_PARSE_OK;
     command->errstr = NULL;
     command->type = CMD_UNKNOWN;
     command->cmd = NULL;
     command->clen = 0;
-    command->keys = NULL;
     command->narg_start = NULL;
     command->narg_end = NULL;
     command->narg = 0;
     command->quit = 0;
     command->noforward = 0;
+    command->readonly = 0;
+    command->asking = 0;
     command->slot_num = -1;
     command->frag_seq = NULL;
     command->reply = NULL;
     command->sub_commands = NULL;
     command->node_addr = NULL;
+    command->node = NULL;
+}
+
+struct cmd *command_get() {
+    struct cmd *command;
+    command = hi_malloc(sizeof(struct cmd));
+    if (command == NULL) {
+        return NULL;
+    }
+
+    command_init(command);
 
     command->keys = hiarray_create(1, sizeof(struct keypos));
     if (command->keys == NULL) {
@@ -1210,6 +1511,26 @@ struct cmd *command_get() {
     return command;
 }
 
+/* Empty a command so that it can be reused. The key array is kept with its
+ * allocated size. */
+void command_reset(struct cmd *command) {
+    hi_free(command->cmd);
+    hi_free(command->errstr);
+    hi_free(command->frag_seq);
+    freeReplyObject(command->reply);
+
+    if (command->sub_commands != NULL) {
+        listRelease(command->sub_commands);
+    }
+
+    if (command->node_addr != NULL) {
+        sdsfree(command->node_addr);
+    }
+
+    command->keys->nelem = 0;
+    command_init(command);
+}
+
 void command_destroy(struct cmd *command) {
     if (command == NULL) {
         return;
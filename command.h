@@ -138,6 +138,22 @@ struct keypos {
                             pairs in command, like mset */
 };
 
+/* Key positions of a command, as given by the COMMAND command */
+struct cmd_key_spec {
+    int arity;                /* # arguments, or the minimum if negative */
+    int first_key;            /* Index of the first key, 0 if none */
+    int last_key;             /* Index of the last key, negative from end */
+    int step;                 /* # arguments from one key to the next */
+    int keynum_index;         /* Index of the # keys argument, 0 if none */
+    unsigned readonly : 1;    /* can be served by a replica? */
+    unsigned subcommands : 1; /* has subcommands with their own keys? */
+};
+
+/* Longest command name, or "command|subcommand", in a key spec table */
+#define CMD_KEY_SPEC_NAME_MAX 64
+
+struct dict;
+
 struct cmd {
 
     uint64_t id; /* command id */
@@ -158,6 +174,8 @@ struct cmd {
 
     unsigned quit : 1;      /* quit request? */
     unsigned noforward : 1; /* not need forward (example: ping) */
+    unsigned readonly : 1;  /* can be served by a replica? */
+    unsigned asking : 1;    /* sent preceded by ASKING? */
 
     /* Command destination */
     int slot_num;    /* Command should be sent to slot.
@@ -167,6 +185,8 @@ struct cmd {
                       * nodes (cross slot) */
     char *node_addr; /* Command sent to this node address */
 
+    struct cluster_node *node; /* Node a fragment was sent to, or NULL */
+
     struct cmd *
         *frag_seq; /* sequence of fragment command, map from keys to fragments*/
 
@@ -176,8 +196,13 @@ struct cmd {
 };
 
 void redis_parse_cmd(struct cmd *r);
+void redis_parse_cmd_argv(struct cmd *r, int argc, const char **argv,
+                          const size_t *argvlen);
+void redis_parse_cmd_key_spec(struct cmd *r, struct dict *specs);
 
+void command_init(struct cmd *command);
 struct cmd *command_get(void);
+void command_reset(struct cmd *command);
 void command_destroy(struct cmd *command);
 
 #endif
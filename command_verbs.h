@@ -0,0 +1,232 @@
+/* Generated by gen_command_verbs.py from command.h, do not edit. */
+#ifndef __COMMAND_VERBS_H_
+#define __COMMAND_VERBS_H_
+
+#define CMD_VERB_SEED 0x00000001U
+#define CMD_VERB_BUCKETS 64
+#define CMD_VERB_SLOTS 256
+#define CMD_VERB_MAX_LEN 16
+
+static const uint8_t cmd_verb_displacement[CMD_VERB_BUCKETS] = {
+    12, 0, 0, 0, 2, 0, 2, 0, 2, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 2, 1, 0, 0, 1, 0,
+    0, 0, 0, 0, 0, 1, 12, 1, 0, 1, 0, 0, 0, 3, 0, 0, 0, 1, 0, 6, 1, 0, 0, 1, 0,
+    4, 0, 0, 1, 1, 0, 4, 0, 0, 0, 4, 0, 1, 0,
+};
+
+/* Command type of each slot, CMD_UNKNOWN when unused */
+static const uint8_t cmd_verb_slot[CMD_VERB_SLOTS] = {
+    [0] = CMD_REQ_REDIS_SETBIT,
+    [1] = CMD_REQ_REDIS_BITCOUNT,
+    [3] = CMD_REQ_REDIS_ZRANGE,
+    [10] = CMD_REQ_REDIS_SET,
+    [13] = CMD_REQ_REDIS_LINDEX,
+    [16] = CMD_REQ_REDIS_LRANGE,
+    [17] = CMD_REQ_REDIS_MSET,
+    [23] = CMD_REQ_REDIS_ZSCORE,
+    [24] = CMD_REQ_REDIS_RPOP,
+    [25] = CMD_REQ_REDIS_HVALS,
+    [26] = CMD_REQ_REDIS_LLEN,
+    [27] = CMD_REQ_REDIS_HGETALL,
+    [29] = CMD_REQ_REDIS_ZREVRANK,
+    [31] = CMD_REQ_REDIS_SSCAN,
+    [34] = CMD_REQ_REDIS_SORT,
+    [40] = CMD_REQ_REDIS_SUNIONSTORE,
+    [41] = CMD_REQ_REDIS_EXPIRE,
+    [44] = CMD_REQ_REDIS_EVALSHA,
+    [47] = CMD_REQ_REDIS_EVAL,
+    [49] = CMD_REQ_REDIS_PFMERGE,
+    [57] = CMD_REQ_REDIS_PEXPIREAT,
+    [59] = CMD_REQ_REDIS_LPOP,
+    [61] = CMD_REQ_REDIS_GETSET,
+    [63] = CMD_REQ_REDIS_HSCAN,
+    [64] = CMD_REQ_REDIS_RESTORE,
+    [68] = CMD_REQ_REDIS_LPUSHX,
+    [70] = CMD_REQ_REDIS_STRLEN,
+    [72] = CMD_REQ_REDIS_PING,
+    [73] = CMD_REQ_REDIS_PFCOUNT,
+    [74] = CMD_REQ_REDIS_SMEMBERS,
+    [77] = CMD_REQ_REDIS_SETEX,
+    [78] = CMD_REQ_REDIS_LSET,
+    [81] = CMD_REQ_REDIS_LINSERT,
+    [82] = CMD_REQ_REDIS_PTTL,
+    [88] = CMD_REQ_REDIS_INCRBYFLOAT,
+    [89] = CMD_REQ_REDIS_EXISTS,
+    [96] = CMD_REQ_REDIS_HDEL,
+    [97] = CMD_REQ_REDIS_SADD,
+    [98] = CMD_REQ_REDIS_INCR,
+    [99] = CMD_REQ_REDIS_HSETNX,
+    [100] = CMD_REQ_REDIS_HGET,
+    [101] = CMD_REQ_REDIS_ZRANGEBYSCORE,
+    [102] = CMD_REQ_REDIS_HMSET,
+    [103] = CMD_REQ_REDIS_SISMEMBER,
+    [104] = CMD_REQ_REDIS_LREM,
+    [106] = CMD_REQ_REDIS_SUNION,
+    [108] = CMD_REQ_REDIS_AUTH,
+    [109] = CMD_REQ_REDIS_ZREM,
+    [110] = CMD_REQ_REDIS_SINTERSTORE,
+    [111] = CMD_REQ_REDIS_PFADD,
+    [112] = CMD_REQ_REDIS_ZRANK,
+    [113] = CMD_REQ_REDIS_HLEN,
+    [115] = CMD_REQ_REDIS_SETNX,
+    [117] = CMD_REQ_REDIS_SDIFF,
+    [119] = CMD_REQ_REDIS_DUMP,
+    [120] = CMD_REQ_REDIS_SETRANGE,
+    [138] = CMD_REQ_REDIS_INCRBY,
+    [140] = CMD_REQ_REDIS_GETBIT,
+    [144] = CMD_REQ_REDIS_ZCOUNT,
+    [145] = CMD_REQ_REDIS_SDIFFSTORE,
+    [146] = CMD_REQ_REDIS_HSET,
+    [147] = CMD_REQ_REDIS_SCARD,
+    [149] = CMD_REQ_REDIS_PSETEX,
+    [150] = CMD_REQ_REDIS_ZREMRANGEBYSCORE,
+    [152] = CMD_REQ_REDIS_HMGET,
+    [154] = CMD_REQ_REDIS_SMOVE,
+    [159] = CMD_REQ_REDIS_TYPE,
+    [160] = CMD_REQ_REDIS_QUIT,
+    [161] = CMD_REQ_REDIS_DEL,
+    [170] = CMD_REQ_REDIS_ZREVRANGE,
+    [179] = CMD_REQ_REDIS_GET,
+    [180] = CMD_REQ_REDIS_RPOPLPUSH,
+    [186] = CMD_REQ_REDIS_ZINCRBY,
+    [188] = CMD_REQ_REDIS_ZSCAN,
+    [189] = CMD_REQ_REDIS_SINTER,
+    [192] = CMD_REQ_REDIS_HINCRBY,
+    [194] = CMD_REQ_REDIS_HEXISTS,
+    [200] = CMD_REQ_REDIS_ZREVRANGEBYSCORE,
+    [201] = CMD_REQ_REDIS_SREM,
+    [202] = CMD_REQ_REDIS_ZRANGEBYLEX,
+    [207] = CMD_REQ_REDIS_ZREMRANGEBYLEX,
+    [208] = CMD_REQ_REDIS_HINCRBYFLOAT,
+    [210] = CMD_REQ_REDIS_ZUNIONSTORE,
+    [218] = CMD_REQ_REDIS_PERSIST,
+    [220] = CMD_REQ_REDIS_ZLEXCOUNT,
+    [221] = CMD_REQ_REDIS_ZADD,
+    [224] = CMD_REQ_REDIS_ZCARD,
+    [230] = CMD_REQ_REDIS_PEXPIRE,
+    [232] = CMD_REQ_REDIS_TTL,
+    [233] = CMD_REQ_REDIS_MGET,
+    [238] = CMD_REQ_REDIS_ZINTERSTORE,
+    [239] = CMD_REQ_REDIS_GETRANGE,
+    [240] = CMD_REQ_REDIS_LPUSH,
+    [242] = CMD_REQ_REDIS_HKEYS,
+    [243] = CMD_REQ_REDIS_EXPIREAT,
+    [244] = CMD_REQ_REDIS_DECRBY,
+    [245] = CMD_REQ_REDIS_RPUSHX,
+    [246] = CMD_REQ_REDIS_SPOP,
+    [247] = CMD_REQ_REDIS_RPUSH,
+    [248] = CMD_REQ_REDIS_SRANDMEMBER,
+    [249] = CMD_REQ_REDIS_DECR,
+    [250] = CMD_REQ_REDIS_LTRIM,
+    [251] = CMD_REQ_REDIS_ZREMRANGEBYRANK,
+    [252] = CMD_REQ_REDIS_APPEND,
+};
+
+/* Lowercase name of each command type */
+static const char *const cmd_verb_name[] = {
+    [CMD_REQ_REDIS_DEL] = "del",
+    [CMD_REQ_REDIS_EXISTS] = "exists",
+    [CMD_REQ_REDIS_EXPIRE] = "expire",
+    [CMD_REQ_REDIS_EXPIREAT] = "expireat",
+    [CMD_REQ_REDIS_PEXPIRE] = "pexpire",
+    [CMD_REQ_REDIS_PEXPIREAT] = "pexpireat",
+    [CMD_REQ_REDIS_PERSIST] = "persist",
+    [CMD_REQ_REDIS_PTTL] = "pttl",
+    [CMD_REQ_REDIS_SORT] = "sort",
+    [CMD_REQ_REDIS_TTL] = "ttl",
+    [CMD_REQ_REDIS_TYPE] = "type",
+    [CMD_REQ_REDIS_APPEND] = "append",
+    [CMD_REQ_REDIS_BITCOUNT] = "bitcount",
+    [CMD_REQ_REDIS_DECR] = "decr",
+    [CMD_REQ_REDIS_DECRBY] = "decrby",
+    [CMD_REQ_REDIS_DUMP] = "dump",
+    [CMD_REQ_REDIS_GET] = "get",
+    [CMD_REQ_REDIS_GETBIT] = "getbit",
+    [CMD_REQ_REDIS_GETRANGE] = "getrange",
+    [CMD_REQ_REDIS_GETSET] = "getset",
+    [CMD_REQ_REDIS_INCR] = "incr",
+    [CMD_REQ_REDIS_INCRBY] = "incrby",
+    [CMD_REQ_REDIS_INCRBYFLOAT] = "incrbyfloat",
+    [CMD_REQ_REDIS_MGET] = "mget",
+    [CMD_REQ_REDIS_MSET] = "mset",
+    [CMD_REQ_REDIS_PSETEX] = "psetex",
+    [CMD_REQ_REDIS_RESTORE] = "restore",
+    [CMD_REQ_REDIS_SET] = "set",
+    [CMD_REQ_REDIS_SETBIT] = "setbit",
+    [CMD_REQ_REDIS_SETEX] = "setex",
+    [CMD_REQ_REDIS_SETNX] = "setnx",
+    [CMD_REQ_REDIS_SETRANGE] = "setrange",
+    [CMD_REQ_REDIS_STRLEN] = "strlen",
+    [CMD_REQ_REDIS_HDEL] = "hdel",
+    [CMD_REQ_REDIS_HEXISTS] = "hexists",
+    [CMD_REQ_REDIS_HGET] = "hget",
+    [CMD_REQ_REDIS_HGETALL] = "hgetall",
+    [CMD_REQ_REDIS_HINCRBY] = "hincrby",
+    [CMD_REQ_REDIS_HINCRBYFLOAT] = "hincrbyfloat",
+    [CMD_REQ_REDIS_HKEYS] = "hkeys",
+    [CMD_REQ_REDIS_HLEN] = "hlen",
+    [CMD_REQ_REDIS_HMGET] = "hmget",
+    [CMD_REQ_REDIS_HMSET] = "hmset",
+    [CMD_REQ_REDIS_HSET] = "hset",
+    [CMD_REQ_REDIS_HSETNX] = "hsetnx",
+    [CMD_REQ_REDIS_HSCAN] = "hscan",
+    [CMD_REQ_REDIS_HVALS] = "hvals",
+    [CMD_REQ_REDIS_LINDEX] = "lindex",
+    [CMD_REQ_REDIS_LINSERT] = "linsert",
+    [CMD_REQ_REDIS_LLEN] = "llen",
+    [CMD_REQ_REDIS_LPOP] = "lpop",
+    [CMD_REQ_REDIS_LPUSH] = "lpush",
+    [CMD_REQ_REDIS_LPUSHX] = "lpushx",
+    [CMD_REQ_REDIS_LRANGE] = "lrange",
+    [CMD_REQ_REDIS_LREM] = "lrem",
+    [CMD_REQ_REDIS_LSET] = "lset",
+    [CMD_REQ_REDIS_LTRIM] = "ltrim",
+    [CMD_REQ_REDIS_PFADD] = "pfadd",
+    [CMD_REQ_REDIS_PFCOUNT] = "pfcount",
+    [CMD_REQ_REDIS_PFMERGE] = "pfmerge",
+    [CMD_REQ_REDIS_RPOP] = "rpop",
+    [CMD_REQ_REDIS_RPOPLPUSH] = "rpoplpush",
+    [CMD_REQ_REDIS_RPUSH] = "rpush",
+    [CMD_REQ_REDIS_RPUSHX] = "rpushx",
+    [CMD_REQ_REDIS_SADD] = "sadd",
+    [CMD_REQ_REDIS_SCARD] = "scard",
+    [CMD_REQ_REDIS_SDIFF] = "sdiff",
+    [CMD_REQ_REDIS_SDIFFSTORE] = "sdiffstore",
+    [CMD_REQ_REDIS_SINTER] = "sinter",
+    [CMD_REQ_REDIS_SINTERSTORE] = "sinterstore",
+    [CMD_REQ_REDIS_SISMEMBER] = "sismember",
+    [CMD_REQ_REDIS_SMEMBERS] = "smembers",
+    [CMD_REQ_REDIS_SMOVE] = "smove",
+    [CMD_REQ_REDIS_SPOP] = "spop",
+    [CMD_REQ_REDIS_SRANDMEMBER] = "srandmember",
+    [CMD_REQ_REDIS_SREM] = "srem",
+    [CMD_REQ_REDIS_SUNION] = "sunion",
+    [CMD_REQ_REDIS_SUNIONSTORE] = "sunionstore",
+    [CMD_REQ_REDIS_SSCAN] = "sscan",
+    [CMD_REQ_REDIS_ZADD] = "zadd",
+    [CMD_REQ_REDIS_ZCARD] = "zcard",
+    [CMD_REQ_REDIS_ZCOUNT] = "zcount",
+    [CMD_REQ_REDIS_ZINCRBY] = "zincrby",
+    [CMD_REQ_REDIS_ZINTERSTORE] = "zinterstore",
+    [CMD_REQ_REDIS_ZLEXCOUNT] = "zlexcount",
+    [CMD_REQ_REDIS_ZRANGE] = "zrange",
+    [CMD_REQ_REDIS_ZRANGEBYLEX] = "zrangebylex",
+    [CMD_REQ_REDIS_ZRANGEBYSCORE] = "zrangebyscore",
+    [CMD_REQ_REDIS_ZRANK] = "zrank",
+    [CMD_REQ_REDIS_ZREM] = "zrem",
+    [CMD_REQ_REDIS_ZREMRANGEBYRANK] = "zremrangebyrank",
+    [CMD_REQ_REDIS_ZREMRANGEBYLEX] = "zremrangebylex",
+    [CMD_REQ_REDIS_ZREMRANGEBYSCORE] = "zremrangebyscore",
+    [CMD_REQ_REDIS_ZREVRANGE] = "zrevrange",
+    [CMD_REQ_REDIS_ZREVRANGEBYSCORE] = "zrevrangebyscore",
+    [CMD_REQ_REDIS_ZREVRANK] = "zrevrank",
+    [CMD_REQ_REDIS_ZSCORE] = "zscore",
+    [CMD_REQ_REDIS_ZUNIONSTORE] = "zunionstore",
+    [CMD_REQ_REDIS_ZSCAN] = "zscan",
+    [CMD_REQ_REDIS_EVAL] = "eval",
+    [CMD_REQ_REDIS_EVALSHA] = "evalsha",
+    [CMD_REQ_REDIS_PING] = "ping",
+    [CMD_REQ_REDIS_QUIT] = "quit",
+    [CMD_REQ_REDIS_AUTH] = "auth",
+};
+
+#endif
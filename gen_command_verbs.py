@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Generate command_verbs.h, the command name lookup used by command.c.
+
+The command names are taken from the REQ_REDIS_* entries of CMD_TYPE_CODEC
+in command.h. A name maps to its command type using a hash-and-displace
+perfect hash: the hash of the lowercased name selects a bucket, and the
+displacement stored for the bucket moves the names of the bucket to free
+slots. The hash function below must be kept identical to cmd_verb_hash() in
+command.c.
+
+Usage: gen_command_verbs.py [command.h] > command_verbs.h
+
+Run it after changing CMD_TYPE_CODEC.
+"""
+
+import re
+import sys
+import textwrap
+
+BUCKETS = 64
+SLOTS = 256
+MASK32 = 0xFFFFFFFF
+
+
+def cmd_types(header):
+    """Return the command types in CMD_TYPE_CODEC, in enum order."""
+    with open(header) as f:
+        text = f.read()
+    codec = re.search(r"#define CMD_TYPE_CODEC\(ACTION\)(.*?)\n\n", text,
+                      re.DOTALL)
+    if codec is None:
+        sys.exit("CMD_TYPE_CODEC not found in " + header)
+    return re.findall(r"ACTION\((\w+)\)", codec.group(1))
+
+
+def verb_hash(seed, verb):
+    h = seed
+    for ch in verb.encode():
+        h = ((h ^ (ch | 0x20)) * 16777619) & MASK32
+    return h ^ (h >> 16)
+
+
+def find_displacements(seed, verbs):
+    """Return the displacement of each bucket, or None if the verbs can not
+    be placed using this seed."""
+    buckets = [[] for _ in range(BUCKETS)]
+    for verb in verbs:
+        h = verb_hash(seed, verb)
+        buckets[h % BUCKETS].append(h >> 8)
+
+    displacements = [0] * BUCKETS
+    slots = {}
+    # Place the fullest buckets first, while most slots are free
+    order = sorted(range(BUCKETS), key=lambda b: -len(buckets[b]))
+    for bucket in order:
+        hashes = buckets[bucket]
+        if not hashes:
+            continue
+        for d in range(SLOTS):
+            targets = {(h ^ d) % SLOTS for h in hashes}
+            if len(targets) == len(hashes) and not targets & slots.keys():
+                displacements[bucket] = d
+                for h in hashes:
+                    slots[(h ^ d) % SLOTS] = h
+                break
+        else:
+            return None
+    return displacements
+
+
+def main():
+    header = sys.argv[1] if len(sys.argv) > 1 else "command.h"
+    types = cmd_types(header)
+    verbs = {t[len("REQ_REDIS_"):].lower(): t for t in types
+             if t.startswith("REQ_REDIS_")}
+
+    if len(types) > 256:
+        sys.exit("Command types do not fit in uint8_t")
+    for verb in verbs:
+        if not re.fullmatch("[a-z]+", verb):
+            sys.exit("Command name is not only letters: " + verb)
+
+    for seed in range(1, 1 << 20):
+        displacements = find_displacements(seed, verbs)
+        if displacements is not None:
+            break
+    else:
+        sys.exit("No perfect hash found")
+
+    slots = ["UNKNOWN"] * SLOTS
+    for verb, t in verbs.items():
+        h = verb_hash(seed, verb)
+        slots[((h >> 8) ^ displacements[h % BUCKETS]) % SLOTS] = t
+
+    out = sys.stdout
+    out.write("/* Generated by gen_command_verbs.py from command.h, do not "
+              "edit. */\n")
+    out.write("#ifndef __COMMAND_VERBS_H_\n#define __COMMAND_VERBS_H_\n\n")
+    out.write("#define CMD_VERB_SEED 0x%08xU\n" % seed)
+    out.write("#define CMD_VERB_BUCKETS %d\n" % BUCKETS)
+    out.write("#define CMD_VERB_SLOTS %d\n" % SLOTS)
+    out.write("#define CMD_VERB_MAX_LEN %d\n\n" % max(map(len, verbs)))
+
+    out.write("static const uint8_t cmd_verb_displacement[CMD_VERB_BUCKETS]"
+              " = {\n")
+    rows = textwrap.wrap(", ".join(map(str, displacements)) + ",", 76)
+    for row in rows:
+        out.write("    %s\n" % row)
+    out.write("};\n\n")
+
+    out.write("/* Command type of each slot, CMD_UNKNOWN when unused */\n")
+    out.write("static const uint8_t cmd_verb_slot[CMD_VERB_SLOTS] = {\n")
+    for i, t in enumerate(slots):
+        if t != "UNKNOWN":
+            out.write("    [%d] = CMD_%s,\n" % (i, t))
+    out.write("};\n\n")
+
+    out.write("/* Lowercase name of each command type */\n")
+    out.write("static const char *const cmd_verb_name[] = {\n")
+    for verb, t in verbs.items():
+        out.write("    [CMD_%s] = \"%s\",\n" % (t, verb))
+    out.write("};\n\n")
+
+    out.write("#endif\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -3,9 +3,18 @@
 #include <ctype.h>
 #include <errno.h>
 #include <hiredis/alloc.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
 
 #include "adlist.h"
 #include "command.h"
@@ -29,9 +38,12 @@
 
 #define REDIS_COMMAND_CLUSTER_NODES "CLUSTER NODES"
 #define REDIS_COMMAND_CLUSTER_SLOTS "CLUSTER SLOTS"
+#define REDIS_COMMAND_CLUSTER_SHARDS "CLUSTER SHARDS"
 
 #define REDIS_COMMAND_ASKING "ASKING"
+#define REDIS_COMMAND_READONLY "READONLY"
 #define REDIS_COMMAND_PING "PING"
+#define REDIS_COMMAND_COMMAND "COMMAND"
 
 #define REDIS_PROTOCOL_ASKING "*1\r\n$6\r\nASKING\r\n"
 
@@ -41,16 +53,74 @@
 
 #define CLUSTER_ADDRESS_SEPARATOR ","
 
+/* Number of hedges that may be sent in a burst */
+#define CLUSTER_HEDGE_BURST 10
+
+/* Number of request states an async context keeps for reuse */
+#define CLUSTER_ASYNC_POOL_SIZE 1024
+
+/* Most keys a command executed without a command object may have */
+#define CLUSTER_STACK_KEYS 16
+
 #define CLUSTER_DEFAULT_MAX_REDIRECT_COUNT 5
 
+#define CLUSTER_DEFAULT_ROUTE_UPDATE_INTERVAL_USEC 1000000LL
+
+/* Multi-key command sent as one fragment per slot. The replies to the
+ * fragments are merged into a single reply when all of them are received. */
+typedef struct cluster_async_fragments {
+    redisClusterAsyncContext *acc;
+    struct cmd *command; /* Command that was split, owns the fragments */
+    redisClusterCallbackFn *callback;
+    void *privdata;
+    int pending; /* Fragments awaiting their reply */
+    int err;     /* First error given instead of a fragment reply */
+    char errstr[128];
+} cluster_async_fragments;
+
 typedef struct cluster_async_data {
     redisClusterAsyncContext *acc;
     struct cmd *command;
     redisClusterCallbackFn *callback;
     int retry_count;
+    uint64_t route_version; /* Route version used when command was sent */
+    int64_t sent_time;      /* Timestamp when the command was sent */
+    cluster_node *node;     /* Node the command was sent to */
     void *privdata;
+
+    /* Multi-key command this is a fragment of, or NULL */
+    cluster_async_fragments *fragments;
+
+    /* Next request state in the pool of the context */
+    struct cluster_async_data *next;
+
+    /* Hedged reads */
+    int64_t hedge_time;                  /* When the read is hedged */
+    listNode *hedge_ln;                  /* Entry in the list of hedges */
+    struct cluster_async_data *hedge;    /* Hedge sent for this read */
+    struct cluster_async_data *hedge_of; /* Read this hedge was sent for */
+    int answered;                        /* Reply given by the hedge */
 } cluster_async_data;
 
+typedef enum ROUTE_UPDATE_ACTION {
+    ROUTE_UPDATE_NONE = 0, /* Lookup table is already updated, just resend */
+    ROUTE_UPDATE_FETCH,    /* Routing table needs to be fetched */
+    ROUTE_UPDATE_ERROR
+} ROUTE_UPDATE_ACTION;
+
+/* Slot to node lookup snapshot.
+ * A dense array of the nodes serving slots, and a map from slot to the index
+ * of its node in that array. Index 0 is reserved for unassigned slots.
+ * A snapshot is immutable while shared, a context installs a new snapshot by
+ * swapping its pointer and releasing its reference to the old one.
+ */
+struct cluster_route {
+    int refcount;
+    uint32_t node_count;                 /* Entries in nodes[], incl. index 0 */
+    uint16_t slots[REDIS_CLUSTER_SLOTS]; /* Node index per slot */
+    cluster_node *nodes[];               /* nodes[0] is always NULL */
+};
+
 typedef enum CLUSTER_ERR_TYPE {
     CLUSTER_NOT_ERR = 0,
     CLUSTER_ERR_MOVED,
@@ -64,6 +134,7 @@ typedef enum CLUSTER_ERR_TYPE {
 static void cluster_node_deinit(cluster_node *node);
 static void cluster_slot_destroy(cluster_slot *slot);
 static void cluster_open_slot_destroy(copen_slot *oslot);
+static void cluster_commands_update(redisClusterContext *cc);
 
 void listClusterNodeDestructor(void *val) {
     cluster_node_deinit(val);
@@ -128,6 +199,59 @@ dictType clusterNodesRefDictType = {
     NULL               /* val destructor */
 };
 
+static unsigned int dictStrHash(const void *key) {
+    return dictGenHashFunction((const unsigned char *)key, strlen(key));
+}
+
+static int dictStrKeyCompare(void *privdata, const void *key1,
+                             const void *key2) {
+    DICT_NOTUSED(privdata);
+
+    return strcmp(key1, key2) == 0;
+}
+
+static void dictKeySpecDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    hi_free(val);
+}
+
+/* Command key spec hash table
+ * maps lowercase command name (get, xinfo|stream) to struct cmd_key_spec
+ * Has ownership of the key specs. Looked up using plain C strings.
+ */
+dictType commandKeySpecDictType = {
+    dictStrHash,          /* hash function */
+    NULL,                 /* key dup */
+    NULL,                 /* val dup */
+    dictStrKeyCompare,    /* key compare */
+    dictSdsDestructor,    /* key destructor */
+    dictKeySpecDestructor /* val destructor */
+};
+
+/* Fetched command table, immutable and refcounted to be shared by the
+ * contexts attached to a shared topology. */
+typedef struct cluster_commands {
+    int refcount;
+    dict *specs; /* Key specs by command name */
+} cluster_commands;
+
+static void cluster_commands_release(cluster_commands *commands) {
+    if (commands == NULL || hi_atomic_decr(&commands->refcount) != 0) {
+        return;
+    }
+
+    dictRelease(commands->specs);
+    hi_free(commands);
+}
+
+/* Replace the command table by the given reference. */
+static void cluster_commands_install(redisClusterContext *cc,
+                                     cluster_commands *commands) {
+    cluster_commands_release(cc->commands);
+    cc->commands = commands;
+}
+
 void listCommandFree(void *command) {
     struct cmd *cmd = command;
     command_destroy(cmd);
@@ -261,6 +385,11 @@ static int cluster_node_init(cluster_node *node) {
     node->acon = NULL;
     node->slots = NULL;
     node->failure_count = 0;
+    node->in_flight = 0;
+    node->latency = 0;
+    node->latency_dev = 0;
+    node->in_pipeline = 0;
+    node->pipeline_next = NULL;
     node->migrating = NULL;
     node->importing = NULL;
 
@@ -390,7 +519,8 @@ static void cluster_slot_destroy(cluster_slot *slot) {
 }
 
 static copen_slot *cluster_open_slot_create(uint32_t slot_num, int migrate,
-                                            sds remote_name,
+                                            const char *remote_name,
+                                            size_t remote_name_len,
                                             cluster_node *node) {
     copen_slot *oslot;
 
@@ -407,7 +537,7 @@ static copen_slot *cluster_open_slot_create(uint32_t slot_num, int migrate,
     oslot->slot_num = slot_num;
     oslot->migrate = migrate;
     oslot->node = node;
-    oslot->remote_name = sdsdup(remote_name);
+    oslot->remote_name = sdsnewlen(remote_name, remote_name_len);
     if (oslot->remote_name == NULL) {
         hi_free(oslot);
         return NULL;
@@ -459,6 +589,32 @@ error:
     return REDIS_ERR;
 }
 
+/**
+ * Enable reads on a replica connection in the synchronous API
+ */
+static int set_readonly(redisClusterContext *cc, cluster_node *node,
+                        redisContext *c) {
+    if (node->role != REDIS_ROLE_SLAVE) {
+        return REDIS_OK;
+    }
+
+    redisReply *reply = redisCommand(c, REDIS_COMMAND_READONLY);
+    if (reply == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "Command READONLY reply error (NULL)");
+        return REDIS_ERR;
+    }
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+        freeReplyObject(reply);
+        return REDIS_ERR;
+    }
+
+    freeReplyObject(reply);
+    return REDIS_OK;
+}
+
 /**
  * Return a new node with the "cluster slots" command reply.
  */
@@ -466,6 +622,8 @@ static cluster_node *node_get_with_slots(redisClusterContext *cc,
                                          redisReply *host_elem,
                                          redisReply *port_elem, uint8_t role) {
     cluster_node *node = NULL;
+    char port[HI_UINT16_MAXLEN + 1];
+    int port_len;
 
     if (host_elem == NULL || port_elem == NULL) {
         return NULL;
@@ -508,14 +666,14 @@ static cluster_node *node_get_with_slots(redisClusterContext *cc,
         node->slots->free = listClusterSlotDestructor;
     }
 
-    node->addr = sdsnewlen(host_elem->str, host_elem->len);
-    if (node->addr == NULL) {
-        goto oom;
-    }
-    node->addr = sdscatfmt(node->addr, ":%i", port_elem->integer);
+    // Build "host:port" using a single allocation
+    port_len = snprintf(port, sizeof(port), ":%d", (int)port_elem->integer);
+    node->addr = sdsnewlen(NULL, host_elem->len + port_len);
     if (node->addr == NULL) {
         goto oom;
     }
+    memcpy(node->addr, host_elem->str, host_elem->len);
+    memcpy(node->addr + host_elem->len, port, port_len);
     node->host = sdsnewlen(host_elem->str, host_elem->len);
     if (node->host == NULL) {
         goto oom;
@@ -539,19 +697,65 @@ error:
     return NULL;
 }
 
+/* A space separated field in a "cluster nodes" reply line. The field points
+ * into the reply buffer and is not null terminated. */
+typedef struct cluster_nodes_field {
+    char *p;
+    size_t len;
+} cluster_nodes_field;
+
+/* Number of fields before the slot fields in a "cluster nodes" line:
+ * <id> <ip:port@cport> <flags> <master> <ping-sent> <pong-recv>
+ * <config-epoch> <link-state> */
+#define CLUSTER_NODES_FIXED_FIELDS 8
+
+/* Get the next field of a line, starting at pos. Returns the position
+ * after the field and its separator. */
+static char *cluster_nodes_next_field(char *pos, char *line_end,
+                                      cluster_nodes_field *field) {
+    char *sep;
+
+    sep = memchr(pos, ' ', line_end - pos);
+    if (sep == NULL) {
+        sep = line_end;
+    }
+
+    field->p = pos;
+    field->len = sep - pos;
+
+    return sep + 1;
+}
+
 /**
  * Return a new node with the "cluster nodes" command reply.
  */
 static cluster_node *node_get_with_nodes(redisClusterContext *cc,
-                                         sds *node_infos, int info_count,
+                                         cluster_nodes_field *fields,
                                          uint8_t role) {
-    char *p = NULL;
-    char *port = NULL;
     cluster_node *node = NULL;
+    char *addr = fields[1].p;
+    size_t addr_len, host_len;
+
+    // Strip away cport and hostname if given by redis
+    for (addr_len = 0; addr_len < fields[1].len; addr_len++) {
+        if (addr[addr_len] == PORT_CPORT_SEPARATOR || addr[addr_len] == ',') {
+            break;
+        }
+    }
 
-    if (info_count < 8) {
+    // Get host part
+    for (host_len = addr_len; host_len > 0; host_len--) {
+        if (addr[host_len - 1] == IP_PORT_SEPARATOR) {
+            break;
+        }
+    }
+    if (host_len == 0) {
+        __redisClusterSetError(
+            cc, REDIS_ERR_OTHER,
+            "server address is incorrect, port separator missing.");
         return NULL;
     }
+    host_len--; // remove found separator character
 
     node = hi_malloc(sizeof(cluster_node));
     if (node == NULL) {
@@ -568,94 +772,169 @@ static cluster_node *node_get_with_nodes(redisClusterContext *cc,
         node->slots->free = listClusterSlotDestructor;
     }
 
-    node->name = node_infos[0];
-    node->addr = node_infos[1];
-    node->role = role;
-
-    // Get host part
-    if ((p = strrchr(node_infos[1], IP_PORT_SEPARATOR)) == NULL) {
-        __redisClusterSetError(
-            cc, REDIS_ERR_OTHER,
-            "server address is incorrect, port separator missing.");
-        goto error;
+    node->name = sdsnewlen(fields[0].p, fields[0].len);
+    if (node->name == NULL) {
+        goto oom;
     }
-
-    node->host = sdsnewlen(node_infos[1], p - node_infos[1]);
-    if (node->host == NULL) {
+    node->addr = sdsnewlen(addr, addr_len);
+    if (node->addr == NULL) {
         goto oom;
     }
-    p++; // remove found separator character
-
-    // Strip away cport if given by redis
-    size_t port_len;
-    if ((port = strchr(p, PORT_CPORT_SEPARATOR)) == NULL) {
-        port_len = strlen(p);
-    } else {
-        port_len = port - p;
+    node->host = sdsnewlen(addr, host_len);
+    if (node->host == NULL) {
+        goto oom;
     }
-    node->port = hi_atoi(p, port_len);
-
-    // Ownership moved to node
-    node_infos[0] = NULL;
-    node_infos[1] = NULL;
+    node->port = hi_atoi(addr + host_len + 1, (addr_len - host_len - 1));
+    node->role = role;
 
     return node;
 
 oom:
     __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
-    // passthrough
-
-error:
-    if (node) {
-        if (node->slots) {
-            listRelease(node->slots);
-        }
-        sdsfree(node->host);
+    if (node != NULL) {
+        cluster_node_deinit(node);
         hi_free(node);
     }
     return NULL;
 }
 
-static void cluster_nodes_swap_ctx(dict *nodes_f, dict *nodes_t) {
-    dictEntry *de_f, *de_t;
-    cluster_node *node_f, *node_t;
-    redisContext *c;
-    redisAsyncContext *ac;
+/* Check if two nodes serve the same slot ranges. */
+static int cluster_node_slots_equal(cluster_node *node1, cluster_node *node2) {
+    listIter li1, li2;
+    listNode *ln1, *ln2;
+    cluster_slot *slot1, *slot2;
+    unsigned long len1, len2;
+
+    len1 = node1->slots ? listLength(node1->slots) : 0;
+    len2 = node2->slots ? listLength(node2->slots) : 0;
+    if (len1 != len2) {
+        return 0;
+    }
+    if (len1 == 0) {
+        return 1;
+    }
+
+    listRewind(node1->slots, &li1);
+    listRewind(node2->slots, &li2);
+    while ((ln1 = listNext(&li1)) != NULL && (ln2 = listNext(&li2)) != NULL) {
+        slot1 = listNodeValue(ln1);
+        slot2 = listNodeValue(ln2);
+        if (slot1->start != slot2->start || slot1->end != slot2->end) {
+            return 0;
+        }
+    }
 
-    if (nodes_f == NULL || nodes_t == NULL) {
+    return 1;
+}
+
+/* Set the node that open slots in an array belong to. */
+static void cluster_open_slots_set_node(struct hiarray *oslots,
+                                        cluster_node *node) {
+    uint32_t i;
+
+    if (oslots == NULL) {
         return;
     }
 
-    dictIterator di;
-    dictInitIterator(&di, nodes_t);
+    for (i = 0; i < hiarray_n(oslots); i++) {
+        copen_slot **oslot = hiarray_get(oslots, i);
+        (*oslot)->node = node;
+    }
+}
 
-    while ((de_t = dictNext(&di)) != NULL) {
-        node_t = dictGetEntryVal(de_t);
-        if (node_t == NULL) {
-            continue;
+/* Let an existing node take over the topology of a newly parsed node with
+ * the same address. The existing node keeps its connections and statistics,
+ * while its outdated topology is moved to the parsed node to be freed with
+ * it. Slot ranges are only replaced when changed. Replicas that exist in
+ * both are kept the same way. */
+static void cluster_node_adopt(cluster_node *node, cluster_node *update) {
+    listIter li, li_old;
+    listNode *ln, *ln_old;
+    cluster_node *slave, *slave_old;
+    struct hilist *list;
+    struct hiarray *oslots;
+    sds name;
+
+    name = node->name;
+    node->name = update->name;
+    update->name = name;
+    node->role = update->role;
+
+    if (!cluster_node_slots_equal(node, update)) {
+        list = node->slots;
+        node->slots = update->slots;
+        update->slots = list;
+
+        if (node->slots != NULL) {
+            listRewind(node->slots, &li);
+            while ((ln = listNext(&li)) != NULL) {
+                ((cluster_slot *)listNodeValue(ln))->node = node;
+            }
         }
+    }
 
-        de_f = dictFind(nodes_f, node_t->addr);
-        if (de_f == NULL) {
-            continue;
-        }
+    oslots = node->migrating;
+    node->migrating = update->migrating;
+    update->migrating = oslots;
+    cluster_open_slots_set_node(node->migrating, node);
+
+    oslots = node->importing;
+    node->importing = update->importing;
+    update->importing = oslots;
+    cluster_open_slots_set_node(node->importing, node);
+
+    list = node->slaves;
+    node->slaves = update->slaves;
+    update->slaves = list;
+
+    if (node->slaves == NULL || update->slaves == NULL) {
+        return;
+    }
 
-        node_f = dictGetEntryVal(de_f);
-        if (node_f->con != NULL) {
-            c = node_f->con;
-            node_f->con = node_t->con;
-            node_t->con = c;
+    listRewind(node->slaves, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        slave = listNodeValue(ln);
+
+        listRewind(update->slaves, &li_old);
+        while ((ln_old = listNext(&li_old)) != NULL) {
+            slave_old = listNodeValue(ln_old);
+            if (sdscmp(slave->addr, slave_old->addr) == 0) {
+                cluster_node_adopt(slave_old, slave);
+                ln->value = slave_old;
+                ln_old->value = slave;
+                break;
+            }
         }
+    }
+}
+
+/* Keep the nodes that exist both in the current nodes dict and in a newly
+ * parsed nodes dict, together with their connections. Kept nodes replace
+ * the parsed nodes in nodes_new, and the parsed nodes are moved to nodes_old
+ * instead, to be freed with it. */
+static void cluster_nodes_adopt(dict *nodes_old, dict *nodes_new) {
+    dictEntry *de_old, *de_new;
+    cluster_node *node_old, *node_new;
+
+    if (nodes_old == NULL) {
+        return;
+    }
 
-        if (node_f->acon != NULL) {
-            ac = node_f->acon;
-            node_f->acon = node_t->acon;
-            node_t->acon = ac;
+    dictIterator di;
+    dictInitIterator(&di, nodes_new);
+    while ((de_new = dictNext(&di)) != NULL) {
+        node_new = dictGetEntryVal(de_new);
 
-            node_t->acon->data = node_t;
-            if (node_f->acon)
-                node_f->acon->data = node_f;
+        de_old = dictFind(nodes_old, node_new->addr);
+        if (de_old == NULL) {
+            continue;
         }
+
+        node_old = dictGetEntryVal(de_old);
+        cluster_node_adopt(node_old, node_new);
+
+        dictSetHashVal(nodes_new, de_new, node_old);
+        dictSetHashVal(nodes_old, de_old, node_new);
     }
 }
 
@@ -778,6 +1057,7 @@ dict *parse_cluster_slots(redisClusterContext *cc, redisReply *reply,
     redisReply *elem_ip, *elem_port;
     cluster_node *master = NULL, *slave;
     uint32_t i, idx;
+    sds address = NULL, tmp;
 
     if (reply == NULL) {
         return NULL;
@@ -866,17 +1146,20 @@ dict *parse_cluster_slots(redisClusterContext *cc, redisReply *reply,
 
                 // this is master.
                 if (idx == 2) {
-                    sds address = sdsnewlen(elem_ip->str, elem_ip->len);
-                    if (address == NULL) {
+                    // The lookup buffer is reused for all slot ranges
+                    tmp = address == NULL
+                              ? sdsnewlen(elem_ip->str, elem_ip->len)
+                              : sdscpylen(address, elem_ip->str, elem_ip->len);
+                    if (tmp == NULL) {
                         goto oom;
                     }
-                    address = sdscatfmt(address, ":%i", elem_port->integer);
+                    address = sdscatfmt(tmp, ":%i", elem_port->integer);
                     if (address == NULL) {
+                        sdsfree(tmp);
                         goto oom;
                     }
 
                     den = dictFind(nodes, address);
-                    sdsfree(address);
                     // master already exists, break to the next slots region.
                     if (den != NULL) {
 
@@ -945,6 +1228,7 @@ dict *parse_cluster_slots(redisClusterContext *cc, redisReply *reply,
         }
     }
 
+    sdsfree(address);
     return nodes;
 
 oom:
@@ -952,6 +1236,7 @@ oom:
     // passthrough
 
 error:
+    sdsfree(address);
     if (nodes != NULL) {
         dictRelease(nodes);
     }
@@ -961,261 +1246,478 @@ error:
     return NULL;
 }
 
+/* Get the value of a field in a "cluster shards" reply element, which is a
+ * map in RESP3 and a flat array of field names and values in RESP2. */
+static redisReply *cluster_shards_field(redisReply *elem, const char *name) {
+    size_t i, len = strlen(name);
+    redisReply *field;
+
+    if ((elem->type != REDIS_REPLY_ARRAY && elem->type != REDIS_REPLY_MAP) ||
+        elem->elements % 2 != 0) {
+        return NULL;
+    }
+
+    for (i = 0; i < elem->elements; i += 2) {
+        field = elem->element[i];
+        if (field->type == REDIS_REPLY_STRING && field->len == len &&
+            memcmp(field->str, name, len) == 0) {
+            return elem->element[i + 1];
+        }
+    }
+
+    return NULL;
+}
+
+static int cluster_shards_field_equal(redisReply *elem, const char *name,
+                                      const char *value) {
+    redisReply *field = cluster_shards_field(elem, name);
+
+    return field != NULL && field->type == REDIS_REPLY_STRING &&
+           (size_t)field->len == strlen(value) &&
+           memcmp(field->str, value, field->len) == 0;
+}
+
 /**
- * Parse the "cluster nodes" command reply to nodes dict.
+ * Return a new node with a node description in the "cluster shards"
+ * command reply.
  */
-dict *parse_cluster_nodes(redisClusterContext *cc, char *str, int str_len,
-                          int flags) {
+static cluster_node *node_get_with_shards(redisClusterContext *cc,
+                                          redisReply *elem_node,
+                                          uint8_t role) {
+    redisReply *elem_id, *elem_ip, *elem_port;
+    cluster_node *node;
+
+    elem_id = cluster_shards_field(elem_node, "id");
+    // The preferred endpoint, which is also what "cluster slots" returns
+    elem_ip = cluster_shards_field(elem_node, "endpoint");
+    if (elem_ip == NULL || elem_ip->type != REDIS_REPLY_STRING ||
+        (elem_ip->len == 1 && elem_ip->str[0] == '?')) {
+        elem_ip = cluster_shards_field(elem_node, "ip");
+    }
+    elem_port = cluster_shards_field(elem_node, "port");
+    if (elem_port == NULL) {
+        elem_port = cluster_shards_field(elem_node, "tls-port");
+    }
+
+    if (elem_id == NULL || elem_id->type != REDIS_REPLY_STRING ||
+        elem_ip == NULL || elem_ip->type != REDIS_REPLY_STRING ||
+        elem_port == NULL || elem_port->type != REDIS_REPLY_INTEGER) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "Command(cluster shards) reply error: "
+                               "node id, ip or port is not correct.");
+        return NULL;
+    }
+
+    node = node_get_with_slots(cc, elem_ip, elem_port, role);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->name = sdsnewlen(elem_id->str, elem_id->len);
+    if (node->name == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        cluster_node_deinit(node);
+        hi_free(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+/**
+ * Parse the "cluster shards" command reply to nodes dict.
+ * Each shard lists its slot ranges once, followed by its nodes.
+ */
+dict *parse_cluster_shards(redisClusterContext *cc, redisReply *reply,
+                           int flags) {
     int ret;
     dict *nodes = NULL;
-    dict *nodes_name = NULL;
     cluster_node *master, *slave;
     cluster_slot *slot;
-    char *pos, *start, *end, *line_start, *line_end;
-    char *role;
-    int role_len;
-    int slot_start, slot_end;
-    sds *part = NULL, *slot_start_end = NULL;
-    int count_part = 0, count_slot_start_end = 0;
-    int k;
-    int len;
+    redisReply *elem_shard, *elem_slots, *elem_nodes, *elem_node;
+    redisReply *elem_master, *elem_start, *elem_end;
+    uint32_t i, j;
+
+    if (reply == NULL) {
+        return NULL;
+    }
 
     nodes = dictCreate(&clusterNodesDictType, NULL);
     if (nodes == NULL) {
         goto oom;
     }
 
-    start = str;
-    end = start + str_len;
+    if (reply->type != REDIS_REPLY_ARRAY) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "Command(cluster shards) reply error: "
+                               "reply is not an array.");
+        goto error;
+    }
 
-    line_start = start;
+    for (i = 0; i < reply->elements; i++) {
+        elem_shard = reply->element[i];
+        elem_slots = cluster_shards_field(elem_shard, "slots");
+        elem_nodes = cluster_shards_field(elem_shard, "nodes");
+        if (elem_slots == NULL || elem_slots->type != REDIS_REPLY_ARRAY ||
+            elem_slots->elements % 2 != 0 || elem_nodes == NULL ||
+            elem_nodes->type != REDIS_REPLY_ARRAY) {
+            __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                   "Command(cluster shards) reply error: "
+                                   "shard is not correct.");
+            goto error;
+        }
 
-    for (pos = start; pos < end; pos++) {
-        if (*pos == '\n') {
-            line_end = pos - 1;
-            len = line_end - line_start;
+        // Find the master of the shard. Around a failover the failed old
+        // master can be listed too, so an online master is preferred.
+        elem_master = NULL;
+        for (j = 0; j < elem_nodes->elements; j++) {
+            elem_node = elem_nodes->element[j];
+            if (!cluster_shards_field_equal(elem_node, "role", "master")) {
+                continue;
+            }
+            if (cluster_shards_field_equal(elem_node, "health", "online")) {
+                elem_master = elem_node;
+                break;
+            }
+            if (elem_master == NULL) {
+                elem_master = elem_node;
+            }
+        }
 
-            part = sdssplitlen(line_start, len + 1, " ", 1, &count_part);
-            if (part == NULL) {
-                goto oom;
+        master = NULL;
+        if (elem_master != NULL) {
+            master = node_get_with_shards(cc, elem_master, REDIS_ROLE_MASTER);
+            if (master == NULL) {
+                goto error;
             }
+        }
 
-            if (count_part < 8) {
+        // A shard without master, like a failed one, serves no slots
+        if (master == NULL) {
+            continue;
+        }
+
+        sds key = sdsnewlen(master->addr, sdslen(master->addr));
+        if (key == NULL) {
+            cluster_node_deinit(master);
+            hi_free(master);
+            goto oom;
+        }
+
+        ret = dictAdd(nodes, key, master);
+        if (ret != DICT_OK) {
+            __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                   "The address already exists in the nodes");
+            sdsfree(key);
+            cluster_node_deinit(master);
+            hi_free(master);
+            goto error;
+        }
+
+        for (j = 0; j < elem_slots->elements; j += 2) {
+            elem_start = elem_slots->element[j];
+            elem_end = elem_slots->element[j + 1];
+            if (elem_start->type != REDIS_REPLY_INTEGER ||
+                elem_end->type != REDIS_REPLY_INTEGER ||
+                elem_start->integer < 0 ||
+                elem_start->integer > elem_end->integer ||
+                elem_end->integer >= REDIS_CLUSTER_SLOTS) {
                 __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                                       "split cluster nodes error");
+                                       "Command(cluster shards) reply error: "
+                                       "slot range is not correct.");
                 goto error;
             }
 
-            // the address string is ":0", skip this node.
-            if (sdslen(part[1]) == 2 && strcmp(part[1], ":0") == 0) {
-                sdsfreesplitres(part, count_part);
-                count_part = 0;
-                part = NULL;
+            slot = cluster_slot_create(master);
+            if (slot == NULL) {
+                goto oom;
+            }
+
+            slot->start = (uint32_t)elem_start->integer;
+            slot->end = (uint32_t)elem_end->integer;
+        }
 
-                start = pos + 1;
-                line_start = start;
-                pos = start;
+        if (!(flags & HIRCLUSTER_FLAG_ADD_SLAVE)) {
+            continue;
+        }
 
+        for (j = 0; j < elem_nodes->elements; j++) {
+            elem_node = elem_nodes->element[j];
+            // Only add replicas that are able to serve reads
+            if (!cluster_shards_field_equal(elem_node, "role", "replica") ||
+                !cluster_shards_field_equal(elem_node, "health", "online")) {
                 continue;
             }
 
-            if (sdslen(part[2]) >= 7 && memcmp(part[2], "myself,", 7) == 0) {
-                role_len = sdslen(part[2]) - 7;
-                role = part[2] + 7;
-            } else {
-                role_len = sdslen(part[2]);
-                role = part[2];
+            slave = node_get_with_shards(cc, elem_node, REDIS_ROLE_SLAVE);
+            if (slave == NULL) {
+                goto error;
             }
 
-            // add master node
-            if (role_len >= 6 && memcmp(role, "master", 6) == 0) {
-                if (count_part < 8) {
-                    __redisClusterSetError(
-                        cc, REDIS_ERR_OTHER,
-                        "Master node parts number error: less than 8.");
-                    goto error;
+            if (master->slaves == NULL) {
+                master->slaves = listCreate();
+                if (master->slaves == NULL) {
+                    cluster_node_deinit(slave);
+                    hi_free(slave);
+                    goto oom;
                 }
 
-                master = node_get_with_nodes(cc, part, count_part,
-                                             REDIS_ROLE_MASTER);
-                if (master == NULL) {
-                    goto error;
-                }
+                master->slaves->free = listClusterNodeDestructor;
+            }
 
-                sds key = sdsnewlen(master->addr, sdslen(master->addr));
-                if (key == NULL) {
-                    cluster_node_deinit(master);
-                    hi_free(master);
-                    goto oom;
-                }
+            if (listAddNodeTail(master->slaves, slave) == NULL) {
+                cluster_node_deinit(slave);
+                hi_free(slave);
+                goto oom;
+            }
+        }
+    }
 
-                ret = dictAdd(nodes, key, master);
-                if (ret != DICT_OK) {
-                    // Key already exists, but possibly an OOM error
-                    __redisClusterSetError(
-                        cc, REDIS_ERR_OTHER,
-                        "The address already exists in the nodes");
-                    sdsfree(key);
-                    cluster_node_deinit(master);
-                    hi_free(master);
-                    goto error;
-                }
+    return nodes;
 
-                if (flags & HIRCLUSTER_FLAG_ADD_SLAVE) {
-                    ret = cluster_master_slave_mapping_with_name(
-                        cc, &nodes_name, master, master->name);
-                    if (ret != REDIS_OK) {
-                        cluster_node_deinit(master);
-                        hi_free(master);
-                        goto error;
-                    }
-                }
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    // passthrough
 
-                for (k = 8; k < count_part; k++) {
-                    slot_start_end = sdssplitlen(part[k], sdslen(part[k]), "-",
-                                                 1, &count_slot_start_end);
-                    if (slot_start_end == NULL) {
-                        goto oom;
-                    }
+error:
+    if (nodes != NULL) {
+        dictRelease(nodes);
+    }
+    return NULL;
+}
 
-                    if (count_slot_start_end == 1) {
-                        slot_start = hi_atoi(slot_start_end[0],
-                                             sdslen(slot_start_end[0]));
-                        slot_end = slot_start;
-                    } else if (count_slot_start_end == 2) {
-                        slot_start = hi_atoi(slot_start_end[0],
-                                             sdslen(slot_start_end[0]));
-                        ;
-                        slot_end = hi_atoi(slot_start_end[1],
-                                           sdslen(slot_start_end[1]));
-                        ;
-                    } else {
-                        // add open slot for master
-                        if (flags & HIRCLUSTER_FLAG_ADD_OPENSLOT &&
-                            count_slot_start_end == 3 &&
-                            sdslen(slot_start_end[0]) > 1 &&
-                            sdslen(slot_start_end[1]) == 1 &&
-                            sdslen(slot_start_end[2]) > 1 &&
-                            slot_start_end[0][0] == '[' &&
-                            slot_start_end[2][sdslen(slot_start_end[2]) - 1] ==
-                                ']') {
-
-                            copen_slot *oslot, **oslot_elem;
-
-                            sdsrange(slot_start_end[0], 1, -1);
-                            sdsrange(slot_start_end[2], 0, -2);
-
-                            if (slot_start_end[1][0] == '>') {
-                                oslot = cluster_open_slot_create(
-                                    hi_atoi(slot_start_end[0],
-                                            sdslen(slot_start_end[0])),
-                                    1, slot_start_end[2], master);
-                                if (oslot == NULL) {
-                                    __redisClusterSetError(
-                                        cc, REDIS_ERR_OTHER,
-                                        "create open slot error");
-                                    goto error;
-                                }
-
-                                if (master->migrating == NULL) {
-                                    master->migrating =
-                                        hiarray_create(1, sizeof(oslot));
-                                    if (master->migrating == NULL) {
-                                        cluster_open_slot_destroy(oslot);
-                                        goto oom;
-                                    }
-                                }
-
-                                oslot_elem = hiarray_push(master->migrating);
-                                if (oslot_elem == NULL) {
-                                    cluster_open_slot_destroy(oslot);
-                                    goto oom;
-                                }
-
-                                *oslot_elem = oslot;
-                            } else if (slot_start_end[1][0] == '<') {
-                                oslot = cluster_open_slot_create(
-                                    hi_atoi(slot_start_end[0],
-                                            sdslen(slot_start_end[0])),
-                                    0, slot_start_end[2], master);
-                                if (oslot == NULL) {
-                                    __redisClusterSetError(
-                                        cc, REDIS_ERR_OTHER,
-                                        "create open slot error");
-                                    goto error;
-                                }
-
-                                if (master->importing == NULL) {
-                                    master->importing =
-                                        hiarray_create(1, sizeof(oslot));
-                                    if (master->importing == NULL) {
-                                        cluster_open_slot_destroy(oslot);
-                                        goto oom;
-                                    }
-                                }
-
-                                oslot_elem = hiarray_push(master->importing);
-                                if (oslot_elem == NULL) {
-                                    cluster_open_slot_destroy(oslot);
-                                    goto oom;
-                                }
-
-                                *oslot_elem = oslot;
-                            }
-                        }
+/* Add an open slot given as "[slot->-node-id]" (migrating) or as
+ * "[slot-<-node-id]" (importing) in a "cluster nodes" line to a master.
+ * Malformed fields are ignored.
+ */
+static int cluster_nodes_add_open_slot(redisClusterContext *cc,
+                                       cluster_node *master,
+                                       cluster_nodes_field *field) {
+    copen_slot *oslot, **oslot_elem;
+    struct hiarray **oslots;
+    char *p = field->p, *dash, *name;
+    int slot_num, migrate;
+
+    if (field->len < 6 || p[0] != '[' || p[field->len - 1] != ']') {
+        return REDIS_OK;
+    }
 
-                        slot_start = -1;
-                        slot_end = -1;
-                    }
+    dash = memchr(p, '-', field->len);
+    if (dash == NULL || dash + 3 >= p + field->len || dash[2] != '-') {
+        return REDIS_OK;
+    }
+    name = dash + 3;
 
-                    sdsfreesplitres(slot_start_end, count_slot_start_end);
-                    count_slot_start_end = 0;
-                    slot_start_end = NULL;
+    if (dash[1] == '>') {
+        migrate = 1;
+        oslots = &master->migrating;
+    } else if (dash[1] == '<') {
+        migrate = 0;
+        oslots = &master->importing;
+    } else {
+        return REDIS_OK;
+    }
 
-                    if (slot_start < 0 || slot_end < 0 ||
-                        slot_start > slot_end ||
-                        slot_end >= REDIS_CLUSTER_SLOTS) {
-                        continue;
-                    }
+    slot_num = hi_atoi(p + 1, (dash - p - 1));
+    if (slot_num < 0) {
+        return REDIS_OK;
+    }
 
-                    slot = cluster_slot_create(master);
-                    if (slot == NULL) {
-                        goto oom;
-                    }
+    oslot = cluster_open_slot_create((uint32_t)slot_num, migrate, name,
+                                     p + field->len - 1 - name, master);
+    if (oslot == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, "create open slot error");
+        return REDIS_ERR;
+    }
 
-                    slot->start = (uint32_t)slot_start;
-                    slot->end = (uint32_t)slot_end;
-                }
+    if (*oslots == NULL) {
+        *oslots = hiarray_create(1, sizeof(oslot));
+        if (*oslots == NULL) {
+            cluster_open_slot_destroy(oslot);
+            goto oom;
+        }
+    }
+
+    oslot_elem = hiarray_push(*oslots);
+    if (oslot_elem == NULL) {
+        cluster_open_slot_destroy(oslot);
+        goto oom;
+    }
+
+    *oslot_elem = oslot;
+    return REDIS_OK;
+
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    return REDIS_ERR;
+}
+
+/**
+ * Parse the "cluster nodes" command reply to nodes dict.
+ * The reply is tokenized in place, only the resulting nodes and slots are
+ * allocated.
+ */
+dict *parse_cluster_nodes(redisClusterContext *cc, char *str, int str_len,
+                          int flags) {
+    int ret;
+    dict *nodes = NULL;
+    dict *nodes_name = NULL;
+    cluster_node *master, *slave;
+    cluster_slot *slot;
+    cluster_nodes_field fields[CLUSTER_NODES_FIXED_FIELDS], field;
+    char *pos, *end, *line_end, *dash;
+    char *role;
+    size_t role_len;
+    int slot_start, slot_end;
+    int count_fields;
+    sds master_name = NULL;
+
+    nodes = dictCreate(&clusterNodesDictType, NULL);
+    if (nodes == NULL) {
+        goto oom;
+    }
+
+    end = str + str_len;
+
+    for (pos = str; pos < end; pos = line_end + 1) {
+        line_end = memchr(pos, '\n', end - pos);
+        if (line_end == NULL) {
+            break;
+        }
+
+        for (count_fields = 0;
+             count_fields < CLUSTER_NODES_FIXED_FIELDS && pos <= line_end;
+             count_fields++) {
+            pos = cluster_nodes_next_field(pos, line_end,
+                                           &fields[count_fields]);
+        }
+
+        if (count_fields < CLUSTER_NODES_FIXED_FIELDS) {
+            __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                   "split cluster nodes error");
+            goto error;
+        }
+
+        // the address string is ":0", skip this node.
+        if (fields[1].len == 2 && memcmp(fields[1].p, ":0", 2) == 0) {
+            continue;
+        }
+
+        if (fields[2].len >= 7 && memcmp(fields[2].p, "myself,", 7) == 0) {
+            role_len = fields[2].len - 7;
+            role = fields[2].p + 7;
+        } else {
+            role_len = fields[2].len;
+            role = fields[2].p;
+        }
 
+        // add master node
+        if (role_len >= 6 && memcmp(role, "master", 6) == 0) {
+            master = node_get_with_nodes(cc, fields, REDIS_ROLE_MASTER);
+            if (master == NULL) {
+                goto error;
+            }
+
+            sds key = sdsnewlen(master->addr, sdslen(master->addr));
+            if (key == NULL) {
+                cluster_node_deinit(master);
+                hi_free(master);
+                goto oom;
             }
-            // add slave node
-            else if ((flags & HIRCLUSTER_FLAG_ADD_SLAVE) &&
-                     (role_len >= 5 && memcmp(role, "slave", 5) == 0)) {
-                slave =
-                    node_get_with_nodes(cc, part, count_part, REDIS_ROLE_SLAVE);
-                if (slave == NULL) {
-                    goto error;
-                }
 
-                ret = cluster_master_slave_mapping_with_name(cc, &nodes_name,
-                                                             slave, part[3]);
+            ret = dictAdd(nodes, key, master);
+            if (ret != DICT_OK) {
+                // Key already exists, but possibly an OOM error
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "The address already exists in the nodes");
+                sdsfree(key);
+                cluster_node_deinit(master);
+                hi_free(master);
+                goto error;
+            }
+
+            if (flags & HIRCLUSTER_FLAG_ADD_SLAVE) {
+                ret = cluster_master_slave_mapping_with_name(
+                    cc, &nodes_name, master, master->name);
                 if (ret != REDIS_OK) {
-                    cluster_node_deinit(slave);
-                    hi_free(slave);
+                    cluster_node_deinit(master);
+                    hi_free(master);
                     goto error;
                 }
             }
 
-            sdsfreesplitres(part, count_part);
-            count_part = 0;
-            part = NULL;
+            // Slot fields: <slot>, <start>-<end> or an open slot
+            while (pos < line_end) {
+                pos = cluster_nodes_next_field(pos, line_end, &field);
+                if (field.len == 0) {
+                    continue;
+                }
+
+                if (field.p[0] == '[') {
+                    if ((flags & HIRCLUSTER_FLAG_ADD_OPENSLOT) &&
+                        cluster_nodes_add_open_slot(cc, master, &field) !=
+                            REDIS_OK) {
+                        goto error;
+                    }
+                    continue;
+                }
+
+                dash = memchr(field.p, '-', field.len);
+                if (dash == NULL) {
+                    slot_start = hi_atoi(field.p, field.len);
+                    slot_end = slot_start;
+                } else {
+                    slot_start = hi_atoi(field.p, (dash - field.p));
+                    slot_end =
+                        hi_atoi(dash + 1, (field.p + field.len - dash - 1));
+                }
+
+                if (slot_start < 0 || slot_end < 0 || slot_start > slot_end ||
+                    slot_end >= REDIS_CLUSTER_SLOTS) {
+                    continue;
+                }
+
+                slot = cluster_slot_create(master);
+                if (slot == NULL) {
+                    goto oom;
+                }
+
+                slot->start = (uint32_t)slot_start;
+                slot->end = (uint32_t)slot_end;
+            }
+
+        }
+        // add slave node
+        else if ((flags & HIRCLUSTER_FLAG_ADD_SLAVE) &&
+                 (role_len >= 5 && memcmp(role, "slave", 5) == 0)) {
+            slave = node_get_with_nodes(cc, fields, REDIS_ROLE_SLAVE);
+            if (slave == NULL) {
+                goto error;
+            }
+
+            // The master name buffer is reused for all slaves
+            master_name = master_name == NULL
+                              ? sdsnewlen(fields[3].p, fields[3].len)
+                              : sdscpylen(master_name, fields[3].p,
+                                          fields[3].len);
+            if (master_name == NULL) {
+                cluster_node_deinit(slave);
+                hi_free(slave);
+                goto oom;
+            }
 
-            start = pos + 1;
-            line_start = start;
-            pos = start;
+            ret = cluster_master_slave_mapping_with_name(cc, &nodes_name,
+                                                         slave, master_name);
+            if (ret != REDIS_OK) {
+                cluster_node_deinit(slave);
+                hi_free(slave);
+                goto error;
+            }
         }
     }
 
+    sdsfree(master_name);
     if (nodes_name != NULL) {
         dictRelease(nodes_name);
     }
@@ -1227,8 +1729,7 @@ oom:
     // passthrough
 
 error:
-    sdsfreesplitres(part, count_part);
-    sdsfreesplitres(slot_start_end, count_slot_start_end);
+    sdsfree(master_name);
     if (nodes != NULL) {
         dictRelease(nodes);
     }
@@ -1238,236 +1739,2319 @@ error:
     return NULL;
 }
 
-/**
- * Update route with the "cluster nodes" or "cluster slots" command reply.
- */
-static int cluster_update_route_by_addr(redisClusterContext *cc, const char *ip,
-                                        int port) {
-    redisContext *c = NULL;
-    redisReply *reply = NULL;
-    dict *nodes = NULL;
-    struct hiarray *slots = NULL;
-    cluster_node *master;
-    cluster_slot *slot, **slot_elem;
-    dictEntry *den;
-    listNode *lnode;
-    cluster_node *table[REDIS_CLUSTER_SLOTS];
-    uint32_t j, k;
+/* Create a route snapshot with room for node_count nodes, not counting
+ * the reserved index 0. All slots are unassigned. */
+static struct cluster_route *cluster_route_create(uint32_t node_count) {
+    struct cluster_route *route;
 
-    if (cc == NULL) {
-        return REDIS_ERR;
+    if (node_count >= UINT16_MAX) {
+        return NULL;
     }
 
-    if (ip == NULL || port <= 0) {
-        __redisClusterSetError(cc, REDIS_ERR_OTHER, "Ip or port error!");
-        goto error;
+    route = hi_calloc(1, sizeof(struct cluster_route) +
+                             (node_count + 1) * sizeof(cluster_node *));
+    if (route == NULL) {
+        return NULL;
     }
 
-    if (cc->connect_timeout) {
-        c = redisConnectWithTimeout(ip, port, *cc->connect_timeout);
-    } else {
-        c = redisConnect(ip, port);
+    route->refcount = 1;
+    route->node_count = 1;
+    route->nodes[0] = NULL;
+
+    return route;
+}
+
+static void cluster_route_release(struct cluster_route *route) {
+    if (route == NULL) {
+        return;
     }
 
-    if (c == NULL) {
-        goto oom;
+    if (--route->refcount == 0) {
+        hi_free(route);
     }
-    if (c->err) {
-        __redisClusterSetError(cc, c->err, c->errstr);
-        goto error;
+}
+
+/* Install a new route snapshot, the context takes over the reference. */
+static void cluster_route_install(redisClusterContext *cc,
+                                  struct cluster_route *route) {
+    struct cluster_route *old_route = cc->route;
+
+    cc->route = route;
+    cluster_route_release(old_route);
+}
+
+static inline cluster_node *cluster_route_lookup(struct cluster_route *route,
+                                                 uint32_t slot_num) {
+    return route->nodes[route->slots[slot_num]];
+}
+
+/* Check if two route snapshots map all slots to the same nodes. */
+static int cluster_route_equal(struct cluster_route *route1,
+                               struct cluster_route *route2) {
+    uint32_t slot_num;
+
+    if (route1 == NULL || route2 == NULL ||
+        route1->node_count != route2->node_count) {
+        return 0;
     }
 
-    if (cc->command_timeout) {
-        redisSetTimeout(c, *cc->command_timeout);
+    for (slot_num = 0; slot_num < REDIS_CLUSTER_SLOTS; slot_num++) {
+        if (cluster_route_lookup(route1, slot_num) !=
+            cluster_route_lookup(route2, slot_num)) {
+            return 0;
+        }
     }
 
-#ifdef SSL_SUPPORT
-    if (cc->ssl) {
-        if (redisInitiateSSLWithContext(c, cc->ssl) != REDIS_OK) {
-            __redisClusterSetError(cc, c->err, c->errstr);
-            goto error;
+    return 1;
+}
+
+/* Let the given node serve a slot. The current snapshot is changed in place
+ * when not shared and the node is already known, otherwise a changed copy is
+ * installed. */
+static int cluster_route_set_slot(redisClusterContext *cc, uint32_t slot_num,
+                                  cluster_node *node) {
+    struct cluster_route *route = cc->route, *new_route;
+    uint32_t idx;
+
+    if (route == NULL) {
+        return REDIS_ERR;
+    }
+
+    for (idx = 1; idx < route->node_count; idx++) {
+        if (route->nodes[idx] == node) {
+            break;
         }
     }
-#endif
 
-    if (authenticate(cc, c) != REDIS_OK) {
-        goto error;
+    if (idx < route->node_count && route->refcount == 1) {
+        route->slots[slot_num] = (uint16_t)idx;
+        return REDIS_OK;
     }
 
-    if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SLOTS) {
-        reply = redisCommand(c, REDIS_COMMAND_CLUSTER_SLOTS);
-        if (reply == NULL) {
-            if (c->err == REDIS_ERR_TIMEOUT) {
-                __redisClusterSetError(
-                    cc, c->err,
-                    "Command(cluster slots) reply error(socket timeout)");
-            } else {
-                __redisClusterSetError(
-                    cc, REDIS_ERR_OTHER,
-                    "Command(cluster slots) reply error(NULL).");
-            }
-            goto error;
-        } else if (reply->type != REDIS_REPLY_ARRAY) {
-            if (reply->type == REDIS_REPLY_ERROR) {
-                __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
-            } else {
-                __redisClusterSetError(
-                    cc, REDIS_ERR_OTHER,
-                    "Command(cluster slots) reply error: type is not array.");
-            }
+    new_route = cluster_route_create(route->node_count);
+    if (new_route == NULL) {
+        return REDIS_ERR;
+    }
+    memcpy(new_route->slots, route->slots, sizeof(route->slots));
+    memcpy(new_route->nodes, route->nodes,
+           route->node_count * sizeof(cluster_node *));
+    new_route->node_count = route->node_count;
+    if (idx == route->node_count) {
+        new_route->nodes[new_route->node_count++] = node;
+    }
+    new_route->slots[slot_num] = (uint16_t)idx;
 
-            goto error;
-        }
+    cluster_route_install(cc, new_route);
+    return REDIS_OK;
+}
 
-        nodes = parse_cluster_slots(cc, reply, cc->flags);
-    } else {
-        reply = redisCommand(c, REDIS_COMMAND_CLUSTER_NODES);
-        if (reply == NULL) {
-            if (c->err == REDIS_ERR_TIMEOUT) {
-                __redisClusterSetError(
-                    cc, c->err,
-                    "Command(cluster nodes) reply error(socket timeout)");
-            } else {
-                __redisClusterSetError(
-                    cc, REDIS_ERR_OTHER,
-                    "Command(cluster nodes) reply error(NULL).");
-            }
-            goto error;
-        } else if (reply->type != REDIS_REPLY_STRING) {
-            if (reply->type == REDIS_REPLY_ERROR) {
-                __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
-            } else {
-                __redisClusterSetError(
-                    cc, REDIS_ERR_OTHER,
-                    "Command(cluster nodes) reply error: type is not string.");
-            }
+/* ASK cache
+ *
+ * While a slot is migrating, the keys already moved are served by the
+ * importing node after an ASKING command, and the migrating node answers
+ * commands for them with an ASK redirect. Keys that got an ASK are kept per
+ * slot, so that following commands for them are sent to the importing node
+ * directly. Keys that have not moved can not be sent to the importing node,
+ * since it handles them as missing keys. The open slots parsed from
+ * CLUSTER NODES keep the cache of a slot over route updates until its
+ * migration completes.
+ */
+typedef struct cluster_ask_slot {
+    cluster_node *target; /* Node importing the slot */
+    dict *keys;           /* Moved keys, as struct keypos */
+} cluster_ask_slot;
+
+/* Max number of moved keys kept per slot */
+#define CLUSTER_ASK_CACHE_MAX_KEYS 1024
+
+static unsigned int dictKeyposHash(const void *key) {
+    const struct keypos *kp = key;
+    return dictGenHashFunction((unsigned char *)kp->start,
+                               (int)(kp->end - kp->start));
+}
 
-            goto error;
+static int dictKeyposKeyCompare(void *privdata, const void *key1,
+                                const void *key2) {
+    const struct keypos *kp1 = key1, *kp2 = key2;
+    DICT_NOTUSED(privdata);
+
+    return kp1->end - kp1->start == kp2->end - kp2->start &&
+           memcmp(kp1->start, kp2->start, kp1->end - kp1->start) == 0;
+}
+
+static void dictKeyposDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    hi_free(val);
+}
+
+/* Moved keys of a slot
+ * Keys are copies, allocated together with their struct keypos
+ */
+dictType clusterAskKeysDictType = {
+    dictKeyposHash,       /* hash function */
+    NULL,                 /* key dup */
+    NULL,                 /* val dup */
+    dictKeyposKeyCompare, /* key compare */
+    dictKeyposDestructor, /* key destructor */
+    NULL                  /* val destructor */
+};
+
+static void cluster_ask_slot_free(cluster_ask_slot *ask) {
+    if (ask->keys != NULL) {
+        dictRelease(ask->keys);
+    }
+    hi_free(ask);
+}
+
+/* Get the cache of a slot migrating to the given node. The moved keys are
+ * dropped when the slot was migrating to another node. */
+static cluster_ask_slot *cluster_ask_slot_get(redisClusterContext *cc,
+                                              uint32_t slot_num,
+                                              cluster_node *target) {
+    cluster_ask_slot *ask;
+
+    if (cc->ask_slots == NULL) {
+        cc->ask_slots = hi_calloc(REDIS_CLUSTER_SLOTS, sizeof(*cc->ask_slots));
+        if (cc->ask_slots == NULL) {
+            return NULL;
         }
+    }
+
+    ask = cc->ask_slots[slot_num];
+    if (ask != NULL) {
+        if (ask->target != target && ask->keys != NULL) {
+            dictRelease(ask->keys);
+            ask->keys = NULL;
+        }
+        ask->target = target;
+        return ask;
+    }
+
+    ask = hi_malloc(sizeof(*ask));
+    if (ask == NULL) {
+        return NULL;
+    }
+    ask->target = target;
+    ask->keys = NULL;
+    cc->ask_slots[slot_num] = ask;
+    return ask;
+}
 
-        nodes = parse_cluster_nodes(cc, reply->str, reply->len, cc->flags);
+/* Remember that the key of a single-key command was moved to the node given
+ * in an ASK redirect. Failures are ignored, it's only a cache. */
+static void cluster_ask_cache_add(redisClusterContext *cc, struct cmd *command,
+                                  cluster_node *target) {
+    cluster_ask_slot *ask;
+    struct keypos *kp, *key;
+    size_t len;
+
+    if (command->slot_num < 0 || hiarray_n(command->keys) != 1) {
+        return;
+    }
+
+    ask = cluster_ask_slot_get(cc, (uint32_t)command->slot_num, target);
+    if (ask == NULL) {
+        return;
+    }
+
+    if (ask->keys == NULL) {
+        ask->keys = dictCreate(&clusterAskKeysDictType, NULL);
+        if (ask->keys == NULL) {
+            return;
+        }
+    }
+
+    kp = hiarray_get(command->keys, 0);
+    if (dictSize(ask->keys) >= CLUSTER_ASK_CACHE_MAX_KEYS ||
+        dictFind(ask->keys, kp) != NULL) {
+        return;
+    }
+
+    len = kp->end - kp->start;
+    key = hi_malloc(sizeof(*key) + len);
+    if (key == NULL) {
+        return;
+    }
+    key->start = (char *)(key + 1);
+    key->end = key->start + len;
+    key->remain_len = 0;
+    memcpy(key->start, kp->start, len);
+
+    if (dictAdd(ask->keys, key, NULL) != DICT_OK) {
+        hi_free(key);
+    }
+}
+
+/* Get the importing node for the key of a single-key command, when the key
+ * is known to be moved by an ongoing slot migration. */
+static cluster_node *cluster_ask_cache_lookup(redisClusterContext *cc,
+                                              struct cmd *command) {
+    cluster_ask_slot *ask;
+
+    if (cc->ask_slots == NULL || command->slot_num < 0) {
+        return NULL;
+    }
+
+    ask = cc->ask_slots[command->slot_num];
+    if (ask == NULL || ask->keys == NULL || hiarray_n(command->keys) != 1 ||
+        dictFind(ask->keys, hiarray_get(command->keys, 0)) == NULL) {
+        return NULL;
+    }
+
+    return ask->target;
+}
+
+/* Forget the moved keys of a slot, when a MOVED shows that it has a new
+ * owner. */
+static void cluster_ask_cache_forget(redisClusterContext *cc, int slot_num) {
+    if (cc->ask_slots == NULL || slot_num < 0 ||
+        cc->ask_slots[slot_num] == NULL) {
+        return;
+    }
+
+    cluster_ask_slot_free(cc->ask_slots[slot_num]);
+    cc->ask_slots[slot_num] = NULL;
+}
+
+static void cluster_ask_cache_free(redisClusterContext *cc) {
+    uint32_t i;
+
+    if (cc->ask_slots == NULL) {
+        return;
+    }
+
+    for (i = 0; i < REDIS_CLUSTER_SLOTS; i++) {
+        if (cc->ask_slots[i] != NULL) {
+            cluster_ask_slot_free(cc->ask_slots[i]);
+        }
+    }
+    hi_free(cc->ask_slots);
+    cc->ask_slots = NULL;
+}
+
+/* Find a node in cc->nodes by its node id. */
+static cluster_node *cluster_node_get_by_name(redisClusterContext *cc,
+                                              sds name) {
+    dictIterator di;
+    dictEntry *de;
+    cluster_node *node;
+
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        node = dictGetEntryVal(de);
+        if (node->name != NULL && sdscmp(node->name, name) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* Update the cache after a route update, which may release the nodes it
+ * refers to. Only slots that are still migrating are kept, and the slots
+ * that started migrating are added. Without open slot information the cache
+ * is cleared. */
+static void cluster_ask_cache_refresh(redisClusterContext *cc) {
+    cluster_ask_slot **old_slots = cc->ask_slots;
+    cluster_ask_slot *ask;
+    cluster_node *master, *target;
+    copen_slot **oslot;
+    dictIterator di;
+    dictEntry *de;
+    uint32_t i;
+
+    cc->ask_slots = NULL;
+
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        master = dictGetEntryVal(de);
+        if (master->migrating == NULL) {
+            continue;
+        }
+
+        for (i = 0; i < hiarray_n(master->migrating); i++) {
+            oslot = hiarray_get(master->migrating, i);
+            target = cluster_node_get_by_name(cc, (*oslot)->remote_name);
+            if (target == NULL) {
+                continue;
+            }
+
+            /* Move over the cache of the slot from the old table */
+            if (old_slots != NULL && old_slots[(*oslot)->slot_num] != NULL) {
+                if (cc->ask_slots == NULL) {
+                    cc->ask_slots = hi_calloc(REDIS_CLUSTER_SLOTS,
+                                              sizeof(*cc->ask_slots));
+                    if (cc->ask_slots == NULL) {
+                        continue;
+                    }
+                }
+                ask = old_slots[(*oslot)->slot_num];
+                old_slots[(*oslot)->slot_num] = NULL;
+                cc->ask_slots[(*oslot)->slot_num] = ask;
+            }
+
+            cluster_ask_slot_get(cc, (*oslot)->slot_num, target);
+        }
+    }
+
+    if (old_slots != NULL) {
+        for (i = 0; i < REDIS_CLUSTER_SLOTS; i++) {
+            if (old_slots[i] != NULL) {
+                cluster_ask_slot_free(old_slots[i]);
+            }
+        }
+        hi_free(old_slots);
+    }
+}
+
+/* Empty the list of nodes given pipelined commands, see
+ * cluster_pipeline_node_add(). */
+static void cluster_pipeline_nodes_clear(redisClusterContext *cc) {
+    cluster_node *node;
+
+    while ((node = cc->pipeline_nodes) != NULL) {
+        cc->pipeline_nodes = node->pipeline_next;
+        node->in_pipeline = 0;
+        node->pipeline_next = NULL;
+    }
+}
+
+/**
+ * Update route with a dict of master nodes and their slots.
+ * Nodes that already exist in cc->nodes are kept together with their
+ * connections, see cluster_nodes_adopt().
+ * The nodes dict is consumed, also on failure.
+ */
+static int cluster_update_route_by_nodes(redisClusterContext *cc,
+                                         dict *nodes) {
+    dict *old_nodes;
+    struct hiarray *slots = NULL, *old_slots;
+    cluster_node *master;
+    cluster_slot *slot, **slot_elem;
+    dictEntry *den;
+    listNode *lnode;
+    struct cluster_route *route = NULL;
+    uint32_t k, idx, slot_count = 0;
+
+    route = cluster_route_create(dictSize(nodes));
+    if (route == NULL) {
+        goto oom;
+    }
+
+    dictIterator di;
+    dictInitIterator(&di, nodes);
+
+    while ((den = dictNext(&di))) {
+        master = dictGetEntryVal(den);
+        if (master->role != REDIS_ROLE_MASTER) {
+            __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                   "Node role must be master");
+            goto error;
+        }
+
+        if (master->slots == NULL || listLength(master->slots) == 0) {
+            continue;
+        }
+
+        idx = route->node_count++;
+
+        listIter li;
+        listRewind(master->slots, &li);
+
+        while ((lnode = listNext(&li))) {
+            slot = listNodeValue(lnode);
+            if (slot->start > slot->end || slot->end >= REDIS_CLUSTER_SLOTS) {
+                __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                       "Slot region for node is error");
+                goto error;
+            }
+
+            for (k = slot->start; k <= slot->end; k++) {
+                if (route->slots[k] != 0) {
+                    __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                           "Diffent node hold a same slot");
+                    goto error;
+                }
+
+                route->slots[k] = (uint16_t)idx;
+            }
+            slot_count++;
+        }
+    }
+
+    // Sized to never grow, nothing can fail once nodes are adopted
+    slots = hiarray_create(slot_count > 0 ? slot_count : 1,
+                           sizeof(cluster_slot *));
+    if (slots == NULL) {
+        goto oom;
+    }
+
+    // Keep known nodes and their connections, the parsed nodes are moved
+    // to cc->nodes and freed with it.
+    cluster_nodes_adopt(cc->nodes, nodes);
+
+    /* Collect the nodes and slots to use, in the same iteration order as
+     * when the node indexes were given. */
+    idx = 1;
+    dictInitIterator(&di, nodes);
+    while ((den = dictNext(&di))) {
+        master = dictGetEntryVal(den);
+        if (master->slots == NULL || listLength(master->slots) == 0) {
+            continue;
+        }
+
+        route->nodes[idx++] = master;
+
+        listIter li;
+        listRewind(master->slots, &li);
+
+        while ((lnode = listNext(&li))) {
+            slot_elem = hiarray_push(slots);
+            *slot_elem = listNodeValue(lnode);
+        }
+    }
+
+    hiarray_sort(slots, cluster_slot_start_cmp);
+
+    /* Install the new route before releasing the old nodes, since releasing
+     * a node can trigger callbacks of pending async commands. The current
+     * route is kept when all slots are served by the same nodes as before. */
+    cluster_pipeline_nodes_clear(cc);
+    old_nodes = cc->nodes;
+    old_slots = cc->slots;
+    cc->nodes = nodes;
+    cc->slots = slots;
+    if (!cluster_route_equal(cc->route, route)) {
+        cluster_route_install(cc, route);
+    } else {
+        cluster_route_release(route);
+    }
+    cc->route_version++;
+    cc->update_route_time = 0LL;
+    cluster_ask_cache_refresh(cc);
+
+    if (old_slots != NULL) {
+        old_slots->nelem = 0;
+        hiarray_destroy(old_slots);
+    }
+    if (old_nodes != NULL) {
+        dictRelease(old_nodes);
+    }
+
+    return REDIS_OK;
+
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    // passthrough
+
+error:
+    cluster_route_release(route);
+    if (nodes != NULL) {
+        dictRelease(nodes);
+    }
+    return REDIS_ERR;
+}
+
+/* Get the command used to fetch the routing table. */
+static const char *cluster_route_command(redisClusterContext *cc) {
+    if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SHARDS) {
+        return REDIS_COMMAND_CLUSTER_SHARDS;
+    } else if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SLOTS) {
+        return REDIS_COMMAND_CLUSTER_SLOTS;
+    }
+    return REDIS_COMMAND_CLUSTER_NODES;
+}
+
+/**
+ * Parse the "cluster nodes", "cluster slots" or "cluster shards" command
+ * reply to nodes dict.
+ */
+static dict *cluster_parse_route_reply(redisClusterContext *cc,
+                                       redisReply *reply) {
+    int flags = cc->flags;
+
+    /* A shared topology holds the replicas for all attached contexts */
+    if (cc->topology != NULL) {
+        flags |= HIRCLUSTER_FLAG_ADD_SLAVE;
+    }
+
+    if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SHARDS) {
+        if (reply->type != REDIS_REPLY_ARRAY) {
+            if (reply->type == REDIS_REPLY_ERROR) {
+                __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+            } else {
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "Command(cluster shards) reply error: type is not array.");
+            }
+
+            return NULL;
+        }
+
+        return parse_cluster_shards(cc, reply, flags);
+    } else if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SLOTS) {
+        if (reply->type != REDIS_REPLY_ARRAY) {
+            if (reply->type == REDIS_REPLY_ERROR) {
+                __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+            } else {
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "Command(cluster slots) reply error: type is not array.");
+            }
+
+            return NULL;
+        }
+
+        return parse_cluster_slots(cc, reply, flags);
+    } else {
+        if (reply->type != REDIS_REPLY_STRING) {
+            if (reply->type == REDIS_REPLY_ERROR) {
+                __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+            } else {
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "Command(cluster nodes) reply error: type is not string.");
+            }
+
+            return NULL;
+        }
+
+        return parse_cluster_nodes(cc, reply->str, reply->len, flags);
+    }
+}
+
+/**
+ * Update route with the "cluster nodes", "cluster slots" or "cluster shards"
+ * command reply.
+ */
+static int cluster_update_route_by_reply(redisClusterContext *cc,
+                                         redisReply *reply) {
+    dict *nodes;
+
+    nodes = cluster_parse_route_reply(cc, reply);
+    if (nodes == NULL) {
+        return REDIS_ERR;
+    }
+
+    return cluster_update_route_by_nodes(cc, nodes);
+}
+
+/**
+ * Connect and authenticate to the node at ip:port, for requests made outside
+ * of the node connections used for commands. Returns NULL with the error set
+ * on failure.
+ */
+static redisContext *cluster_connect_once(redisClusterContext *cc,
+                                          const char *ip, int port) {
+    redisContext *c;
+
+    if (cc->connect_timeout) {
+        c = redisConnectWithTimeout(ip, port, *cc->connect_timeout);
+    } else {
+        c = redisConnect(ip, port);
+    }
+
+    if (c == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+    if (c->err) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        goto error;
+    }
+
+    if (cc->command_timeout) {
+        redisSetTimeout(c, *cc->command_timeout);
+    }
+
+#ifdef SSL_SUPPORT
+    if (cc->ssl) {
+        if (redisInitiateSSLWithContext(c, cc->ssl) != REDIS_OK) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            goto error;
+        }
+    }
+#endif
+
+    if (authenticate(cc, c) != REDIS_OK) {
+        goto error;
+    }
+
+    return c;
+
+error:
+    redisFree(c);
+    return NULL;
+}
+
+/**
+ * Update route by fetching the routing table from the node at ip:port.
+ */
+static int cluster_update_route_by_addr(redisClusterContext *cc, const char *ip,
+                                        int port) {
+    redisContext *c = NULL;
+    redisReply *reply = NULL;
+    int ret;
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    if (ip == NULL || port <= 0) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, "Ip or port error!");
+        goto error;
+    }
+
+    c = cluster_connect_once(cc, ip, port);
+    if (c == NULL) {
+        goto error;
+    }
+
+    if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SHARDS) {
+        reply = redisCommand(c, REDIS_COMMAND_CLUSTER_SHARDS);
+        if (reply == NULL) {
+            if (c->err == REDIS_ERR_TIMEOUT) {
+                __redisClusterSetError(
+                    cc, c->err,
+                    "Command(cluster shards) reply error(socket timeout)");
+            } else {
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "Command(cluster shards) reply error(NULL).");
+            }
+            goto error;
+        }
+    } else if (cc->flags & HIRCLUSTER_FLAG_ROUTE_USE_SLOTS) {
+        reply = redisCommand(c, REDIS_COMMAND_CLUSTER_SLOTS);
+        if (reply == NULL) {
+            if (c->err == REDIS_ERR_TIMEOUT) {
+                __redisClusterSetError(
+                    cc, c->err,
+                    "Command(cluster slots) reply error(socket timeout)");
+            } else {
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "Command(cluster slots) reply error(NULL).");
+            }
+            goto error;
+        }
+    } else {
+        reply = redisCommand(c, REDIS_COMMAND_CLUSTER_NODES);
+        if (reply == NULL) {
+            if (c->err == REDIS_ERR_TIMEOUT) {
+                __redisClusterSetError(
+                    cc, c->err,
+                    "Command(cluster nodes) reply error(socket timeout)");
+            } else {
+                __redisClusterSetError(
+                    cc, REDIS_ERR_OTHER,
+                    "Command(cluster nodes) reply error(NULL).");
+            }
+            goto error;
+        }
+    }
+
+    ret = cluster_update_route_by_reply(cc, reply);
+
+    freeReplyObject(reply);
+    redisFree(c);
+    return ret;
+
+error:
+    freeReplyObject(reply);
+    redisFree(c);
+    return REDIS_ERR;
+}
+
+#ifndef _WIN32
+/*
+ * Parallel route fetch.
+ *
+ * The known nodes are probed concurrently using non-blocking connects, with
+ * up to 'route_probes' probes in flight. A probe that fails is replaced by
+ * a probe of the next node. The first valid routing table is used, or when
+ * a quorum is configured, the first routing table that 'route_quorum' nodes
+ * agree on.
+ */
+
+typedef struct cluster_route_probe {
+    redisContext *c;
+    int written;      /* Commands are written, waiting for replies */
+    int auth_pending; /* Waiting for the AUTH reply */
+} cluster_route_probe;
+
+typedef struct cluster_route_candidate {
+    dict *nodes;
+    int votes;
+} cluster_route_candidate;
+
+static int cluster_route_probe_start(redisClusterContext *cc,
+                                     cluster_route_probe *probe,
+                                     cluster_node *node) {
+    redisContext *c;
+
+    c = redisConnectNonBlock(node->host, node->port);
+    if (c == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+    if (c->err) {
+        goto error;
+    }
+
+    probe->auth_pending = 0;
+    if (cc->password[0] != '\0') {
+        if (redisAppendCommand(c, "AUTH %s", cc->password) != REDIS_OK) {
+            goto error;
+        }
+        probe->auth_pending = 1;
+    }
+
+    if (redisAppendCommand(c, cluster_route_command(cc)) != REDIS_OK) {
+        goto error;
+    }
+
+    probe->c = c;
+    probe->written = 0;
+    return REDIS_OK;
+
+error:
+    __redisClusterSetError(cc, c->err, c->errstr);
+    redisFree(c);
+    return REDIS_ERR;
+}
+
+static void cluster_route_probe_stop(cluster_route_probe *probe) {
+    redisFree(probe->c);
+    probe->c = NULL;
+}
+
+/* Progress a probe when its socket is ready. The reply to the route command
+ * is returned in 'reply' when complete.
+ */
+static int cluster_route_probe_process(redisClusterContext *cc,
+                                       cluster_route_probe *probe,
+                                       redisReply **reply) {
+    redisContext *c = probe->c;
+    redisReply *r;
+    int done;
+
+    if (!probe->written) {
+        if (redisBufferWrite(c, &done) != REDIS_OK) {
+            goto error;
+        }
+        probe->written = done;
+        return REDIS_OK;
+    }
+
+    if (redisBufferRead(c) != REDIS_OK) {
+        goto error;
+    }
+
+    while (1) {
+        if (redisGetReplyFromReader(c, (void **)&r) != REDIS_OK) {
+            goto error;
+        }
+        if (r == NULL) {
+            return REDIS_OK;
+        }
+        if (!probe->auth_pending) {
+            *reply = r;
+            return REDIS_OK;
+        }
+
+        probe->auth_pending = 0;
+        if (r->type == REDIS_REPLY_ERROR) {
+            __redisClusterSetError(cc, REDIS_ERR_OTHER, r->str);
+            freeReplyObject(r);
+            return REDIS_ERR;
+        }
+        freeReplyObject(r);
+    }
+
+error:
+    __redisClusterSetError(cc, c->err, c->errstr);
+    return REDIS_ERR;
+}
+
+/* Check if two parsed routing tables have the same masters and slots. */
+static int cluster_route_nodes_equal(dict *nodes1, dict *nodes2) {
+    dictEntry *de1, *de2;
+    cluster_node *node1, *node2;
+    cluster_slot *slot1, *slot2;
+    listNode *lnode1, *lnode2;
+
+    if (dictSize(nodes1) != dictSize(nodes2)) {
+        return 0;
+    }
+
+    dictIterator di;
+    dictInitIterator(&di, nodes1);
+    while ((de1 = dictNext(&di)) != NULL) {
+        node1 = dictGetEntryVal(de1);
+        de2 = dictFind(nodes2, node1->addr);
+        if (de2 == NULL) {
+            return 0;
+        }
+        node2 = dictGetEntryVal(de2);
+
+        if (node1->slots == NULL || node2->slots == NULL) {
+            if (node1->slots != node2->slots) {
+                return 0;
+            }
+            continue;
+        }
+        if (listLength(node1->slots) != listLength(node2->slots)) {
+            return 0;
+        }
+
+        listIter li1;
+        listRewind(node1->slots, &li1);
+        while ((lnode1 = listNext(&li1)) != NULL) {
+            slot1 = listNodeValue(lnode1);
+
+            listIter li2;
+            listRewind(node2->slots, &li2);
+            while ((lnode2 = listNext(&li2)) != NULL) {
+                slot2 = listNodeValue(lnode2);
+                if (slot1->start == slot2->start && slot1->end == slot2->end) {
+                    break;
+                }
+            }
+            if (lnode2 == NULL) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* Register a parsed routing table as an answer from one node. Returns the
+ * routing table when it has reached the quorum. */
+static dict *cluster_route_vote(cluster_route_candidate *candidates,
+                                uint32_t *candidate_count, dict *nodes,
+                                int quorum) {
+    cluster_route_candidate *candidate = NULL;
+    uint32_t i;
+
+    for (i = 0; i < *candidate_count; i++) {
+        if (cluster_route_nodes_equal(candidates[i].nodes, nodes)) {
+            candidate = &candidates[i];
+            candidate->votes++;
+            dictRelease(nodes);
+            break;
+        }
+    }
+
+    if (candidate == NULL) {
+        candidate = &candidates[(*candidate_count)++];
+        candidate->nodes = nodes;
+        candidate->votes = 1;
+    }
+
+    if (candidate->votes < quorum) {
+        return NULL;
+    }
+
+    nodes = candidate->nodes;
+    candidate->nodes = NULL;
+    return nodes;
+}
+
+/* Milliseconds to wait for a probe event, or -1 to wait without limit. */
+static int cluster_route_probe_wait_ms(int64_t deadline) {
+    int64_t left;
+
+    if (deadline == 0) {
+        return -1;
+    }
+
+    left = (deadline - hi_usec_now()) / 1000;
+    return left > 0 ? (int)left : 0;
+}
+
+static int cluster_update_route_fetch_parallel(redisClusterContext *cc) {
+    cluster_node **seeds = NULL;
+    cluster_route_probe *probes = NULL;
+    cluster_route_candidate *candidates = NULL;
+    struct pollfd *pfds = NULL;
+    redisReply *reply;
+    dict *nodes;
+    dictEntry *de;
+    cluster_node *node;
+    uint32_t seed_count = 0, next_seed = 0, width = 0, candidate_count = 0, i;
+    int64_t deadline = 0;
+    int active, n, ret = REDIS_ERR;
+
+    seeds = hi_calloc(dictSize(cc->nodes), sizeof(cluster_node *));
+    if (seeds == NULL) {
+        goto oom;
+    }
+
+    dictIterator di;
+    dictInitIterator(&di, cc->nodes);
+    while ((de = dictNext(&di)) != NULL) {
+        node = dictGetEntryVal(de);
+        if (node == NULL || node->host == NULL || node->port < 0) {
+            continue;
+        }
+        seeds[seed_count++] = node;
+    }
+
+    if (seed_count == 0) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, "no valid server address");
+        goto done;
+    }
+
+    width = (uint32_t)MAX(cc->route_probes, cc->route_quorum);
+    if (width > seed_count) {
+        width = seed_count;
+    }
+
+    probes = hi_calloc(width, sizeof(cluster_route_probe));
+    pfds = hi_calloc(width, sizeof(struct pollfd));
+    candidates = hi_calloc(seed_count, sizeof(cluster_route_candidate));
+    if (probes == NULL || pfds == NULL || candidates == NULL) {
+        goto oom;
+    }
+
+    /* All probes share the sum of the configured timeouts */
+    if (cc->connect_timeout != NULL || cc->command_timeout != NULL) {
+        deadline = hi_usec_now();
+        if (cc->connect_timeout != NULL) {
+            deadline += cc->connect_timeout->tv_sec * 1000000LL +
+                        cc->connect_timeout->tv_usec;
+        }
+        if (cc->command_timeout != NULL) {
+            deadline += cc->command_timeout->tv_sec * 1000000LL +
+                        cc->command_timeout->tv_usec;
+        }
+    }
+
+    while (1) {
+        /* Keep the probe window filled */
+        active = 0;
+        for (i = 0; i < width; i++) {
+            while (probes[i].c == NULL && next_seed < seed_count) {
+                if (cluster_route_probe_start(cc, &probes[i],
+                                              seeds[next_seed++]) != REDIS_OK &&
+                    cc->err == REDIS_ERR_OOM) {
+                    goto done;
+                }
+            }
+
+            pfds[i].fd = probes[i].c != NULL ? probes[i].c->fd : -1;
+            pfds[i].events = probes[i].written ? POLLIN : POLLOUT;
+            pfds[i].revents = 0;
+            if (probes[i].c != NULL) {
+                active++;
+            }
+        }
+
+        if (active == 0) {
+            if (cc->route_quorum > 1 && candidate_count > 0) {
+                __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                                       "no quorum for the routing table");
+            }
+            goto done;
+        }
+
+        n = poll(pfds, width, cluster_route_probe_wait_ms(deadline));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            __redisClusterSetError(cc, REDIS_ERR_IO, strerror(errno));
+            goto done;
+        }
+        if (n == 0) {
+            __redisClusterSetError(cc, REDIS_ERR_TIMEOUT,
+                                   "route update error(socket timeout)");
+            goto done;
+        }
+
+        for (i = 0; i < width; i++) {
+            if (pfds[i].revents == 0 || probes[i].c == NULL) {
+                continue;
+            }
+
+            reply = NULL;
+            if (cluster_route_probe_process(cc, &probes[i], &reply) !=
+                REDIS_OK) {
+                cluster_route_probe_stop(&probes[i]);
+                continue;
+            }
+            if (reply == NULL) {
+                continue;
+            }
+
+            /* A probe is done after its first reply */
+            cluster_route_probe_stop(&probes[i]);
+
+            nodes = cluster_parse_route_reply(cc, reply);
+            freeReplyObject(reply);
+            if (nodes == NULL) {
+                if (cc->err == REDIS_ERR_OOM) {
+                    goto done;
+                }
+                continue;
+            }
+
+            if (cc->route_quorum > 1) {
+                nodes = cluster_route_vote(candidates, &candidate_count, nodes,
+                                           cc->route_quorum);
+                if (nodes == NULL) {
+                    continue;
+                }
+            }
+
+            if (cluster_update_route_by_nodes(cc, nodes) == REDIS_OK) {
+                ret = REDIS_OK;
+                goto done;
+            }
+        }
+    }
+
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    // passthrough
+
+done:
+    if (probes != NULL) {
+        for (i = 0; i < width; i++) {
+            redisFree(probes[i].c);
+        }
+        hi_free(probes);
+    }
+    if (candidates != NULL) {
+        for (i = 0; i < candidate_count; i++) {
+            if (candidates[i].nodes != NULL) {
+                dictRelease(candidates[i].nodes);
+            }
+        }
+        hi_free(candidates);
+    }
+    hi_free(pfds);
+    hi_free(seeds);
+
+    if (ret == REDIS_OK && cc->err) {
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+    return ret;
+}
+
+/* Check if the routing table should be fetched from several nodes at once.
+ * Connections using SSL are always probed one by one. */
+static int cluster_route_fetch_is_parallel(redisClusterContext *cc) {
+#ifdef SSL_SUPPORT
+    if (cc->ssl != NULL) {
+        return 0;
+    }
+#endif
+    return cc->route_probes > 1 || cc->route_quorum > 1;
+}
+#endif /* _WIN32 */
+
+/* Fetch the routing table from any of the given nodes. */
+static int cluster_update_route_fetch_from(redisClusterContext *cc,
+                                           dict *nodes) {
+    int ret;
+    int flag_err_not_set = 1;
+    cluster_node *node;
+    dictEntry *de;
+
+    dictIterator di;
+    dictInitIterator(&di, nodes);
+
+    while ((de = dictNext(&di)) != NULL) {
+        node = dictGetEntryVal(de);
+        if (node == NULL || node->host == NULL || node->port < 0) {
+            continue;
+        }
+
+        ret = cluster_update_route_by_addr(cc, node->host, node->port);
+        if (ret == REDIS_OK) {
+            if (cc->err) {
+                cc->err = 0;
+                memset(cc->errstr, '\0', strlen(cc->errstr));
+            }
+            return REDIS_OK;
+        }
+
+        flag_err_not_set = 0;
+    }
+
+    if (flag_err_not_set) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, "no valid server address");
+    }
+
+    return REDIS_ERR;
+}
+
+/* Fetch the routing table from any of the known nodes. When they were read
+ * from the topology cache file and none of them answers, like when the
+ * cluster has been redeployed with new addresses, the seed nodes are
+ * asked. */
+static int cluster_update_route_fetch(redisClusterContext *cc) {
+    int ret;
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    if (cc->nodes == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, "no server address");
+        return REDIS_ERR;
+    }
+
+#ifndef _WIN32
+    if (cluster_route_fetch_is_parallel(cc)) {
+        ret = cluster_update_route_fetch_parallel(cc);
+    } else {
+        ret = cluster_update_route_fetch_from(cc, cc->nodes);
+    }
+#else
+    ret = cluster_update_route_fetch_from(cc, cc->nodes);
+#endif
+
+    if (ret != REDIS_OK && cc->seed_nodes != NULL) {
+        ret = cluster_update_route_fetch_from(cc, cc->seed_nodes);
+    }
+
+    /* The seed nodes are only needed until a route is fetched */
+    if (ret == REDIS_OK && cc->seed_nodes != NULL) {
+        dictRelease(cc->seed_nodes);
+        cc->seed_nodes = NULL;
+    }
+
+    return ret;
+}
+
+/*
+ * Shared topology.
+ *
+ * Contexts attached to the same redisClusterTopology, possibly used by
+ * different threads, share the fetched routing table and command table. A
+ * route update done by one context is published as an immutable snapshot by
+ * swapping the topology's snapshot pointer and increasing its version. Each
+ * context keeps using its own nodes and connections, and rebuilds them from
+ * the newest snapshot when it sees that the version has changed. The command
+ * table is shared by reference. The version check is a single atomic load,
+ * so the slot lookups remain lock-free.
+ *
+ * Route updates are serialized per topology. A context that waited for an
+ * update done by another context uses that result instead of fetching again.
+ */
+
+/* Node as described in a published snapshot. */
+typedef struct cluster_topology_node {
+    sds name;
+    sds addr;
+    sds host;
+    int port;
+    uint32_t master; /* Index of the master of a replica, 0 for a master */
+} cluster_topology_node;
+
+/* Published routing table, immutable and refcounted. */
+typedef struct cluster_topology_route {
+    int refcount;
+    uint64_t version;
+    uint32_t node_count;                 /* Entries in nodes[], incl. index 0 */
+    cluster_topology_node *nodes;        /* Replicas follow their master */
+    uint16_t slots[REDIS_CLUSTER_SLOTS]; /* Master index per slot */
+    cluster_commands *commands;          /* Command table or NULL */
+} cluster_topology_route;
+
+struct redisClusterTopology {
+    int refcount;
+    uint64_t version;       /* Version of the published snapshot */
+    hi_mutex_t lock;        /* Protects the snapshot pointer */
+    hi_mutex_t update_lock; /* Serializes route updates */
+    cluster_topology_route *route;
+};
+
+static void cluster_topology_route_release(cluster_topology_route *troute) {
+    uint32_t i;
+
+    if (troute == NULL || hi_atomic_decr(&troute->refcount) != 0) {
+        return;
+    }
+
+    if (troute->nodes != NULL) {
+        for (i = 1; i < troute->node_count; i++) {
+            sdsfree(troute->nodes[i].name);
+            sdsfree(troute->nodes[i].addr);
+            sdsfree(troute->nodes[i].host);
+        }
+        hi_free(troute->nodes);
+    }
+    cluster_commands_release(troute->commands);
+    hi_free(troute);
+}
+
+static int cluster_topology_node_set(cluster_topology_node *tnode,
+                                     cluster_node *node, uint32_t master) {
+    if (node->name != NULL) {
+        tnode->name = sdsdup(node->name);
+        if (tnode->name == NULL) {
+            return REDIS_ERR;
+        }
+    }
+    tnode->addr = sdsdup(node->addr);
+    if (tnode->addr == NULL) {
+        return REDIS_ERR;
+    }
+    tnode->host = sdsdup(node->host);
+    if (tnode->host == NULL) {
+        return REDIS_ERR;
+    }
+    tnode->port = node->port;
+    tnode->master = master;
+
+    return REDIS_OK;
+}
+
+static int cluster_topology_node_copy(cluster_topology_node *tnode,
+                                      const cluster_topology_node *src) {
+    if (src->name != NULL) {
+        tnode->name = sdsdup(src->name);
+        if (tnode->name == NULL) {
+            return REDIS_ERR;
+        }
+    }
+    tnode->addr = sdsdup(src->addr);
+    if (tnode->addr == NULL) {
+        return REDIS_ERR;
+    }
+    tnode->host = sdsdup(src->host);
+    if (tnode->host == NULL) {
+        return REDIS_ERR;
+    }
+    tnode->port = src->port;
+    tnode->master = src->master;
+
+    return REDIS_OK;
+}
+
+/* Create a copy of a snapshot with a slot served by the given master. A
+ * master missing from the snapshot is added last. */
+static cluster_topology_route *
+cluster_topology_route_patch(const cluster_topology_route *old, uint32_t slot,
+                             cluster_node *master) {
+    cluster_topology_route *troute;
+    uint32_t i, idx;
+
+    for (idx = 1; idx < old->node_count; idx++) {
+        if (old->nodes[idx].master == 0 &&
+            sdscmp(old->nodes[idx].addr, master->addr) == 0) {
+            break;
+        }
+    }
+
+    troute = hi_calloc(1, sizeof(*troute));
+    if (troute == NULL) {
+        return NULL;
+    }
+    troute->refcount = 1;
+
+    troute->nodes = hi_calloc(old->node_count + 1,
+                              sizeof(cluster_topology_node));
+    if (troute->nodes == NULL) {
+        goto oom;
+    }
+
+    troute->node_count = 1;
+    for (i = 1; i < old->node_count; i++) {
+        if (cluster_topology_node_copy(&troute->nodes[troute->node_count++],
+                                       &old->nodes[i]) != REDIS_OK) {
+            goto oom;
+        }
+    }
+    if (idx == old->node_count &&
+        cluster_topology_node_set(&troute->nodes[troute->node_count++],
+                                  master, 0) != REDIS_OK) {
+        goto oom;
+    }
+
+    memcpy(troute->slots, old->slots, sizeof(troute->slots));
+    troute->slots[slot] = (uint16_t)idx;
+
+    troute->commands = old->commands;
+    if (troute->commands != NULL) {
+        hi_atomic_incr(&troute->commands->refcount);
+    }
+
+    return troute;
+
+oom:
+    cluster_topology_route_release(troute);
+    return NULL;
+}
+
+/* Create a snapshot of the current routing table of a context. */
+static cluster_topology_route *
+cluster_topology_route_create(redisClusterContext *cc) {
+    struct cluster_route *route = cc->route;
+    cluster_topology_route *troute;
+    cluster_node *master;
+    listNode *lnode;
+    uint32_t i, count;
+
+    count = route->node_count;
+    for (i = 1; i < route->node_count; i++) {
+        master = route->nodes[i];
+        if (master->slaves != NULL) {
+            count += listLength(master->slaves);
+        }
+    }
+
+    troute = hi_calloc(1, sizeof(*troute));
+    if (troute == NULL) {
+        return NULL;
+    }
+    troute->refcount = 1;
+
+    troute->nodes = hi_calloc(count, sizeof(cluster_topology_node));
+    if (troute->nodes == NULL) {
+        goto oom;
+    }
+
+    troute->node_count = route->node_count;
+    for (i = 1; i < route->node_count; i++) {
+        if (cluster_topology_node_set(&troute->nodes[i], route->nodes[i], 0) !=
+            REDIS_OK) {
+            goto oom;
+        }
+    }
+
+    for (i = 1; i < route->node_count; i++) {
+        master = route->nodes[i];
+        if (master->slaves == NULL) {
+            continue;
+        }
+
+        listIter li;
+        listRewind(master->slaves, &li);
+        while ((lnode = listNext(&li))) {
+            if (cluster_topology_node_set(&troute->nodes[troute->node_count++],
+                                          listNodeValue(lnode),
+                                          i) != REDIS_OK) {
+                goto oom;
+            }
+        }
+    }
+
+    memcpy(troute->slots, route->slots, sizeof(troute->slots));
+
+    troute->commands = cc->commands;
+    if (troute->commands != NULL) {
+        hi_atomic_incr(&troute->commands->refcount);
+    }
+
+    return troute;
+
+oom:
+    cluster_topology_route_release(troute);
+    return NULL;
+}
+
+static cluster_node *
+cluster_topology_node_create(const cluster_topology_node *tnode) {
+    cluster_node *node;
+
+    node = hi_malloc(sizeof(cluster_node));
+    if (node == NULL) {
+        return NULL;
+    }
+    cluster_node_init(node);
+
+    node->role = tnode->master == 0 ? REDIS_ROLE_MASTER : REDIS_ROLE_SLAVE;
+    node->port = tnode->port;
+    if (tnode->name != NULL) {
+        node->name = sdsdup(tnode->name);
+        if (node->name == NULL) {
+            goto oom;
+        }
+    }
+    node->addr = sdsdup(tnode->addr);
+    if (node->addr == NULL) {
+        goto oom;
+    }
+    node->host = sdsdup(tnode->host);
+    if (node->host == NULL) {
+        goto oom;
+    }
+
+    return node;
+
+oom:
+    cluster_node_deinit(node);
+    hi_free(node);
+    return NULL;
+}
+
+/* Create a nodes dict, with slots and optionally replicas, from a snapshot. */
+static dict *cluster_topology_route_nodes(redisClusterContext *cc,
+                                          cluster_topology_route *troute) {
+    dict *nodes;
+    cluster_node **created = NULL, *node = NULL, *master;
+    cluster_topology_node *tnode;
+    cluster_slot *slot;
+    sds key;
+    uint32_t i, k, start;
+
+    nodes = dictCreate(&clusterNodesDictType, NULL);
+    if (nodes == NULL) {
+        goto oom;
+    }
+
+    created = hi_calloc(troute->node_count, sizeof(cluster_node *));
+    if (created == NULL) {
+        goto oom;
+    }
+
+    for (i = 1; i < troute->node_count; i++) {
+        tnode = &troute->nodes[i];
+        if (tnode->master != 0 && !(cc->flags & HIRCLUSTER_FLAG_ADD_SLAVE)) {
+            continue;
+        }
+
+        node = cluster_topology_node_create(tnode);
+        if (node == NULL) {
+            goto oom;
+        }
+
+        if (tnode->master == 0) {
+            key = sdsdup(node->addr);
+            if (key == NULL) {
+                goto oom;
+            }
+            if (dictAdd(nodes, key, node) != DICT_OK) {
+                sdsfree(key);
+                goto oom;
+            }
+        } else {
+            master = created[tnode->master];
+            if (master->slaves == NULL) {
+                master->slaves = listCreate();
+                if (master->slaves == NULL) {
+                    goto oom;
+                }
+
+                master->slaves->free = listClusterNodeDestructor;
+            }
+            if (listAddNodeTail(master->slaves, node) == NULL) {
+                goto oom;
+            }
+        }
+        created[i] = node;
+        node = NULL;
+    }
+
+    for (k = 0; k < REDIS_CLUSTER_SLOTS; k = i) {
+        start = k;
+        for (i = k + 1;
+             i < REDIS_CLUSTER_SLOTS && troute->slots[i] == troute->slots[k];
+             i++)
+            ;
+        if (troute->slots[k] == 0) {
+            continue;
+        }
+
+        slot = cluster_slot_create(created[troute->slots[k]]);
+        if (slot == NULL) {
+            goto oom;
+        }
+        slot->start = start;
+        slot->end = i - 1;
+    }
+
+    hi_free(created);
+    return nodes;
+
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    if (node != NULL) {
+        cluster_node_deinit(node);
+        hi_free(node);
+    }
+    hi_free(created);
+    if (nodes != NULL) {
+        dictRelease(nodes);
+    }
+    return NULL;
+}
+
+/* Check, lock-free, if a newer snapshot than the one used by the context
+ * has been published. */
+static int cluster_topology_changed(redisClusterContext *cc) {
+    return cc->topology != NULL &&
+           hi_atomic_load64(&cc->topology->version) != cc->topology_version;
+}
+
+/* Rebuild the routing table of a context from the newest snapshot. */
+static int cluster_topology_sync(redisClusterContext *cc) {
+    redisClusterTopology *topology = cc->topology;
+    cluster_topology_route *troute;
+    dict *nodes;
+    int ret = REDIS_ERR;
+
+    hi_mutex_lock(&topology->lock);
+    troute = topology->route;
+    if (troute != NULL) {
+        hi_atomic_incr(&troute->refcount);
+    }
+    hi_mutex_unlock(&topology->lock);
+
+    if (troute == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "no routing table in shared topology");
+        return REDIS_ERR;
+    }
+
+    nodes = cluster_topology_route_nodes(cc, troute);
+    if (nodes != NULL) {
+        ret = cluster_update_route_by_nodes(cc, nodes);
+    }
+    if (ret == REDIS_OK) {
+        cc->topology_version = troute->version;
+
+        /* The command table is only fetched when the publisher had none */
+        if (troute->commands != NULL &&
+            cc->flags & HIRCLUSTER_FLAG_FETCH_COMMANDS) {
+            hi_atomic_incr(&troute->commands->refcount);
+            cluster_commands_install(cc, troute->commands);
+        } else if (cc->commands == NULL) {
+            cluster_commands_update(cc);
+        }
+    }
+
+    cluster_topology_route_release(troute);
+    return ret;
+}
+
+/* Sync with a newer snapshot when one has been published. On failure the
+ * current routing table is kept. */
+static void cluster_topology_sync_when_changed(redisClusterContext *cc) {
+    if (!cluster_topology_changed(cc)) {
+        return;
+    }
+
+    if (cluster_topology_sync(cc) != REDIS_OK) {
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+}
+
+/* Publish the routing table of a context to its topology. */
+static int cluster_topology_publish(redisClusterContext *cc) {
+    redisClusterTopology *topology = cc->topology;
+    cluster_topology_route *troute, *old_troute;
+
+    troute = cluster_topology_route_create(cc);
+    if (troute == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+
+    hi_mutex_lock(&topology->lock);
+    old_troute = topology->route;
+    troute->version = topology->version + 1;
+    topology->route = troute;
+    hi_atomic_store64(&topology->version, troute->version);
+    hi_mutex_unlock(&topology->lock);
+
+    cc->topology_version = troute->version;
+    cluster_topology_route_release(old_troute);
+    return REDIS_OK;
+}
+
+/* Publish a slot moved to the given master, as told by a MOVED reply. The
+ * newest snapshot is patched, not replaced by the routing table of the
+ * context, which may lack the replicas or be outdated. */
+static int cluster_topology_publish_slot(redisClusterContext *cc,
+                                         uint32_t slot, cluster_node *master) {
+    redisClusterTopology *topology = cc->topology;
+    cluster_topology_route *troute, *old_troute;
+
+    hi_mutex_lock(&topology->lock);
+    old_troute = topology->route;
+    if (old_troute == NULL) {
+        hi_mutex_unlock(&topology->lock);
+        return REDIS_OK;
+    }
+
+    troute = cluster_topology_route_patch(old_troute, slot, master);
+    if (troute == NULL) {
+        hi_mutex_unlock(&topology->lock);
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+
+    troute->version = topology->version + 1;
+    topology->route = troute;
+    hi_atomic_store64(&topology->version, troute->version);
+    hi_mutex_unlock(&topology->lock);
+
+    /* A context behind still has to sync the snapshots it missed */
+    if (cc->topology_version == old_troute->version) {
+        cc->topology_version = troute->version;
+    }
+    cluster_topology_route_release(old_troute);
+    return REDIS_OK;
+}
+
+/* Update the route of a context attached to a shared topology. Only one
+ * context fetches the routing table, contexts waiting meanwhile use the
+ * published result. */
+static int cluster_topology_update_route(redisClusterContext *cc) {
+    redisClusterTopology *topology = cc->topology;
+    int ret;
+
+    hi_mutex_lock(&topology->update_lock);
+
+    if (cluster_topology_changed(cc)) {
+        hi_mutex_unlock(&topology->update_lock);
+        return cluster_topology_sync(cc);
+    }
+
+    ret = cluster_update_route_fetch(cc);
+    if (ret == REDIS_OK) {
+        cluster_commands_update(cc);
+        ret = cluster_topology_publish(cc);
+    }
+
+    hi_mutex_unlock(&topology->update_lock);
+    return ret;
+}
+
+redisClusterTopology *redisClusterTopologyCreate(void) {
+    redisClusterTopology *topology;
+
+    topology = hi_calloc(1, sizeof(redisClusterTopology));
+    if (topology == NULL) {
+        return NULL;
+    }
+
+    topology->refcount = 1;
+    topology->version = 0;
+    topology->route = NULL;
+    hi_mutex_init(&topology->lock);
+    hi_mutex_init(&topology->update_lock);
+
+    return topology;
+}
+
+/* Release a reference to a topology. The topology is freed when the last
+ * attached context is freed. */
+void redisClusterTopologyFree(redisClusterTopology *topology) {
+    if (topology == NULL || hi_atomic_decr(&topology->refcount) != 0) {
+        return;
+    }
+
+    cluster_topology_route_release(topology->route);
+    hi_mutex_destroy(&topology->lock);
+    hi_mutex_destroy(&topology->update_lock);
+    hi_free(topology);
+}
+
+/*
+ * Topology cache file
+ *
+ * The slot lookup table can be saved to a file after each routing table
+ * update, and loaded when connecting instead of fetching the routing table.
+ * Staleness is corrected by MOVED redirects and a lazy full route update.
+ *
+ * File layout, all integers in little-endian byte order:
+ *
+ *   "HCTF" u16 version, u16 node count, u64 epoch (seconds since 1970)
+ *   per node: u16 port, u8 host length, host, u8 name length, name
+ *   u16 range count
+ *   per slot range: u16 start, u16 end, u16 node index (0-based)
+ *   u16 crc16 of everything above
+ */
+
+#define TOPOLOGY_FILE_MAGIC "HCTF"
+#define TOPOLOGY_FILE_VERSION 1
+#define TOPOLOGY_FILE_MAX_SIZE (4 * 1024 * 1024)
+
+static unsigned char *topology_file_put_u16(unsigned char *p,
+                                            uint32_t value) {
+    p[0] = (unsigned char)(value & 0xff);
+    p[1] = (unsigned char)((value >> 8) & 0xff);
+    return p + 2;
+}
+
+static unsigned char *topology_file_put_str(unsigned char *p, const char *str,
+                                            size_t len) {
+    p[0] = (unsigned char)len;
+    if (len > 0) {
+        memcpy(p + 1, str, len);
+    }
+    return p + 1 + len;
+}
+
+/* Get the number of slot ranges in a lookup table. */
+static uint32_t topology_file_range_count(struct cluster_route *route) {
+    uint32_t slot_num, ranges = 0;
+
+    for (slot_num = 0; slot_num < REDIS_CLUSTER_SLOTS; slot_num++) {
+        if (route->slots[slot_num] != 0 &&
+            (slot_num + 1 == REDIS_CLUSTER_SLOTS ||
+             route->slots[slot_num + 1] != route->slots[slot_num])) {
+            ranges++;
+        }
+    }
+
+    return ranges;
+}
+
+/* Serialize the current slot lookup table. */
+static sds topology_file_encode(redisClusterContext *cc) {
+    struct cluster_route *route = cc->route;
+    cluster_node *node;
+    uint32_t idx, start, slot_num, ranges;
+    size_t size, name_len;
+    unsigned char *p;
+    uint64_t epoch;
+    sds buf;
+    int i;
+
+    ranges = topology_file_range_count(route);
+    size = 4 + 2 + 2 + 8 + 2 + ranges * 6 + 2;
+    for (idx = 1; idx < route->node_count; idx++) {
+        node = route->nodes[idx];
+        name_len = node->name ? sdslen(node->name) : 0;
+        if (node->host == NULL || sdslen(node->host) > UINT8_MAX ||
+            name_len > UINT8_MAX) {
+            return NULL;
+        }
+        size += 2 + 1 + sdslen(node->host) + 1 + name_len;
+    }
+
+    buf = sdsnewlen(NULL, size);
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    p = (unsigned char *)buf;
+    memcpy(p, TOPOLOGY_FILE_MAGIC, 4);
+    p = topology_file_put_u16(p + 4, TOPOLOGY_FILE_VERSION);
+    p = topology_file_put_u16(p, route->node_count - 1);
+    epoch = (uint64_t)time(NULL);
+    for (i = 0; i < 8; i++) {
+        *p++ = (unsigned char)((epoch >> (8 * i)) & 0xff);
+    }
+
+    for (idx = 1; idx < route->node_count; idx++) {
+        node = route->nodes[idx];
+        p = topology_file_put_u16(p, (uint32_t)node->port);
+        p = topology_file_put_str(p, node->host, sdslen(node->host));
+        p = topology_file_put_str(p, node->name,
+                                  node->name ? sdslen(node->name) : 0);
+    }
+
+    p = topology_file_put_u16(p, ranges);
+    for (start = 0; start < REDIS_CLUSTER_SLOTS; start = slot_num) {
+        idx = route->slots[start];
+        slot_num = start + 1;
+        while (slot_num < REDIS_CLUSTER_SLOTS &&
+               route->slots[slot_num] == idx) {
+            slot_num++;
+        }
+
+        if (idx != 0) {
+            p = topology_file_put_u16(p, start);
+            p = topology_file_put_u16(p, slot_num - 1);
+            p = topology_file_put_u16(p, idx - 1);
+        }
+    }
+
+    topology_file_put_u16(p, crc16(buf, (int)(size - 2)));
+    return buf;
+}
+
+/* Save the slot lookup table to the topology cache file. The file is
+ * replaced atomically, and failures are ignored since the file only is a
+ * cache. */
+static void topology_file_save(redisClusterContext *cc) {
+    sds buf, tmp_path = NULL;
+    FILE *fp = NULL;
+
+    if (cc->topology_file == NULL || cc->route == NULL) {
+        return;
+    }
+
+    buf = topology_file_encode(cc);
+    if (buf == NULL) {
+        return;
+    }
+
+    /* Unique to the context, since the file can be shared by processes */
+    tmp_path = sdscatfmt(sdsempty(), "%s.%i.%U.tmp", cc->topology_file,
+                         (int)getpid(),
+                         (unsigned long long)(uintptr_t)cc);
+    if (tmp_path == NULL) {
+        goto done;
+    }
+
+    fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        goto done;
+    }
+
+    if (fwrite(buf, 1, sdslen(buf), fp) != sdslen(buf)) {
+        fclose(fp);
+        remove(tmp_path);
+        goto done;
+    }
+    if (fclose(fp) != 0) {
+        remove(tmp_path);
+        goto done;
+    }
+
+#ifdef _WIN32
+    remove(cc->topology_file);
+#endif
+    if (rename(tmp_path, cc->topology_file) != 0) {
+        remove(tmp_path);
+    }
+
+done:
+    sdsfree(tmp_path);
+    sdsfree(buf);
+}
+
+/* A reader of the topology cache file contents. */
+typedef struct topology_file_reader {
+    const unsigned char *pos;
+    const unsigned char *end;
+} topology_file_reader;
+
+static int topology_file_get_u16(topology_file_reader *r, uint32_t *value) {
+    if (r->end - r->pos < 2) {
+        return REDIS_ERR;
+    }
+    *value = (uint32_t)r->pos[0] | ((uint32_t)r->pos[1] << 8);
+    r->pos += 2;
+    return REDIS_OK;
+}
+
+static int topology_file_get_str(topology_file_reader *r, const char **str,
+                                 size_t *len) {
+    if (r->end - r->pos < 1 || r->end - r->pos - 1 < r->pos[0]) {
+        return REDIS_ERR;
+    }
+    *len = r->pos[0];
+    *str = (const char *)r->pos + 1;
+    r->pos += 1 + *len;
+    return REDIS_OK;
+}
+
+/* Read the whole topology cache file. */
+static sds topology_file_read(const char *path) {
+    char chunk[4096];
+    size_t n;
+    sds buf;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    buf = sdsempty();
+    while (buf != NULL && (n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        buf = sdscatlen(buf, chunk, n);
+        if (buf != NULL && sdslen(buf) > TOPOLOGY_FILE_MAX_SIZE) {
+            sdsfree(buf);
+            buf = NULL;
+        }
+    }
+    if (buf != NULL && ferror(fp)) {
+        sdsfree(buf);
+        buf = NULL;
+    }
+
+    fclose(fp);
+    return buf;
+}
+
+/* Decode the topology cache file contents into a dict of master nodes. */
+static dict *topology_file_decode(sds buf) {
+    topology_file_reader r;
+    dict *nodes = NULL;
+    cluster_node **index = NULL, *node;
+    cluster_slot *slot;
+    const char *host, *name;
+    size_t host_len, name_len, len = sdslen(buf);
+    uint32_t version, node_count, port, ranges, start, end, idx, crc, i;
+
+    if (len < 4 + 2 + 2 + 8 + 2 + 2 ||
+        memcmp(buf, TOPOLOGY_FILE_MAGIC, 4) != 0) {
+        return NULL;
+    }
+
+    r.pos = (const unsigned char *)buf + len - 2;
+    r.end = (const unsigned char *)buf + len;
+    if (topology_file_get_u16(&r, &crc) != REDIS_OK ||
+        crc != crc16(buf, (int)(len - 2))) {
+        return NULL;
+    }
+
+    r.pos = (const unsigned char *)buf + 4;
+    r.end = (const unsigned char *)buf + len - 2;
+    if (topology_file_get_u16(&r, &version) != REDIS_OK ||
+        version != TOPOLOGY_FILE_VERSION ||
+        topology_file_get_u16(&r, &node_count) != REDIS_OK ||
+        node_count == 0 || r.end - r.pos < 8) {
+        return NULL;
+    }
+    r.pos += 8; // The epoch is informational
+
+    nodes = dictCreate(&clusterNodesDictType, NULL);
+    index = hi_calloc(node_count, sizeof(cluster_node *));
+    if (nodes == NULL || index == NULL) {
+        goto error;
+    }
+
+    for (i = 0; i < node_count; i++) {
+        if (topology_file_get_u16(&r, &port) != REDIS_OK ||
+            topology_file_get_str(&r, &host, &host_len) != REDIS_OK ||
+            topology_file_get_str(&r, &name, &name_len) != REDIS_OK ||
+            host_len == 0 || !hi_valid_port((int)port)) {
+            goto error;
+        }
+
+        node = hi_malloc(sizeof(cluster_node));
+        if (node == NULL) {
+            goto error;
+        }
+        cluster_node_init(node);
+        node->role = REDIS_ROLE_MASTER;
+        node->port = (int)port;
+        node->host = sdsnewlen(host, host_len);
+        node->addr = sdsnewlen(host, host_len);
+        if (node->addr != NULL) {
+            node->addr = sdscatfmt(node->addr, ":%u", port);
+        }
+        node->name = name_len > 0 ? sdsnewlen(name, name_len) : NULL;
+        if (node->host == NULL || node->addr == NULL ||
+            (name_len > 0 && node->name == NULL)) {
+            cluster_node_deinit(node);
+            hi_free(node);
+            goto error;
+        }
+
+        sds key = sdsdup(node->addr);
+        if (key == NULL || dictAdd(nodes, key, node) != DICT_OK) {
+            sdsfree(key);
+            cluster_node_deinit(node);
+            hi_free(node);
+            goto error;
+        }
+        index[i] = node;
+    }
+
+    if (topology_file_get_u16(&r, &ranges) != REDIS_OK) {
+        goto error;
+    }
+    for (i = 0; i < ranges; i++) {
+        if (topology_file_get_u16(&r, &start) != REDIS_OK ||
+            topology_file_get_u16(&r, &end) != REDIS_OK ||
+            topology_file_get_u16(&r, &idx) != REDIS_OK ||
+            idx >= node_count) {
+            goto error;
+        }
+
+        slot = cluster_slot_create(index[idx]);
+        if (slot == NULL) {
+            goto error;
+        }
+        slot->start = start;
+        slot->end = end;
+    }
+
+    if (r.pos != r.end) {
+        goto error;
+    }
+
+    hi_free(index);
+    return nodes;
+
+error:
+    hi_free(index);
+    if (nodes != NULL) {
+        dictRelease(nodes);
+    }
+    return NULL;
+}
+
+/* Install the slot lookup table from the topology cache file. A full route
+ * update is scheduled to be done lazily. Nothing is changed on failure. */
+static int topology_file_load(redisClusterContext *cc) {
+    dict *nodes, *seed_nodes;
+    sds buf;
+
+    if (cc->topology_file == NULL) {
+        return REDIS_ERR;
+    }
+
+    buf = topology_file_read(cc->topology_file);
+    if (buf == NULL) {
+        return REDIS_ERR;
+    }
+
+    nodes = topology_file_decode(buf);
+    sdsfree(buf);
+    if (nodes == NULL) {
+        return REDIS_ERR;
+    }
+
+    /* The seed nodes are kept aside, to be asked when none of the cached
+     * nodes can be reached */
+    seed_nodes = cc->nodes;
+    cc->nodes = NULL;
+
+    /* Overlapping slot ranges are rejected here */
+    if (cluster_update_route_by_nodes(cc, nodes) != REDIS_OK) {
+        cc->nodes = seed_nodes;
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+        return REDIS_ERR;
+    }
+
+    if (cc->seed_nodes != NULL) {
+        dictRelease(cc->seed_nodes);
+    }
+    cc->seed_nodes = seed_nodes;
+
+    cc->update_route_time = hi_usec_now() + cc->route_update_interval;
+    return REDIS_OK;
+}
+
+/*
+ * Command table.
+ *
+ * The key positions of the commands missing from the compiled-in table in
+ * command.c are learned from the COMMAND reply of a node, fetched with each
+ * routing table update when enabled. The legacy first key, last key and
+ * step are used, or the first key spec when the first key is not fixed,
+ * such as for commands giving the number of keys.
+ */
+
+/* Get the value of an integer reply, or 0. */
+static long long cluster_reply_integer(redisReply *reply) {
+    return reply != NULL && reply->type == REDIS_REPLY_INTEGER ? reply->integer
+                                                               : 0;
+}
+
+/* Set the key positions from the first key spec in a COMMAND reply element,
+ * available since Redis 7.0, when the keys start at a given index. */
+static void cluster_command_key_spec_parse(redisReply *key_specs,
+                                           struct cmd_key_spec *spec) {
+    redisReply *begin, *begin_spec, *find, *find_spec;
+    long long index, keynum_index, first_key;
+
+    if (key_specs->type != REDIS_REPLY_ARRAY || key_specs->elements == 0) {
+        return;
+    }
+
+    begin = cluster_shards_field(key_specs->element[0], "begin_search");
+    find = cluster_shards_field(key_specs->element[0], "find_keys");
+    if (begin == NULL || find == NULL ||
+        !cluster_shards_field_equal(begin, "type", "index")) {
+        return;
+    }
+
+    begin_spec = cluster_shards_field(begin, "spec");
+    find_spec = cluster_shards_field(find, "spec");
+    if (begin_spec == NULL || find_spec == NULL) {
+        return;
+    }
+
+    index = cluster_reply_integer(cluster_shards_field(begin_spec, "index"));
+    if (index <= 0 || index > INT_MAX / 2) {
+        return;
+    }
+
+    if (cluster_shards_field_equal(find, "type", "range")) {
+        spec->first_key = (int)index;
+        spec->last_key = (int)cluster_reply_integer(
+            cluster_shards_field(find_spec, "lastkey"));
+        spec->step = (int)cluster_reply_integer(
+            cluster_shards_field(find_spec, "keystep"));
+    } else if (cluster_shards_field_equal(find, "type", "keynum")) {
+        /* The key count and the first key are relative to the index */
+        keynum_index = cluster_reply_integer(
+            cluster_shards_field(find_spec, "keynumidx"));
+        first_key = cluster_reply_integer(
+            cluster_shards_field(find_spec, "firstkey"));
+        if (keynum_index < 0 || keynum_index > INT_MAX / 2 ||
+            first_key > INT_MAX / 2) {
+            return;
+        }
+        keynum_index += index;
+        first_key += index;
+        if (first_key <= keynum_index) {
+            return;
+        }
+        spec->keynum_index = (int)keynum_index;
+        spec->first_key = (int)first_key;
+        spec->step = (int)cluster_reply_integer(
+            cluster_shards_field(find_spec, "keystep"));
+    }
+}
+
+/* Add a command, and its subcommands, described by an element of the
+ * COMMAND reply to the table. Malformed elements are skipped. */
+static int cluster_commands_add(dict *commands, redisReply *elem) {
+    struct cmd_key_spec *spec;
+    redisReply *name, *flags, *subcommands;
+    size_t i;
+    sds key;
+
+    if (elem->type != REDIS_REPLY_ARRAY || elem->elements < 6) {
+        return REDIS_OK;
     }
 
-    if (nodes == NULL) {
-        goto error;
+    name = elem->element[0];
+    flags = elem->element[2];
+    if (name->type != REDIS_REPLY_STRING || name->len == 0 ||
+        name->len > CMD_KEY_SPEC_NAME_MAX ||
+        memchr(name->str, '\0', name->len) != NULL ||
+        elem->element[1]->type != REDIS_REPLY_INTEGER ||
+        flags->type != REDIS_REPLY_ARRAY) {
+        return REDIS_OK;
     }
 
-    memset(table, 0, REDIS_CLUSTER_SLOTS * sizeof(cluster_node *));
-
-    slots = hiarray_create(dictSize(nodes), sizeof(cluster_slot *));
-    if (slots == NULL) {
-        goto oom;
+    spec = hi_calloc(1, sizeof(*spec));
+    if (spec == NULL) {
+        return REDIS_ERR;
     }
 
-    dictIterator di;
-    dictInitIterator(&di, nodes);
+    spec->arity = (int)cluster_reply_integer(elem->element[1]);
+    spec->first_key = (int)cluster_reply_integer(elem->element[3]);
+    spec->last_key = (int)cluster_reply_integer(elem->element[4]);
+    spec->step = (int)cluster_reply_integer(elem->element[5]);
+    if (spec->first_key < 0) {
+        spec->first_key = 0;
+    }
+    if (spec->first_key == 0 && elem->elements > 8) {
+        cluster_command_key_spec_parse(elem->element[8], spec);
+    }
 
-    while ((den = dictNext(&di))) {
-        master = dictGetEntryVal(den);
-        if (master->role != REDIS_ROLE_MASTER) {
-            __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                                   "Node role must be master");
-            goto error;
+    for (i = 0; i < flags->elements; i++) {
+        if ((flags->element[i]->type == REDIS_REPLY_STATUS ||
+             flags->element[i]->type == REDIS_REPLY_STRING) &&
+            strcmp(flags->element[i]->str, "readonly") == 0) {
+            spec->readonly = 1;
         }
+    }
 
-        if (master->slots == NULL) {
-            continue;
-        }
+    subcommands = elem->elements > 9 ? elem->element[9] : NULL;
+    if (subcommands != NULL && subcommands->type == REDIS_REPLY_ARRAY &&
+        subcommands->elements > 0) {
+        spec->subcommands = 1;
+    }
 
-        listIter li;
-        listRewind(master->slots, &li);
+    key = sdsnewlen(name->str, name->len);
+    if (key == NULL) {
+        hi_free(spec);
+        return REDIS_ERR;
+    }
+    sdstolower(key);
 
-        while ((lnode = listNext(&li))) {
-            slot = listNodeValue(lnode);
-            if (slot->start > slot->end || slot->end >= REDIS_CLUSTER_SLOTS) {
-                __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                                       "Slot region for node is error");
-                goto error;
-            }
+    /* The first of duplicate names is kept, with its subcommands */
+    if (dictAdd(commands, key, spec) != DICT_OK) {
+        sdsfree(key);
+        hi_free(spec);
+        return REDIS_OK;
+    }
 
-            slot_elem = hiarray_push(slots);
-            if (slot_elem == NULL) {
-                goto oom;
+    if (spec->subcommands) {
+        for (i = 0; i < subcommands->elements; i++) {
+            if (cluster_commands_add(commands, subcommands->element[i]) !=
+                REDIS_OK) {
+                return REDIS_ERR;
             }
-            *slot_elem = slot;
         }
     }
 
-    hiarray_sort(slots, cluster_slot_start_cmp);
-    for (j = 0; j < hiarray_n(slots); j++) {
-        slot_elem = hiarray_get(slots, j);
+    return REDIS_OK;
+}
 
-        for (k = (*slot_elem)->start; k <= (*slot_elem)->end; k++) {
-            if (table[k] != NULL) {
-                __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                                       "Diffent node hold a same slot");
-                goto error;
-            }
+/**
+ * Parse the "command" command reply to a command table.
+ */
+static dict *cluster_parse_commands_reply(redisClusterContext *cc,
+                                          redisReply *reply) {
+    dict *commands;
+    size_t i;
 
-            table[k] = (*slot_elem)->node;
+    if (reply->type != REDIS_REPLY_ARRAY) {
+        if (reply->type == REDIS_REPLY_ERROR) {
+            __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+        } else {
+            __redisClusterSetError(
+                cc, REDIS_ERR_OTHER,
+                "Command(command) reply error: type is not array.");
         }
-    }
 
-    // Move all hiredis contexts in cc->nodes to nodes
-    cluster_nodes_swap_ctx(cc->nodes, nodes);
-    if (cc->nodes != NULL) {
-        dictRelease(cc->nodes);
-        cc->nodes = NULL;
+        return NULL;
     }
-    cc->nodes = nodes;
 
-    if (cc->slots != NULL) {
-        cc->slots->nelem = 0;
-        hiarray_destroy(cc->slots);
-        cc->slots = NULL;
+    commands = dictCreate(&commandKeySpecDictType, NULL);
+    if (commands == NULL) {
+        goto oom;
     }
-    cc->slots = slots;
-
-    memcpy(cc->table, table, REDIS_CLUSTER_SLOTS * sizeof(cluster_node *));
-    cc->route_version++;
-
-    freeReplyObject(reply);
 
-    redisFree(c);
+    for (i = 0; i < reply->elements; i++) {
+        if (cluster_commands_add(commands, reply->element[i]) != REDIS_OK) {
+            goto oom;
+        }
+    }
 
-    return REDIS_OK;
+    return commands;
 
 oom:
+    if (commands != NULL) {
+        dictRelease(commands);
+    }
     __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
-    // passthrough
+    return NULL;
+}
 
-error:
-    if (slots != NULL) {
-        if (slots == cc->slots) {
-            cc->slots = NULL;
-        }
+/* Wrap a parsed command table for installing. */
+static int cluster_commands_install_specs(redisClusterContext *cc,
+                                          dict *specs) {
+    cluster_commands *commands;
 
-        slots->nelem = 0;
-        hiarray_destroy(slots);
-    }
-    if (nodes != NULL) {
-        if (nodes == cc->nodes) {
-            cc->nodes = NULL;
-        }
-        dictRelease(nodes);
+    commands = hi_malloc(sizeof(cluster_commands));
+    if (commands == NULL) {
+        dictRelease(specs);
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
     }
-    freeReplyObject(reply);
-    redisFree(c);
-    return REDIS_ERR;
+    commands->refcount = 1;
+    commands->specs = specs;
+
+    cluster_commands_install(cc, commands);
+    return REDIS_OK;
 }
 
-int cluster_update_route(redisClusterContext *cc) {
-    int ret;
-    int flag_err_not_set = 1;
+/* Fetch the command table from the first known node that can be reached.
+ * The current table is kept on failure. */
+static int cluster_commands_fetch(redisClusterContext *cc) {
+    redisContext *c;
+    redisReply *reply;
     cluster_node *node;
     dictEntry *de;
-
-    if (cc == NULL) {
-        return REDIS_ERR;
-    }
+    dict *commands;
 
     if (cc->nodes == NULL) {
-        __redisClusterSetError(cc, REDIS_ERR_OTHER, "no server address");
         return REDIS_ERR;
     }
 
@@ -1476,29 +4060,70 @@ int cluster_update_route(redisClusterContext *cc) {
 
     while ((de = dictNext(&di)) != NULL) {
         node = dictGetEntryVal(de);
-        if (node == NULL || node->host == NULL || node->port < 0) {
+        if (node->host == NULL || node->port <= 0) {
             continue;
         }
 
-        ret = cluster_update_route_by_addr(cc, node->host, node->port);
-        if (ret == REDIS_OK) {
-            if (cc->err) {
-                cc->err = 0;
-                memset(cc->errstr, '\0', strlen(cc->errstr));
-            }
-            return REDIS_OK;
+        c = cluster_connect_once(cc, node->host, node->port);
+        if (c == NULL) {
+            continue;
         }
 
-        flag_err_not_set = 0;
-    }
+        reply = redisCommand(c, REDIS_COMMAND_COMMAND);
+        if (reply == NULL) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            redisFree(c);
+            continue;
+        }
+        redisFree(c);
 
-    if (flag_err_not_set) {
-        __redisClusterSetError(cc, REDIS_ERR_OTHER, "no valid server address");
+        commands = cluster_parse_commands_reply(cc, reply);
+        freeReplyObject(reply);
+        if (commands == NULL) {
+            return REDIS_ERR;
+        }
+
+        return cluster_commands_install_specs(cc, commands);
     }
 
     return REDIS_ERR;
 }
 
+/* Fetch the command table, when enabled. Without a command table only the
+ * compiled-in commands are known, which is not an error. */
+static void cluster_commands_update(redisClusterContext *cc) {
+    if (!(cc->flags & HIRCLUSTER_FLAG_FETCH_COMMANDS)) {
+        return;
+    }
+
+    if (cluster_commands_fetch(cc) != REDIS_OK) {
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+}
+
+int cluster_update_route(redisClusterContext *cc) {
+    int ret;
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    if (cc->topology != NULL) {
+        ret = cluster_topology_update_route(cc);
+    } else {
+        ret = cluster_update_route_fetch(cc);
+        if (ret == REDIS_OK) {
+            cluster_commands_update(cc);
+        }
+    }
+
+    if (ret == REDIS_OK) {
+        topology_file_save(cc);
+    }
+    return ret;
+}
+
 redisClusterContext *redisClusterContextInit(void) {
     redisClusterContext *cc;
 
@@ -1514,14 +4139,30 @@ redisClusterContext *redisClusterContextInit(void) {
     cc->nodes = NULL;
     cc->slots = NULL;
     cc->max_redirect_count = CLUSTER_DEFAULT_MAX_REDIRECT_COUNT;
+    cc->route_probes = 1;
+    cc->route_quorum = 1;
+    cc->read_preference = HIRCLUSTER_READ_MASTER;
+    cc->read_counter = 0;
+    cc->read_random = ((uint64_t)hi_usec_now() ^ (uintptr_t)cc) | 1;
+    cc->topology_file = NULL;
+    cc->ask_slots = NULL;
+    cc->route_update_interval = CLUSTER_DEFAULT_ROUTE_UPDATE_INTERVAL_USEC;
+    cc->last_route_update = 0LL;
     cc->retry_count = 0;
     cc->requests = NULL;
+    cc->pipeline_nodes = NULL;
+    cc->poll_fds = NULL;
+    cc->poll_ctxs = NULL;
+    cc->poll_size = 0;
     cc->need_update_route = 0;
     cc->update_route_time = 0LL;
 
     cc->route_version = 0LL;
-
-    memset(cc->table, 0, REDIS_CLUSTER_SLOTS * sizeof(cluster_node *));
+    cc->route = NULL;
+    cc->topology = NULL;
+    cc->topology_version = 0LL;
+    cc->commands = NULL;
+    cc->seed_nodes = NULL;
 
     cc->flags |= REDIS_BLOCK;
 
@@ -1548,7 +4189,16 @@ void redisClusterFree(redisClusterContext *cc) {
         cc->command_timeout = NULL;
     }
 
-    memset(cc->table, 0, REDIS_CLUSTER_SLOTS * sizeof(cluster_node *));
+    cluster_route_release(cc->route);
+    cc->route = NULL;
+
+    redisClusterTopologyFree(cc->topology);
+    cc->topology = NULL;
+
+    hi_free(cc->topology_file);
+    cc->topology_file = NULL;
+
+    cluster_ask_cache_free(cc);
 
     if (cc->slots != NULL) {
         cc->slots->nelem = 0;
@@ -1560,10 +4210,19 @@ void redisClusterFree(redisClusterContext *cc) {
         dictRelease(cc->nodes);
     }
 
+    if (cc->seed_nodes != NULL) {
+        dictRelease(cc->seed_nodes);
+    }
+
+    cluster_commands_release(cc->commands);
+
     if (cc->requests != NULL) {
         listRelease(cc->requests);
     }
 
+    hi_free(cc->poll_fds);
+    hi_free(cc->poll_ctxs);
+
     hi_free(cc);
 }
 
@@ -1572,6 +4231,17 @@ void redisClusterFree(redisClusterContext *cc) {
  * When no set of reply functions is given, the default set will be used. */
 static int _redisClusterConnect2(redisClusterContext *cc) {
 
+    /* Use the routing table already fetched by another context */
+    if (cluster_topology_changed(cc)) {
+        return cluster_topology_sync(cc);
+    }
+
+    /* Serve commands from the cached routing table, if any */
+    if (cc->route == NULL && topology_file_load(cc) == REDIS_OK) {
+        cluster_commands_update(cc);
+        return REDIS_OK;
+    }
+
     if (cc->nodes == NULL || dictSize(cc->nodes) == 0) {
         __redisClusterSetError(cc, REDIS_ERR_OTHER,
                                "servers address does not set up");
@@ -1841,35 +4511,175 @@ int redisClusterSetOptionPassword(redisClusterContext *cc,
     return REDIS_OK;
 }
 
-int redisClusterSetOptionParseSlaves(redisClusterContext *cc) {
-
-    if (cc == NULL) {
+int redisClusterSetOptionParseSlaves(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_ADD_SLAVE;
+
+    return REDIS_OK;
+}
+
+int redisClusterSetOptionParseOpenSlots(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_ADD_OPENSLOT;
+
+    return REDIS_OK;
+}
+
+int redisClusterSetOptionRouteUseSlots(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_ROUTE_USE_SLOTS;
+
+    return REDIS_OK;
+}
+
+int redisClusterSetOptionTopologyFile(redisClusterContext *cc,
+                                      const char *path) {
+    char *topology_file;
+
+    if (cc == NULL || path == NULL) {
+        return REDIS_ERR;
+    }
+
+    topology_file = hi_strdup(path);
+    if (topology_file == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+
+    hi_free(cc->topology_file);
+    cc->topology_file = topology_file;
+
+    return REDIS_OK;
+}
+
+int redisClusterSetOptionRouteUseShards(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_ROUTE_USE_SHARDS;
+
+    return REDIS_OK;
+}
+
+/* Collect pipelined replies by polling all node connections, instead of
+ * blocking on one connection at a time. Not available on Windows or with
+ * SSL, where replies are read in turn. */
+int redisClusterSetOptionPipelinePoll(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_PIPELINE_POLL;
+
+    return REDIS_OK;
+}
+
+int redisClusterSetOptionFetchCommands(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_FETCH_COMMANDS;
+
+    return REDIS_OK;
+}
+
+int redisClusterSetOptionUpdateSlotOnMoved(redisClusterContext *cc) {
+
+    if (cc == NULL) {
+        return REDIS_ERR;
+    }
+
+    cc->flags |= HIRCLUSTER_FLAG_UPDATE_SLOT_ON_MOVED;
+
+    return REDIS_OK;
+}
+
+/* Set the minimum time between two route updates triggered by redirects.
+ * Redirects within this interval update the slot lookup table directly
+ * and schedule a route update for when the interval has passed. */
+int redisClusterSetOptionRouteUpdateInterval(redisClusterContext *cc,
+                                             const struct timeval tv) {
+
+    if (cc == NULL || tv.tv_sec < 0 || tv.tv_usec < 0) {
+        return REDIS_ERR;
+    }
+
+    cc->route_update_interval = tv.tv_sec * 1000000LL + tv.tv_usec;
+
+    return REDIS_OK;
+}
+
+/* Set the number of nodes probed concurrently when fetching the routing
+ * table. The first valid routing table received is used. */
+int redisClusterSetOptionRouteProbes(redisClusterContext *cc, int probes) {
+    if (cc == NULL || probes <= 0) {
+        return REDIS_ERR;
+    }
+
+    cc->route_probes = probes;
+
+    return REDIS_OK;
+}
+
+/* Set the number of nodes that must reply with the same routing table
+ * before it is used. */
+int redisClusterSetOptionRouteQuorum(redisClusterContext *cc, int quorum) {
+    if (cc == NULL || quorum <= 0) {
         return REDIS_ERR;
     }
 
-    cc->flags |= HIRCLUSTER_FLAG_ADD_SLAVE;
+    cc->route_quorum = quorum;
 
     return REDIS_OK;
 }
 
-int redisClusterSetOptionParseOpenSlots(redisClusterContext *cc) {
-
-    if (cc == NULL) {
+/* Set where read-only commands are sent: to the master only, preferably to
+ * a replica of the master, or in turn to the master and its replicas.
+ * Replicas are parsed from the routing table when reading from them. */
+int redisClusterSetOptionReadPreference(redisClusterContext *cc,
+                                        int preference) {
+    if (cc == NULL || preference < HIRCLUSTER_READ_MASTER ||
+        preference > HIRCLUSTER_READ_ROUND_ROBIN) {
         return REDIS_ERR;
     }
 
-    cc->flags |= HIRCLUSTER_FLAG_ADD_OPENSLOT;
+    cc->read_preference = preference;
+    if (preference != HIRCLUSTER_READ_MASTER) {
+        cc->flags |= HIRCLUSTER_FLAG_ADD_SLAVE;
+    }
 
     return REDIS_OK;
 }
 
-int redisClusterSetOptionRouteUseSlots(redisClusterContext *cc) {
-
-    if (cc == NULL) {
+/* Attach the context to a routing table shared with other contexts.
+ * The context holds a reference to the topology until it is freed. */
+int redisClusterSetOptionTopology(redisClusterContext *cc,
+                                  redisClusterTopology *topology) {
+    if (cc == NULL || topology == NULL) {
         return REDIS_ERR;
     }
 
-    cc->flags |= HIRCLUSTER_FLAG_ROUTE_USE_SLOTS;
+    hi_atomic_incr(&topology->refcount);
+    redisClusterTopologyFree(cc->topology);
+    cc->topology = topology;
+    cc->topology_version = 0LL;
 
     return REDIS_OK;
 }
@@ -2006,6 +4816,7 @@ redisContext *ctx_get_by_node(redisClusterContext *cc, cluster_node *node) {
             }
 
             authenticate(cc, c); // err and errstr handled in function
+            set_readonly(cc, node, c);
         }
 
         return c;
@@ -2047,7 +4858,8 @@ redisContext *ctx_get_by_node(redisClusterContext *cc, cluster_node *node) {
     }
 #endif
 
-    if (authenticate(cc, c) != REDIS_OK) {
+    if (authenticate(cc, c) != REDIS_OK ||
+        set_readonly(cc, node, c) != REDIS_OK) {
         redisFree(c);
         return NULL;
     }
@@ -2063,11 +4875,115 @@ static cluster_node *node_get_by_table(redisClusterContext *cc,
         return NULL;
     }
 
-    if (slot_num >= REDIS_CLUSTER_SLOTS) {
+    if (slot_num >= REDIS_CLUSTER_SLOTS || cc->route == NULL) {
         return NULL;
     }
 
-    return cc->table[slot_num];
+    return cluster_route_lookup(cc->route, slot_num);
+}
+
+/* Account for a reply received from a node, the given number of usec after
+ * the command was sent. A negative latency means that no reply was received.
+ * The latency is tracked as a moving average where each sample weighs 1/8,
+ * and its mean deviation as a moving average where each sample weighs 1/4.
+ */
+static void cluster_node_reply_received(cluster_node *node, int64_t latency) {
+    int64_t delta;
+
+    if (node->in_flight > 0) {
+        node->in_flight--;
+    }
+
+    if (latency < 0) {
+        return;
+    }
+
+    if (node->latency == 0) {
+        node->latency = latency > 0 ? latency : 1;
+        node->latency_dev = latency / 2;
+    } else {
+        delta = latency - node->latency;
+        node->latency += delta / 8;
+        node->latency_dev += ((delta < 0 ? -delta : delta) -
+                              node->latency_dev) / 4;
+    }
+}
+
+/* The expected cost of sending a command to a node. Nodes without a latency
+ * sample yet are cheap, to get one. */
+static int64_t cluster_node_cost(cluster_node *node) {
+    return node->latency * (node->in_flight + 1);
+}
+
+/* Pseudo-random numbers for the replica selection (xorshift64). */
+static uint64_t cluster_read_random(redisClusterContext *cc) {
+    uint64_t x = cc->read_random;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    cc->read_random = x;
+    return x;
+}
+
+/* Get the node to send a read-only command to, given the master serving its
+ * slot. Depending on the read preference either the master, the cheaper of
+ * two randomly chosen replicas, or the master and its replicas in turn is
+ * picked.
+ */
+static cluster_node *node_get_for_read(redisClusterContext *cc,
+                                       cluster_node *master) {
+    unsigned long replicas, idx, other;
+    cluster_node *node;
+    listNode *ln;
+
+    if (cc->read_preference == HIRCLUSTER_READ_MASTER ||
+        master->slaves == NULL || listLength(master->slaves) == 0) {
+        return master;
+    }
+
+    replicas = listLength(master->slaves);
+    if (cc->read_preference == HIRCLUSTER_READ_ROUND_ROBIN) {
+        idx = cc->read_counter++ % (replicas + 1);
+        if (idx == replicas) {
+            return master;
+        }
+    } else if (replicas == 1) {
+        idx = 0;
+    } else {
+        /* Power of two choices */
+        idx = cluster_read_random(cc) % replicas;
+        other = cluster_read_random(cc) % (replicas - 1);
+        if (other >= idx) {
+            other++;
+        }
+
+        ln = listIndex(master->slaves, (long)idx);
+        node = listNodeValue(ln);
+        ln = listIndex(master->slaves, (long)other);
+        if (cluster_node_cost(listNodeValue(ln)) < cluster_node_cost(node)) {
+            return listNodeValue(ln);
+        }
+        return node;
+    }
+
+    ln = listIndex(master->slaves, (long)idx);
+    return ln ? listNodeValue(ln) : master;
+}
+
+/* Check if a redirect reply points to the given node. A replica answers a
+ * read with a MOVED to its master when it is not in READONLY mode, which
+ * does not mean that the slot has moved.
+ */
+static int redirect_reply_to_node(redisReply *reply, cluster_node *node) {
+    char *addr = reply->str + reply->len;
+
+    while (addr > reply->str && *(addr - 1) != ' ') {
+        addr--;
+    }
+
+    return sdslen(node->addr) == (size_t)(reply->str + reply->len - addr) &&
+           memcmp(node->addr, addr, sdslen(node->addr)) == 0;
 }
 
 static cluster_node *node_get_which_connected(redisClusterContext *cc) {
@@ -2189,6 +5105,59 @@ error:
     return NULL;
 }
 
+/* Append ASKING to the output buffer of a connection, allowing the next
+ * command on the connection to access an importing slot. Both are flushed
+ * in the same write, the reply to ASKING is consumed using
+ * cluster_asking_reply() before the reply to the command. */
+static int cluster_asking(redisClusterContext *cc, redisContext *c) {
+    if (redisAppendFormattedCommand(c, REDIS_PROTOCOL_ASKING,
+                                    strlen(REDIS_PROTOCOL_ASKING)) !=
+        REDIS_OK) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+/* Consume the reply to an ASKING appended by cluster_asking(). When ASKING
+ * is refused the reply to the following command is discarded as well,
+ * keeping the connection in sync. */
+static int cluster_asking_reply(redisClusterContext *cc, redisContext *c) {
+    redisReply *reply;
+
+    if (redisGetReply(c, (void **)&reply) != REDIS_OK) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+        freeReplyObject(reply);
+        if (redisGetReply(c, (void **)&reply) == REDIS_OK) {
+            freeReplyObject(reply);
+        }
+        return REDIS_ERR;
+    }
+
+    freeReplyObject(reply);
+    return REDIS_OK;
+}
+
+/* List a node given pipelined commands. Only the listed nodes are flushed
+ * and polled for replies, until the list is cleared by redisClusterReset().
+ */
+static void cluster_pipeline_node_add(redisClusterContext *cc,
+                                      cluster_node *node) {
+    if (node->in_pipeline) {
+        return;
+    }
+
+    node->in_pipeline = 1;
+    node->pipeline_next = cc->pipeline_nodes;
+    cc->pipeline_nodes = node;
+}
+
 /* Helper function for the redisClusterAppendCommand* family of functions.
  *
  * Write a formatted command to the output buffer. When this family
@@ -2205,6 +5174,27 @@ static int __redisClusterAppendCommand(redisClusterContext *cc,
         return REDIS_ERR;
     }
 
+    /* A key known to be moved by an ongoing slot migration is sent to the
+     * importing node, preceded by ASKING */
+    node = cluster_ask_cache_lookup(cc, command);
+    if (node != NULL) {
+        c = ctx_get_by_node(cc, node);
+        if (c != NULL && c->err == 0) {
+            command->node_addr = sdsnew(node->addr);
+            if (command->node_addr == NULL) {
+                __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+                return REDIS_ERR;
+            }
+            if (cluster_asking(cc, c) != REDIS_OK) {
+                return REDIS_ERR;
+            }
+            command->asking = 1;
+            goto append;
+        }
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+
     node = node_get_by_table(cc, (uint32_t)command->slot_num);
     if (node == NULL) {
         __redisClusterSetError(cc, REDIS_ERR_OTHER, "node get by slot error");
@@ -2219,11 +5209,206 @@ static int __redisClusterAppendCommand(redisClusterContext *cc,
         return REDIS_ERR;
     }
 
+append:
     if (redisAppendFormattedCommand(c, command->cmd, command->clen) !=
         REDIS_OK) {
         __redisClusterSetError(cc, c->err, c->errstr);
         return REDIS_ERR;
     }
+    cluster_pipeline_node_add(cc, node);
+
+    return REDIS_OK;
+}
+
+#ifndef _WIN32
+/*
+ * Polled reply collection.
+ *
+ * Instead of blocking on one node connection at a time, all connections with
+ * outstanding commands are polled while waiting for a reply. Pending commands
+ * are written, and received data is parsed into the hiredis reader of each
+ * connection as soon as its socket is ready. Replies from fast nodes then
+ * don't wait in the socket buffers while a slow node is read, and are still
+ * taken from the readers in the order they are requested.
+ */
+
+static int cluster_poll_is_usable(redisClusterContext *cc) {
+#ifdef SSL_SUPPORT
+    /* Data buffered by the TLS layer is not visible to poll() */
+    if (cc->ssl != NULL) {
+        return 0;
+    }
+#else
+    (void)cc;
+#endif
+    return 1;
+}
+
+/* Make room for polling n connections. The space is kept for reuse. */
+static int cluster_poll_reserve(redisClusterContext *cc, unsigned long n) {
+    struct pollfd *fds;
+    redisContext **ctxs;
+
+    if (n <= cc->poll_size) {
+        return REDIS_OK;
+    }
+
+    fds = hi_realloc(cc->poll_fds, n * sizeof(*fds));
+    if (fds == NULL) {
+        goto oom;
+    }
+    cc->poll_fds = fds;
+
+    ctxs = hi_realloc(cc->poll_ctxs, n * sizeof(*ctxs));
+    if (ctxs == NULL) {
+        goto oom;
+    }
+    cc->poll_ctxs = ctxs;
+    cc->poll_size = n;
+
+    return REDIS_OK;
+
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    return REDIS_ERR;
+}
+
+/* Get the next reply from connection c, which is one of the 'width'
+ * connections in cc->poll_ctxs. */
+static int cluster_poll_reply(redisClusterContext *cc, redisContext *c,
+                              unsigned long width, void **reply) {
+    struct pollfd *pfds = cc->poll_fds;
+    redisContext **ctxs = cc->poll_ctxs;
+    unsigned long i;
+    int64_t deadline = 0, left;
+    int timeout = -1, wdone, n;
+
+    /* A connection that failed while polling for another reply has no
+     * reply left to wait for */
+    if (c->err) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
+
+    if (redisGetReplyFromReader(c, reply) != REDIS_OK) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
+
+    /* The timeout bounds the whole wait, also when other connections are
+     * active meanwhile */
+    if (cc->command_timeout != NULL) {
+        deadline = hi_usec_now() + cc->command_timeout->tv_sec * 1000000LL +
+                   cc->command_timeout->tv_usec;
+    }
+
+    while (*reply == NULL) {
+        if (c->err) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            return REDIS_ERR;
+        }
+
+        if (deadline != 0) {
+            left = deadline - hi_usec_now();
+            if (left <= 0) {
+                __redisClusterSetError(cc, REDIS_ERR_TIMEOUT,
+                                       "reply error(socket timeout)");
+                return REDIS_ERR;
+            }
+            timeout = (int)((left + 999) / 1000);
+        }
+
+        for (i = 0; i < width; i++) {
+            pfds[i].fd = -1; /* Ignored by poll() */
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+            if (ctxs[i]->err == 0) {
+                pfds[i].fd = ctxs[i]->fd;
+                if (sdslen(ctxs[i]->obuf) > 0) {
+                    pfds[i].events |= POLLOUT;
+                }
+            }
+        }
+
+        n = poll(pfds, width, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            __redisClusterSetError(cc, REDIS_ERR_IO, strerror(errno));
+            return REDIS_ERR;
+        }
+        if (n == 0) {
+            __redisClusterSetError(cc, REDIS_ERR_TIMEOUT,
+                                   "reply error(socket timeout)");
+            return REDIS_ERR;
+        }
+
+        /* Errors on other connections are left to be found when their
+         * replies are requested */
+        for (i = 0; i < width; i++) {
+            if ((pfds[i].revents & POLLOUT) &&
+                redisBufferWrite(ctxs[i], &wdone) != REDIS_OK &&
+                ctxs[i] == c) {
+                __redisClusterSetError(cc, c->err, c->errstr);
+                return REDIS_ERR;
+            }
+            if ((pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                redisBufferRead(ctxs[i]) != REDIS_OK && ctxs[i] == c) {
+                __redisClusterSetError(cc, c->err, c->errstr);
+                return REDIS_ERR;
+            }
+        }
+
+        if (redisGetReplyFromReader(c, reply) != REDIS_OK) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            return REDIS_ERR;
+        }
+    }
+
+    return REDIS_OK;
+}
+
+/* Get a pipelined reply from connection c, polling the connections of all
+ * nodes given pipelined commands. */
+static int cluster_pipeline_poll_reply(redisClusterContext *cc,
+                                       redisContext *c, void **reply) {
+    cluster_node *node;
+    unsigned long width = 1;
+
+    for (node = cc->pipeline_nodes; node != NULL; node = node->pipeline_next) {
+        width++;
+    }
+    if (cluster_poll_reserve(cc, width) != REDIS_OK) {
+        return REDIS_ERR;
+    }
+
+    cc->poll_ctxs[0] = c;
+    width = 1;
+    for (node = cc->pipeline_nodes; node != NULL; node = node->pipeline_next) {
+        if (node->con != NULL && node->con != c) {
+            cc->poll_ctxs[width++] = node->con;
+        }
+    }
+
+    return cluster_poll_reply(cc, c, width, reply);
+}
+#endif /* _WIN32 */
+
+/* Get the next reply from a connection with pipelined commands. */
+static int cluster_pipeline_get_reply(redisClusterContext *cc,
+                                      redisContext *c, void **reply) {
+#ifndef _WIN32
+    if ((cc->flags & HIRCLUSTER_FLAG_PIPELINE_POLL) &&
+        cluster_poll_is_usable(cc)) {
+        return cluster_pipeline_poll_reply(cc, c, reply);
+    }
+#endif
+
+    if (redisGetReply(c, reply) != REDIS_OK) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
 
     return REDIS_OK;
 }
@@ -2252,135 +5437,330 @@ static int __redisClusterGetReplyFromNode(redisClusterContext *cc,
         return REDIS_ERR;
     }
 
-    if (redisGetReply(c, reply) != REDIS_OK) {
-        __redisClusterSetError(cc, c->err, c->errstr);
-        return REDIS_ERR;
+    if (cluster_pipeline_get_reply(cc, c, reply) != REDIS_OK) {
+        return REDIS_ERR;
+    }
+
+    if (cluster_reply_error_type(*reply) == CLUSTER_ERR_MOVED)
+        cc->need_update_route = 1;
+
+    return REDIS_OK;
+}
+
+static int __redisClusterGetReply(redisClusterContext *cc, int slot_num,
+                                  void **reply) {
+    cluster_node *node;
+
+    if (cc == NULL || slot_num < 0 || reply == NULL)
+        return REDIS_ERR;
+
+    node = node_get_by_table(cc, (uint32_t)slot_num);
+    if (node == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "slot not served by any node");
+        return REDIS_ERR;
+    }
+
+    return __redisClusterGetReplyFromNode(cc, node, reply);
+}
+
+/* Get the reply to a command sent with ASKING to the importing node of a
+ * migrating slot. */
+static int __redisClusterGetReplyAsking(redisClusterContext *cc,
+                                        struct cmd *command, void **reply) {
+    dictEntry *de;
+    cluster_node *node;
+
+    de = dictFind(cc->nodes, command->node_addr);
+    if (de == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "command was sent to a now unknown node");
+        return REDIS_ERR;
+    }
+    node = dictGetEntryVal(de);
+
+    if (node->con != NULL && node->con->err == 0 &&
+        cluster_asking_reply(cc, node->con) != REDIS_OK) {
+        return REDIS_ERR;
+    }
+
+    return __redisClusterGetReplyFromNode(cc, node, reply);
+}
+
+/* Get the node given as target in a MOVED or ASK error reply,
+ * e.g. "MOVED 3999 127.0.0.1:6381". A node with an unknown address is
+ * created and added to the known nodes. The slot given in the reply is
+ * returned via slot_num when it's not NULL.
+ */
+static cluster_node *node_get_by_redirect_reply(redisClusterContext *cc,
+                                                redisReply *reply,
+                                                int *slot_num) {
+    char *p, *end, *addr, *port;
+    int slot, port_num, error_type;
+    dictEntry *de;
+    cluster_node *node = NULL;
+    sds key = NULL;
+
+    if (cc == NULL || reply == NULL) {
+        return NULL;
+    }
+
+    error_type = cluster_reply_error_type(reply);
+    if (error_type != CLUSTER_ERR_MOVED && error_type != CLUSTER_ERR_ASK) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "reply is not a redirect error!");
+        return NULL;
+    }
+
+    /* Locate the slot and the address part: "<error> <slot> <ip>:<port>" */
+    end = reply->str + reply->len;
+    p = memchr(reply->str, ' ', reply->len);
+    if (p == NULL) {
+        goto parse_error;
+    }
+    p++;
+    addr = memchr(p, ' ', end - p);
+    if (addr == NULL) {
+        goto parse_error;
+    }
+
+    slot = hi_atoi(p, (addr - p));
+    if (slot < 0 || slot >= REDIS_CLUSTER_SLOTS) {
+        goto parse_error;
+    }
+    addr++;
+
+    /* Find the last separator, an IPv6 address contains separators */
+    for (port = end - 1; port > addr && *port != IP_PORT_SEPARATOR; port--)
+        ;
+    port_num = hi_atoi(port + 1, (end - port - 1));
+    if (port == addr || port_num <= 0) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "redirect reply address part parse error!");
+        return NULL;
+    }
+
+    key = sdsnewlen(addr, end - addr);
+    if (key == NULL) {
+        goto oom;
+    }
+
+    de = dictFind(cc->nodes, key);
+    if (de != NULL) {
+        sdsfree(key);
+        node = dictGetEntryVal(de);
+        goto done;
+    }
+
+    node = hi_malloc(sizeof(cluster_node));
+    if (node == NULL) {
+        goto oom;
+    }
+
+    cluster_node_init(node);
+    node->role = REDIS_ROLE_MASTER;
+    node->port = port_num;
+    node->addr = sdsnewlen(addr, end - addr);
+    node->host = sdsnewlen(addr, port - addr);
+    if (node->addr == NULL || node->host == NULL) {
+        goto oom;
     }
 
-    if (cluster_reply_error_type(*reply) == CLUSTER_ERR_MOVED)
-        cc->need_update_route = 1;
+    if (dictAdd(cc->nodes, key, node) != DICT_OK) {
+        goto oom;
+    }
 
-    return REDIS_OK;
+done:
+    if (slot_num != NULL) {
+        *slot_num = slot;
+    }
+    return node;
+
+parse_error:
+    __redisClusterSetError(cc, REDIS_ERR_OTHER, "redirect reply parse error!");
+    return NULL;
+
+oom:
+    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    sdsfree(key);
+    if (node != NULL) {
+        cluster_node_deinit(node);
+        hi_free(node);
+    }
+    return NULL;
 }
 
-static int __redisClusterGetReply(redisClusterContext *cc, int slot_num,
-                                  void **reply) {
-    cluster_node *node;
+/* Route update coordinator.
+ *
+ * All route updates triggered by redirects pass through here to avoid a
+ * storm of updates when a failover or resharding hits many outstanding
+ * commands. At most one route update is started per route update interval,
+ * other callers are served by the already updated lookup table or get an
+ * update scheduled for when the interval has passed. Async callers also
+ * subscribe to an ongoing non-blocking update by parking their command.
+ */
 
-    if (cc == NULL || slot_num < 0 || reply == NULL)
-        return REDIS_ERR;
+/* Check if a new route update may be started, and if so mark it started. */
+static int cluster_route_update_start(redisClusterContext *cc) {
+    int64_t now = hi_usec_now();
 
-    node = node_get_by_table(cc, (uint32_t)slot_num);
-    if (node == NULL) {
-        __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                               "slot not served by any node");
-        return REDIS_ERR;
+    if (cc->last_route_update != 0 &&
+        now - cc->last_route_update < cc->route_update_interval) {
+        return 0;
     }
 
-    return __redisClusterGetReplyFromNode(cc, node, reply);
+    cc->last_route_update = now;
+    return 1;
 }
 
-static cluster_node *node_get_by_ask_error_reply(redisClusterContext *cc,
-                                                 redisReply *reply) {
-    sds *part = NULL, *ip_port = NULL;
-    int part_len = 0, ip_port_len = 0, ret;
-    dictEntry *de;
-    cluster_node *node = NULL;
-
-    if (cc == NULL || reply == NULL) {
-        return NULL;
+/* Schedule a route update for when the route update interval has passed. */
+static void cluster_route_update_schedule(redisClusterContext *cc) {
+    if (cc->update_route_time == 0) {
+        cc->update_route_time = hi_usec_now() + cc->route_update_interval;
     }
+}
 
-    if (cluster_reply_error_type(reply) != CLUSTER_ERR_ASK) {
-        __redisClusterSetError(cc, REDIS_ERR_OTHER, "reply is not ask error!");
-        return NULL;
-    }
+/* Update the slot lookup table using the target given in a MOVED reply,
+ * instead of fetching the full routing table. A full route update is
+ * scheduled to be done lazily, at most once per route update interval.
+ * Returns the node now serving the slot.
+ */
+static cluster_node *cluster_update_slot_by_moved_reply(redisClusterContext *cc,
+                                                        redisReply *reply) {
+    cluster_node *node;
+    int slot_num;
 
-    part = sdssplitlen(reply->str, reply->len, " ", 1, &part_len);
-    if (part == NULL) {
-        goto oom;
+    node = node_get_by_redirect_reply(cc, reply, &slot_num);
+    if (node == NULL) {
+        return NULL;
     }
 
-    if (part_len == 3) {
-        ip_port = sdssplitlen(part[2], sdslen(part[2]), ":", 1, &ip_port_len);
-        if (ip_port == NULL) {
-            goto oom;
+    if (node_get_by_table(cc, (uint32_t)slot_num) != node) {
+        if (cluster_route_set_slot(cc, (uint32_t)slot_num, node) != REDIS_OK) {
+            __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+            return NULL;
+        }
+        cc->route_version++;
+
+        if (cc->topology != NULL &&
+            cluster_topology_publish_slot(cc, (uint32_t)slot_num, node) !=
+                REDIS_OK) {
+            /* Only other contexts miss the update */
+            cc->err = 0;
+            memset(cc->errstr, '\0', strlen(cc->errstr));
         }
+    }
 
-        if (ip_port_len == 2) {
-            de = dictFind(cc->nodes, part[2]);
-            if (de == NULL) {
-                node = hi_malloc(sizeof(cluster_node));
-                if (node == NULL) {
-                    goto oom;
-                }
+    cluster_route_update_schedule(cc);
 
-                cluster_node_init(node);
-                node->addr = part[1];
-                node->host = ip_port[0];
-                node->port = hi_atoi(ip_port[1], sdslen(ip_port[1]));
-                node->role = REDIS_ROLE_MASTER;
+    return node;
+}
 
-                sds key = sdsnewlen(node->addr, sdslen(node->addr));
-                if (key == NULL) {
-                    goto oom;
-                }
+/* Decide how to handle a MOVED reply to a command that was sent using the
+ * lookup table of the given route version. The routing table is only fetched
+ * when the lookup table is unchanged since the command was sent and no route
+ * update was started within the route update interval. Otherwise the slot is
+ * updated from the MOVED reply, unless the table already is newer.
+ */
+static int cluster_route_update_on_moved(redisClusterContext *cc,
+                                         redisReply *reply,
+                                         uint64_t route_version) {
+    if (cc->route_version != route_version) {
+        return ROUTE_UPDATE_NONE;
+    }
 
-                ret = dictAdd(cc->nodes, key, node);
-                if (ret != DICT_OK) {
-                    sdsfree(key);
-                    goto oom;
-                }
+    if (!(cc->flags & HIRCLUSTER_FLAG_UPDATE_SLOT_ON_MOVED) &&
+        cluster_route_update_start(cc)) {
+        return ROUTE_UPDATE_FETCH;
+    }
 
-                part[1] = NULL;
-                ip_port[0] = NULL;
-            } else {
-                node = de->val;
-                goto done;
-            }
-        } else {
-            __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                                   "ask error reply address part parse error!");
+    if (cluster_update_slot_by_moved_reply(cc, reply) == NULL) {
+        return ROUTE_UPDATE_ERROR;
+    }
 
-            goto done;
-        }
+    return ROUTE_UPDATE_NONE;
+}
 
-    } else {
-        __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                               "ask error reply parse error!");
+/* Check if a scheduled route update is due. */
+static int cluster_route_update_is_due(redisClusterContext *cc) {
+    return cc->update_route_time != 0 &&
+           hi_usec_now() >= cc->update_route_time;
+}
 
-        goto done;
+/* Perform a scheduled route update when it is due. A failing update is
+ * rescheduled, meanwhile the current lookup table is used.
+ */
+static void cluster_update_route_when_due(redisClusterContext *cc) {
+    if (!cluster_route_update_is_due(cc)) {
+        return;
     }
 
-done:
-    sdsfreesplitres(part, part_len);
-    sdsfreesplitres(ip_port, ip_port_len);
-    return node;
-
-oom:
-    __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
-    sdsfreesplitres(part, part_len);
-    sdsfreesplitres(ip_port, ip_port_len);
-    return NULL;
+    cc->last_route_update = hi_usec_now();
+    if (cluster_update_route(cc) != REDIS_OK) {
+        cc->update_route_time = hi_usec_now() + cc->route_update_interval;
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
 }
 
 static void *redis_cluster_command_execute(redisClusterContext *cc,
                                            struct cmd *command) {
     int ret;
     void *reply = NULL;
-    cluster_node *node;
+    cluster_node *node, *master;
     redisContext *c = NULL;
     int error_type;
+    int use_master = 0;
+    int asking = 0;
+    uint64_t route_version;
+    int64_t sent_time;
 
 retry:
 
-    node = node_get_by_table(cc, (uint32_t)command->slot_num);
-    if (node == NULL) {
+    route_version = cc->route_version;
+
+    master = node_get_by_table(cc, (uint32_t)command->slot_num);
+    if (master == NULL) {
         __redisClusterSetError(cc, REDIS_ERR_OTHER, "node get by table error");
         return NULL;
     }
 
+    /* A key known to be moved by an ongoing slot migration */
+    node = cluster_ask_cache_lookup(cc, command);
+    if (node != NULL) {
+        c = ctx_get_by_node(cc, node);
+        if (c != NULL && c->err == 0) {
+            if (cluster_asking(cc, c) != REDIS_OK) {
+                return NULL;
+            }
+            asking = 1;
+            goto ask_retry;
+        }
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+
+    node = master;
+    if (command->readonly && !use_master) {
+        node = node_get_for_read(cc, master);
+    }
+
     c = ctx_get_by_node(cc, node);
+    if (node != master && (c == NULL || c->err)) {
+        /* Read from the master when the replica is unreachable */
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+        use_master = 1;
+        goto retry;
+    }
+
+    /* The nodes read from the topology cache file can be gone, like after
+     * a redeploy. The route is then fetched, asking the seed nodes. */
+    if ((c == NULL || c->err) && cc->seed_nodes != NULL &&
+        cluster_update_route(cc) == REDIS_OK) {
+        goto retry;
+    }
+
     if (c == NULL) {
         return NULL;
     } else if (c->err) {
@@ -2415,7 +5795,18 @@ ask_retry:
         return NULL;
     }
 
+    node->in_flight++;
+    sent_time = hi_usec_now();
+    if (asking) {
+        /* ASKING was sent in the same write, its reply comes first */
+        asking = 0;
+        if (cluster_asking_reply(cc, c) != REDIS_OK) {
+            cluster_node_reply_received(node, -1);
+            return NULL;
+        }
+    }
     reply = __redisBlockForReply(c);
+    cluster_node_reply_received(node, reply ? hi_usec_now() - sent_time : -1);
     if (reply == NULL) {
         __redisClusterSetError(cc, c->err, c->errstr);
         return NULL;
@@ -2433,8 +5824,27 @@ ask_retry:
 
         switch (error_type) {
         case CLUSTER_ERR_MOVED:
+            cluster_ask_cache_forget(cc, command->slot_num);
+            if (node->role == REDIS_ROLE_SLAVE) {
+                /* Retry on the master, which still serves the slot
+                 * unless the MOVED points elsewhere */
+                use_master = 1;
+                if (redirect_reply_to_node(reply, master)) {
+                    freeReplyObject(reply);
+                    reply = NULL;
+                    goto retry;
+                }
+            }
+
+            ret = cluster_route_update_on_moved(cc, reply, route_version);
             freeReplyObject(reply);
             reply = NULL;
+            if (ret == ROUTE_UPDATE_ERROR) {
+                return NULL;
+            } else if (ret == ROUTE_UPDATE_NONE) {
+                goto retry;
+            }
+
             ret = cluster_update_route(cc);
             if (ret != REDIS_OK) {
                 __redisClusterSetError(
@@ -2447,7 +5857,7 @@ ask_retry:
 
             break;
         case CLUSTER_ERR_ASK:
-            node = node_get_by_ask_error_reply(cc, reply);
+            node = node_get_by_redirect_reply(cc, reply, NULL);
             if (node == NULL) {
                 freeReplyObject(reply);
                 return NULL;
@@ -2456,6 +5866,8 @@ ask_retry:
             freeReplyObject(reply);
             reply = NULL;
 
+            cluster_ask_cache_add(cc, command, node);
+
             c = ctx_get_by_node(cc, node);
             if (c == NULL) {
                 return NULL;
@@ -2464,14 +5876,10 @@ ask_retry:
                 return NULL;
             }
 
-            reply = redisCommand(c, REDIS_COMMAND_ASKING);
-            if (reply == NULL) {
-                __redisClusterSetError(cc, c->err, c->errstr);
+            if (cluster_asking(cc, c) != REDIS_OK) {
                 return NULL;
             }
-
-            freeReplyObject(reply);
-            reply = NULL;
+            asking = 1;
 
             goto ask_retry;
 
@@ -2493,6 +5901,218 @@ ask_retry:
     return reply;
 }
 
+/* Close the connections with unread fragment replies, which can't be used
+ * before the replies are read. */
+static void cluster_fragments_abort(hilist *commands) {
+    struct cmd *sub_command;
+    listNode *list_node;
+
+    listIter li;
+    listRewind(commands, &li);
+    while ((list_node = listNext(&li)) != NULL) {
+        sub_command = list_node->value;
+        if (sub_command->node == NULL) {
+            continue;
+        }
+
+        cluster_node_reply_received(sub_command->node, -1);
+        redisFree(sub_command->node->con);
+        sub_command->node->con = NULL;
+        sub_command->node = NULL;
+    }
+}
+
+/* Get the reply to a fragment from connection c. When polling, the other
+ * connections with fragments are read as well while waiting. */
+static int cluster_fragment_get_reply(redisClusterContext *cc,
+                                      redisContext *c, unsigned long width,
+                                      void **reply) {
+#ifndef _WIN32
+    if (width > 1) {
+        return cluster_poll_reply(cc, c, width, reply);
+    }
+#else
+    (void)width;
+#endif
+
+    if (redisGetReply(c, reply) != REDIS_OK) {
+        __redisClusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+/* Execute the fragments of a multi-key command. All fragments are sent to
+ * their nodes before any reply is read, so the command takes about one round
+ * trip to the slowest node instead of one round trip per fragment. The replies
+ * are stored in the fragments. A fragment that could not be sent, or that got
+ * a cluster error like a redirect, is then executed on its own. */
+static int cluster_fragments_execute(redisClusterContext *cc,
+                                     hilist *commands) {
+    struct cmd *sub_command;
+    cluster_node *node, *master;
+    redisContext *c;
+    listNode *list_node;
+    redisReply *reply;
+    unsigned long width = 0, i;
+    uint64_t route_version = cc->route_version;
+    int64_t sent_time;
+    int error_type, wdone, ret, polled = 0;
+
+#ifndef _WIN32
+    polled = cluster_poll_is_usable(cc);
+    if (polled &&
+        cluster_poll_reserve(cc, listLength(commands)) != REDIS_OK) {
+        return REDIS_ERR;
+    }
+#endif
+
+    listIter li;
+    listRewind(commands, &li);
+    while ((list_node = listNext(&li)) != NULL) {
+        sub_command = list_node->value;
+
+        master = node_get_by_table(cc, (uint32_t)sub_command->slot_num);
+        if (master == NULL) {
+            continue;
+        }
+
+        node = cluster_ask_cache_lookup(cc, sub_command);
+        if (node != NULL) {
+            sub_command->asking = 1;
+        } else if (sub_command->readonly) {
+            node = node_get_for_read(cc, master);
+        } else {
+            node = master;
+        }
+
+        c = ctx_get_by_node(cc, node);
+        if (c == NULL || c->err) {
+            /* Left to be executed on its own */
+            cc->err = 0;
+            memset(cc->errstr, '\0', strlen(cc->errstr));
+            sub_command->asking = 0;
+            continue;
+        }
+
+        sub_command->node = node;
+        node->in_flight++;
+        if (sub_command->asking && cluster_asking(cc, c) != REDIS_OK) {
+            goto error;
+        }
+        if (redisAppendFormattedCommand(c, sub_command->cmd,
+                                        sub_command->clen) != REDIS_OK) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            goto error;
+        }
+        do {
+            if (redisBufferWrite(c, &wdone) != REDIS_OK) {
+                __redisClusterSetError(cc, c->err, c->errstr);
+                goto error;
+            }
+        } while (!wdone);
+
+        if (polled) {
+            /* Poll each connection once */
+            i = 0;
+            while (i < width && cc->poll_ctxs[i] != c) {
+                i++;
+            }
+            if (i == width) {
+                cc->poll_ctxs[width++] = c;
+            }
+        }
+    }
+    sent_time = hi_usec_now();
+
+    /* Collect the replies in order */
+    listRewind(commands, &li);
+    while ((list_node = listNext(&li)) != NULL) {
+        sub_command = list_node->value;
+        node = sub_command->node;
+        if (node == NULL) {
+            continue;
+        }
+
+        c = node->con;
+        if (sub_command->asking) {
+            sub_command->asking = 0;
+            if (cluster_asking_reply(cc, c) != REDIS_OK) {
+                goto error;
+            }
+        }
+        if (cluster_fragment_get_reply(cc, c, width, (void **)&reply) !=
+            REDIS_OK) {
+            goto error;
+        }
+
+        cluster_node_reply_received(node, hi_usec_now() - sent_time);
+        sub_command->node = NULL;
+        sub_command->reply = reply;
+    }
+
+    /* Execute the remaining fragments one by one, a redirect is followed
+     * using the ASK cache or an updated lookup table */
+    listRewind(commands, &li);
+    while ((list_node = listNext(&li)) != NULL) {
+        sub_command = list_node->value;
+        reply = sub_command->reply;
+        if (reply != NULL) {
+            error_type = cluster_reply_error_type(reply);
+            if (error_type <= CLUSTER_NOT_ERR ||
+                error_type >= CLUSTER_ERR_SENTINEL) {
+                continue;
+            }
+
+            if (error_type == CLUSTER_ERR_ASK) {
+                node = node_get_by_redirect_reply(cc, reply, NULL);
+                if (node == NULL) {
+                    return REDIS_ERR;
+                }
+                cluster_ask_cache_add(cc, sub_command, node);
+            } else if (error_type == CLUSTER_ERR_MOVED) {
+                cluster_ask_cache_forget(cc, sub_command->slot_num);
+                master = node_get_by_table(cc, (uint32_t)sub_command->slot_num);
+                if (sub_command->readonly && master != NULL &&
+                    redirect_reply_to_node(reply, master)) {
+                    /* A replica redirecting to its master, which still
+                     * serves the slot. Retry on the master, as for a
+                     * single command. */
+                    sub_command->readonly = 0;
+                } else {
+                    ret = cluster_route_update_on_moved(cc, reply,
+                                                        route_version);
+                    if (ret == ROUTE_UPDATE_ERROR) {
+                        return REDIS_ERR;
+                    } else if (ret == ROUTE_UPDATE_FETCH &&
+                               cluster_update_route(cc) != REDIS_OK) {
+                        __redisClusterSetError(
+                            cc, REDIS_ERR_OTHER,
+                            "route update error, please recreate "
+                            "redisClusterContext!");
+                        return REDIS_ERR;
+                    }
+                }
+            }
+
+            freeReplyObject(reply);
+            sub_command->reply = NULL;
+        }
+
+        sub_command->reply = redis_cluster_command_execute(cc, sub_command);
+        if (sub_command->reply == NULL) {
+            return REDIS_ERR;
+        }
+    }
+
+    return REDIS_OK;
+
+error:
+    cluster_fragments_abort(commands);
+    return REDIS_ERR;
+}
+
 static int command_pre_fragment(redisClusterContext *cc, struct cmd *command,
                                 hilist *commands) {
 
@@ -2767,6 +6387,7 @@ static int command_pre_fragment(redisClusterContext *cc, struct cmd *command,
         }
 
         sub_command->type = command->type;
+        sub_command->readonly = command->readonly;
 
         if (listAddNodeTail(commands, sub_command) == NULL) {
             goto oom;
@@ -2918,26 +6539,47 @@ oom:
     return NULL;
 }
 
-/*
- * Split the command into subcommands by slot
- *
- * Returns slot_num
- * If slot_num < 0 or slot_num >=  REDIS_CLUSTER_SLOTS means this function runs
- * error; Otherwise if  the commands > 1 , slot_num is the last subcommand slot
- * number.
+/* The arguments a command was formatted from by redisFormatCommandArgv() */
+struct cmd_args {
+    int argc;
+    const char **argv;
+    const size_t *argvlen;
+};
+
+/* Classify a command using the arguments it was formatted from when given,
+ * which avoids scanning the formatted command, otherwise by parsing it. A
+ * command missing from the compiled-in table is looked up in the command
+ * table, when fetched. */
+static void command_parse(redisClusterContext *cc, struct cmd *command,
+                          const struct cmd_args *args) {
+    if (args != NULL) {
+        redis_parse_cmd_argv(command, args->argc, args->argv, args->argvlen);
+    } else {
+        redis_parse_cmd(command);
+    }
+
+    if (command->result == CMD_PARSE_ERROR && command->type == CMD_UNKNOWN &&
+        cc->commands != NULL) {
+        redis_parse_cmd_key_spec(command, cc->commands->specs);
+
+        /* The error of the first attempt no longer applies */
+        if (command->result == CMD_PARSE_OK) {
+            hi_free(command->errstr);
+            command->errstr = NULL;
+        }
+    }
+}
+
+/*
+ * Split a parsed command into subcommands by slot, see
+ * command_format_by_slot().
  */
-static int command_format_by_slot(redisClusterContext *cc, struct cmd *command,
-                                  hilist *commands) {
+static int command_split_by_slot(redisClusterContext *cc, struct cmd *command,
+                                 hilist *commands) {
     struct keypos *kp;
     int key_count;
     int slot_num = -1;
 
-    if (cc == NULL || commands == NULL || command == NULL ||
-        command->cmd == NULL || command->clen <= 0) {
-        goto done;
-    }
-
-    redis_parse_cmd(command);
     if (command->result == CMD_PARSE_ENOMEM) {
         __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
         goto done;
@@ -2968,6 +6610,26 @@ done:
     return slot_num;
 }
 
+/*
+ * Split the command into subcommands by slot
+ *
+ * Returns slot_num
+ * If slot_num < 0 or slot_num >=  REDIS_CLUSTER_SLOTS means this function runs
+ * error; Otherwise if  the commands > 1 , slot_num is the last subcommand slot
+ * number.
+ */
+static int command_format_by_slot(redisClusterContext *cc, struct cmd *command,
+                                  const struct cmd_args *args,
+                                  hilist *commands) {
+    if (cc == NULL || commands == NULL || command == NULL ||
+        command->cmd == NULL || command->clen <= 0) {
+        return -1;
+    }
+
+    command_parse(cc, command, args);
+    return command_split_by_slot(cc, command, commands);
+}
+
 /* Deprecated function, replaced with redisClusterSetOptionMaxRedirect() */
 void redisClusterSetMaxRedirect(redisClusterContext *cc,
                                 int max_redirect_count) {
@@ -2978,10 +6640,83 @@ void redisClusterSetMaxRedirect(redisClusterContext *cc,
     cc->max_redirect_count = max_redirect_count;
 }
 
-void *redisClusterFormattedCommand(redisClusterContext *cc, char *cmd,
-                                   int len) {
+/* Get the number of arguments of a formatted command, or -1. */
+static int command_argc(const char *cmd, int len) {
+    int i, argc = 0;
+
+    if (len < 4 || cmd[0] != '*') {
+        return -1;
+    }
+
+    for (i = 1; i < len && cmd[i] >= '0' && cmd[i] <= '9'; i++) {
+        if (argc > (INT_MAX - 9) / 10) {
+            return -1;
+        }
+        argc = argc * 10 + (cmd[i] - '0');
+    }
+
+    return i > 1 && i < len && cmd[i] == '\r' ? argc : -1;
+}
+
+/* Parse a command into a command and key array on the stack, which saves
+ * the allocations of the general path for single-key commands. A command
+ * with more arguments than the array can hold keys is not parsed and 0 is
+ * returned. */
+static int command_parse_on_stack(redisClusterContext *cc,
+                                  struct cmd *command, struct hiarray *keys,
+                                  struct keypos *keys_elem, char *cmd, int len,
+                                  const struct cmd_args *args) {
+    int argc;
+
+    /* Each key is an argument after the command name, so the keys always
+     * fit and the array is never reallocated */
+    argc = args != NULL ? args->argc : command_argc(cmd, len);
+    if (argc < 2 || argc - 1 > CLUSTER_STACK_KEYS) {
+        return 0;
+    }
+
+    command_init(command);
+    hiarray_set(keys, keys_elem, sizeof(struct keypos), CLUSTER_STACK_KEYS);
+    command->keys = keys;
+    command->cmd = cmd;
+    command->clen = len;
+
+    command_parse(cc, command, args);
+    return 1;
+}
+
+/* Move a command parsed on the stack to a command from command_get(), for
+ * the general path, copying its keys to the key array of the command. */
+static int command_move_from_stack(struct cmd *command, struct cmd *parsed) {
+    struct hiarray *keys = command->keys;
+    struct keypos *kp;
+    uint32_t i;
+
+    *command = *parsed;
+    command->keys = keys;
+    parsed->errstr = NULL;
+
+    for (i = 0; i < hiarray_n(parsed->keys); i++) {
+        kp = hiarray_push(keys);
+        if (kp == NULL) {
+            return REDIS_ERR;
+        }
+        *kp = *(struct keypos *)hiarray_get(parsed->keys, i);
+    }
+
+    return REDIS_OK;
+}
+
+/* Execute a formatted command, classified using the arguments it was
+ * formatted from when args is not NULL. */
+static void *redis_cluster_formatted_command(redisClusterContext *cc,
+                                             char *cmd, int len,
+                                             const struct cmd_args *args) {
+    struct keypos keys_elem[CLUSTER_STACK_KEYS], *kp;
+    struct hiarray keys;
+    struct cmd stack_command;
     redisReply *reply = NULL;
-    int slot_num;
+    int slot_num, parsed;
     struct cmd *command = NULL, *sub_command;
     hilist *commands = NULL;
     listNode *list_node;
@@ -2995,13 +6730,43 @@ void *redisClusterFormattedCommand(redisClusterContext *cc, char *cmd,
         memset(cc->errstr, '\0', strlen(cc->errstr));
     }
 
+    /* Not while pipelining, outstanding replies are read using the table */
+    if (cc->requests == NULL || listLength(cc->requests) == 0) {
+        cluster_topology_sync_when_changed(cc);
+        cluster_update_route_when_due(cc);
+    }
+
+    parsed = command_parse_on_stack(cc, &stack_command, &keys, keys_elem, cmd,
+                                    len, args);
+    if (parsed && stack_command.result == CMD_PARSE_OK &&
+        hiarray_n(&keys) == 1) {
+        kp = hiarray_get(&keys, 0);
+        stack_command.slot_num = keyHashSlot(kp->start, kp->end - kp->start);
+
+        reply = redis_cluster_command_execute(cc, &stack_command);
+        hi_free(stack_command.errstr);
+
+        cc->retry_count = 0;
+        return reply;
+    }
+
+    /* Other commands take the general path, without parsing them again */
     command = command_get();
     if (command == NULL) {
+        if (parsed) {
+            hi_free(stack_command.errstr);
+        }
         goto oom;
     }
 
-    command->cmd = cmd;
-    command->clen = len;
+    if (parsed) {
+        if (command_move_from_stack(command, &stack_command) != REDIS_OK) {
+            goto oom;
+        }
+    } else {
+        command->cmd = cmd;
+        command->clen = len;
+    }
 
     commands = listCreate();
     if (commands == NULL) {
@@ -3010,7 +6775,11 @@ void *redisClusterFormattedCommand(redisClusterContext *cc, char *cmd,
 
     commands->free = listCommandFree;
 
-    slot_num = command_format_by_slot(cc, command, commands);
+    if (parsed) {
+        slot_num = command_split_by_slot(cc, command, commands);
+    } else {
+        slot_num = command_format_by_slot(cc, command, args, commands);
+    }
 
     if (slot_num < 0) {
         goto error;
@@ -3027,20 +6796,22 @@ void *redisClusterFormattedCommand(redisClusterContext *cc, char *cmd,
 
     ASSERT(listLength(commands) != 1);
 
+    if (cluster_fragments_execute(cc, commands) != REDIS_OK) {
+        goto error;
+    }
+
+    /* An error reply to a fragment is the reply to the command */
     listIter li;
     listRewind(commands, &li);
 
     while ((list_node = listNext(&li)) != NULL) {
         sub_command = list_node->value;
 
-        reply = redis_cluster_command_execute(cc, sub_command);
-        if (reply == NULL) {
-            goto error;
-        } else if (reply->type == REDIS_REPLY_ERROR) {
+        if (sub_command->reply->type == REDIS_REPLY_ERROR) {
+            reply = sub_command->reply;
+            sub_command->reply = NULL;
             goto done;
         }
-
-        sub_command->reply = reply;
     }
 
     reply = command_post_fragment(cc, command, commands);
@@ -3073,6 +6844,11 @@ error:
     return NULL;
 }
 
+void *redisClusterFormattedCommand(redisClusterContext *cc, char *cmd,
+                                   int len) {
+    return redis_cluster_formatted_command(cc, cmd, len, NULL);
+}
+
 void *redisClustervCommand(redisClusterContext *cc, const char *format,
                            va_list ap) {
     redisReply *reply;
@@ -3146,6 +6922,7 @@ void *redisClusterCommandToNode(redisClusterContext *cc, cluster_node *node,
 
 void *redisClusterCommandArgv(redisClusterContext *cc, int argc,
                               const char **argv, const size_t *argvlen) {
+    struct cmd_args args = {argc, argv, argvlen};
     redisReply *reply = NULL;
     char *cmd;
     int len;
@@ -3156,15 +6933,20 @@ void *redisClusterCommandArgv(redisClusterContext *cc, int argc,
         return NULL;
     }
 
-    reply = redisClusterFormattedCommand(cc, cmd, len);
+    reply = redis_cluster_formatted_command(cc, cmd, len, &args);
 
     hi_free(cmd);
 
     return reply;
 }
 
-int redisClusterAppendFormattedCommand(redisClusterContext *cc, char *cmd,
-                                       int len) {
+/* Append a formatted command, taking ownership of cmd. The command is kept
+ * in the request list until its reply is read, allowing it to be re-issued
+ * when redirected. It is classified using the arguments it was formatted
+ * from when args is not NULL. */
+static int __redisClusterAppendFormattedCommand(redisClusterContext *cc,
+                                                char *cmd, int len,
+                                                const struct cmd_args *args) {
     int slot_num;
     struct cmd *command = NULL, *sub_command;
     hilist *commands = NULL;
@@ -3173,6 +6955,7 @@ int redisClusterAppendFormattedCommand(redisClusterContext *cc, char *cmd,
     if (cc->requests == NULL) {
         cc->requests = listCreate();
         if (cc->requests == NULL) {
+            hi_free(cmd);
             goto oom;
         }
         cc->requests->free = listCommandFree;
@@ -3180,6 +6963,7 @@ int redisClusterAppendFormattedCommand(redisClusterContext *cc, char *cmd,
 
     command = command_get();
     if (command == NULL) {
+        hi_free(cmd);
         goto oom;
     }
 
@@ -3193,7 +6977,7 @@ int redisClusterAppendFormattedCommand(redisClusterContext *cc, char *cmd,
 
     commands->free = listCommandFree;
 
-    slot_num = command_format_by_slot(cc, command, commands);
+    slot_num = command_format_by_slot(cc, command, args, commands);
 
     if (slot_num < 0) {
         goto error;
@@ -3230,7 +7014,6 @@ int redisClusterAppendFormattedCommand(redisClusterContext *cc, char *cmd,
         listRelease(commands);
     }
     commands = NULL;
-    command->cmd = NULL;
 
     if (listAddNodeTail(cc->requests, command) == NULL) {
         goto oom;
@@ -3242,10 +7025,7 @@ oom:
     // passthrough
 
 error:
-    if (command != NULL) {
-        command->cmd = NULL;
-        command_destroy(command);
-    }
+    command_destroy(command);
     if (commands != NULL) {
         listRelease(commands);
     }
@@ -3256,9 +7036,22 @@ error:
     return REDIS_ERR;
 }
 
+int redisClusterAppendFormattedCommand(redisClusterContext *cc, char *cmd,
+                                       int len) {
+    char *copy;
+
+    copy = hi_malloc(len);
+    if (copy == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+    memcpy(copy, cmd, len);
+
+    return __redisClusterAppendFormattedCommand(cc, copy, len, NULL);
+}
+
 int redisClustervAppendCommand(redisClusterContext *cc, const char *format,
                                va_list ap) {
-    int ret;
     char *cmd;
     int len;
 
@@ -3271,11 +7064,7 @@ int redisClustervAppendCommand(redisClusterContext *cc, const char *format,
         return REDIS_ERR;
     }
 
-    ret = redisClusterAppendFormattedCommand(cc, cmd, len);
-
-    hi_free(cmd);
-
-    return ret;
+    return __redisClusterAppendFormattedCommand(cc, cmd, len, NULL);
 }
 
 int redisClusterAppendCommand(redisClusterContext *cc, const char *format,
@@ -3337,6 +7126,7 @@ int redisClusterAppendCommandToNode(redisClusterContext *cc, cluster_node *node,
         hi_free(cmd);
         return REDIS_ERR;
     }
+    cluster_pipeline_node_add(cc, node);
 
     // Keep the command in the outstanding request list
     command = command_get();
@@ -3363,7 +7153,7 @@ oom:
 
 int redisClusterAppendCommandArgv(redisClusterContext *cc, int argc,
                                   const char **argv, const size_t *argvlen) {
-    int ret;
+    struct cmd_args args = {argc, argv, argvlen};
     char *cmd;
     int len;
 
@@ -3373,34 +7163,22 @@ int redisClusterAppendCommandArgv(redisClusterContext *cc, int argc,
         return REDIS_ERR;
     }
 
-    ret = redisClusterAppendFormattedCommand(cc, cmd, len);
-
-    hi_free(cmd);
-
-    return ret;
+    return __redisClusterAppendFormattedCommand(cc, cmd, len, &args);
 }
 
 static int redisClusterSendAll(redisClusterContext *cc) {
-    dictEntry *de;
     struct cluster_node *node;
     redisContext *c = NULL;
     int wdone = 0;
 
-    if (cc == NULL || cc->nodes == NULL) {
+    if (cc == NULL) {
         return REDIS_ERR;
     }
 
-    dictIterator di;
-    dictInitIterator(&di, cc->nodes);
-
-    while ((de = dictNext(&di)) != NULL) {
-        node = dictGetEntryVal(de);
-        if (node == NULL) {
-            continue;
-        }
-
-        c = ctx_get_by_node(cc, node);
-        if (c == NULL) {
+    /* Only nodes given pipelined commands can have pending output */
+    for (node = cc->pipeline_nodes; node != NULL; node = node->pipeline_next) {
+        c = node->con;
+        if (c == NULL || c->err) {
             continue;
         }
 
@@ -3456,12 +7234,180 @@ static int redisClusterClearAll(redisClusterContext *cc) {
     return REDIS_OK;
 }
 
+/* Get the node a pipelined command was sent to. */
+static cluster_node *pipeline_command_node(redisClusterContext *cc,
+                                           struct cmd *command) {
+    dictEntry *de;
+
+    if (command->node_addr != NULL) {
+        de = dictFind(cc->nodes, command->node_addr);
+        return de != NULL ? dictGetEntryVal(de) : NULL;
+    } else if (command->slot_num >= 0) {
+        return node_get_by_table(cc, (uint32_t)command->slot_num);
+    }
+
+    return NULL;
+}
+
+/* Get the reply to a pipelined command, unless it was already read ahead. */
+static int pipeline_command_reply(redisClusterContext *cc, struct cmd *command,
+                                  void **reply) {
+    cluster_node *node;
+
+    if (command->reply != NULL) {
+        *reply = command->reply;
+        command->reply = NULL;
+        return REDIS_OK;
+    }
+
+    if (command->asking) {
+        /* Command was sent to the importing node of a migrating slot */
+        return __redisClusterGetReplyAsking(cc, command, reply);
+    } else if (command->slot_num >= 0) {
+        /* Command was sent via single slot */
+        return __redisClusterGetReply(cc, command->slot_num, reply);
+    }
+
+    /* Command was sent to a single node */
+    node = pipeline_command_node(cc, command);
+    if (node == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               "command was sent to a now unknown node");
+        return REDIS_ERR;
+    }
+
+    return __redisClusterGetReplyFromNode(cc, node, reply);
+}
+
+static int pipeline_read_ahead_command(redisClusterContext *cc,
+                                       cluster_node *node,
+                                       struct cmd *command) {
+    if (command->reply != NULL || pipeline_command_node(cc, command) != node) {
+        return REDIS_OK;
+    }
+
+    return pipeline_command_reply(cc, command, (void **)&command->reply);
+}
+
+/* Read the replies to all later pipelined commands that were sent to a node,
+ * i.e. the sub commands after list_sub_command in the first request and the
+ * commands in the following requests. A command re-issued to the node gets
+ * its reply after these, which are kept until they are requested. */
+static int pipeline_read_ahead(redisClusterContext *cc, cluster_node *node,
+                               listNode *list_sub_command) {
+    listNode *ln, *sub_ln;
+    struct cmd *command;
+
+    for (sub_ln = list_sub_command ? listNextNode(list_sub_command) : NULL;
+         sub_ln != NULL; sub_ln = listNextNode(sub_ln)) {
+        if (pipeline_read_ahead_command(cc, node, sub_ln->value) !=
+            REDIS_OK) {
+            return REDIS_ERR;
+        }
+    }
+
+    for (ln = listNextNode(listFirst(cc->requests)); ln != NULL;
+         ln = listNextNode(ln)) {
+        command = ln->value;
+        if (command->sub_commands == NULL) {
+            if (pipeline_read_ahead_command(cc, node, command) != REDIS_OK) {
+                return REDIS_ERR;
+            }
+            continue;
+        }
+
+        for (sub_ln = listFirst(command->sub_commands); sub_ln != NULL;
+             sub_ln = listNextNode(sub_ln)) {
+            if (pipeline_read_ahead_command(cc, node, sub_ln->value) !=
+                REDIS_OK) {
+                return REDIS_ERR;
+            }
+        }
+    }
+
+    return REDIS_OK;
+}
+
+/* Re-issue a pipelined command that got a MOVED or ASK reply to the node
+ * given in the reply, and get the new reply. The routing table is updated
+ * first in redisClusterReset(), since the queued commands were routed using
+ * the current one. The redirect is kept as reply when max_redirect_count is
+ * reached. */
+static int pipeline_redirect(redisClusterContext *cc, struct cmd *command,
+                             listNode *list_sub_command, void **reply) {
+    cluster_node *node;
+    redisContext *c;
+    int error_type;
+    int redirects = 0;
+
+    while (1) {
+        error_type = cluster_reply_error_type(*reply);
+        if (error_type != CLUSTER_ERR_MOVED && error_type != CLUSTER_ERR_ASK) {
+            return REDIS_OK;
+        }
+        if (redirects++ >= cc->max_redirect_count) {
+            return REDIS_OK;
+        }
+
+        node = node_get_by_redirect_reply(cc, *reply, NULL);
+        if (node == NULL) {
+            goto error;
+        }
+
+        if (error_type == CLUSTER_ERR_MOVED) {
+            cc->need_update_route = 1;
+            cluster_ask_cache_forget(cc, command->slot_num);
+        } else {
+            cluster_ask_cache_add(cc, command, node);
+        }
+
+        c = ctx_get_by_node(cc, node);
+        if (c == NULL) {
+            goto error;
+        } else if (c->err) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            goto error;
+        }
+
+        if (pipeline_read_ahead(cc, node, list_sub_command) != REDIS_OK) {
+            goto error;
+        }
+
+        freeReplyObject(*reply);
+        *reply = NULL;
+
+        if (error_type == CLUSTER_ERR_ASK &&
+            cluster_asking(cc, c) != REDIS_OK) {
+            return REDIS_ERR;
+        }
+        if (redisAppendFormattedCommand(c, command->cmd, command->clen) !=
+            REDIS_OK) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            return REDIS_ERR;
+        }
+        if (error_type == CLUSTER_ERR_ASK &&
+            cluster_asking_reply(cc, c) != REDIS_OK) {
+            return REDIS_ERR;
+        }
+        if (redisGetReply(c, reply) != REDIS_OK) {
+            __redisClusterSetError(cc, c->err, c->errstr);
+            return REDIS_ERR;
+        }
+    }
+
+error:
+    freeReplyObject(*reply);
+    *reply = NULL;
+    return REDIS_ERR;
+}
+
 int redisClusterGetReply(redisClusterContext *cc, void **reply) {
 
     struct cmd *command, *sub_command;
     hilist *commands = NULL;
     listNode *list_command, *list_sub_command;
     int slot_num;
+    int ret;
     void *sub_reply;
 
     if (cc == NULL || reply == NULL)
@@ -3490,26 +7436,15 @@ int redisClusterGetReply(redisClusterContext *cc, void **reply) {
         goto error;
     }
 
-    slot_num = command->slot_num;
-    if (slot_num >= 0) {
-        /* Command was sent via single slot */
-        listDelNode(cc->requests, list_command);
-        return __redisClusterGetReply(cc, slot_num, reply);
-
-    } else if (command->node_addr) {
-        /* Command was sent to a single node */
-        dictEntry *de;
-
-        de = dictFind(cc->nodes, command->node_addr);
-        if (de != NULL) {
-            listDelNode(cc->requests, list_command);
-            return __redisClusterGetReplyFromNode(cc, dictGetEntryVal(de),
-                                                  reply);
-        } else {
-            __redisClusterSetError(cc, REDIS_ERR_OTHER,
-                                   "command was sent to a now unknown node");
-            goto error;
+    if (command->slot_num >= 0 || command->node_addr) {
+        /* Command was sent to a single node, a command sent via single
+         * slot is re-issued when redirected */
+        ret = pipeline_command_reply(cc, command, reply);
+        if (ret == REDIS_OK && command->slot_num >= 0) {
+            ret = pipeline_redirect(cc, command, NULL, reply);
         }
+        listDelNode(cc->requests, list_command);
+        return ret;
     }
 
     commands = command->sub_commands;
@@ -3538,7 +7473,11 @@ int redisClusterGetReply(redisClusterContext *cc, void **reply) {
             goto error;
         }
 
-        if (__redisClusterGetReply(cc, slot_num, &sub_reply) != REDIS_OK) {
+        if (pipeline_command_reply(cc, sub_command, &sub_reply) != REDIS_OK) {
+            goto error;
+        }
+        if (pipeline_redirect(cc, sub_command, list_sub_command, &sub_reply) !=
+            REDIS_OK) {
             goto error;
         }
 
@@ -3587,8 +7526,16 @@ void redisClusterReset(redisClusterContext *cc) {
         listRelease(cc->requests);
         cc->requests = NULL;
     }
+    cluster_pipeline_nodes_clear(cc);
 
     if (cc->need_update_route) {
+        /* Let the next command perform the update when rate limited */
+        if (!cluster_route_update_start(cc)) {
+            cluster_route_update_schedule(cc);
+            cc->need_update_route = 0;
+            return;
+        }
+
         status = cluster_update_route(cc);
         if (status != REDIS_OK) {
             __redisClusterSetError(
@@ -3642,37 +7589,114 @@ redisClusterAsyncInitialize(redisClusterContext *cc) {
 
     acc->adapter = NULL;
     acc->attach_fn = NULL;
+    acc->timer_fn = NULL;
+    acc->timer = NULL;
+    acc->timer_time = 0;
 
     acc->onConnect = NULL;
     acc->onDisconnect = NULL;
 
+    acc->route_ac = NULL;
+    acc->route_update_attempt = 0;
+    acc->route_addrs = NULL;
+    acc->route_addrs_count = 0;
+    acc->parked = NULL;
+    memset(acc->parked_slots, 0, sizeof(acc->parked_slots));
+
+    acc->hedge_delay = 0;
+    acc->hedge_budget = 0;
+    acc->hedge_tokens = 0;
+    acc->hedges = NULL;
+
+    acc->pool = NULL;
+    acc->pool_size = 0;
+
     return acc;
 }
 
+/* Set the fields of new or reused request state, except its command. */
+static void cluster_async_data_init(cluster_async_data *cad) {
+    cad->acc = NULL;
+    cad->callback = NULL;
+    cad->privdata = NULL;
+    cad->retry_count = 0;
+    cad->route_version = 0;
+    cad->sent_time = 0;
+    cad->node = NULL;
+    cad->fragments = NULL;
+    cad->hedge_time = 0;
+    cad->hedge_ln = NULL;
+    cad->hedge = NULL;
+    cad->hedge_of = NULL;
+    cad->answered = 0;
+    cad->next = NULL;
+}
+
 static cluster_async_data *cluster_async_data_get(void) {
     cluster_async_data *cad;
 
-    cad = hi_malloc(sizeof(cluster_async_data));
-    if (cad == NULL) {
-        return NULL;
+    cad = hi_malloc(sizeof(cluster_async_data));
+    if (cad == NULL) {
+        return NULL;
+    }
+
+    cluster_async_data_init(cad);
+    cad->command = NULL;
+
+    return cad;
+}
+
+/* Take request state from the pool of the context, or NULL when the pool is
+ * empty. Its command, if any, is emptied and ready to be reused. */
+static cluster_async_data *
+cluster_async_pool_get(redisClusterAsyncContext *acc) {
+    cluster_async_data *cad = acc->pool;
+
+    if (cad != NULL) {
+        acc->pool = cad->next;
+        acc->pool_size--;
+        cad->next = NULL;
     }
 
-    cad->acc = NULL;
-    cad->command = NULL;
-    cad->callback = NULL;
-    cad->privdata = NULL;
-    cad->retry_count = 0;
-
     return cad;
 }
 
 static void cluster_async_data_free(cluster_async_data *cad) {
+    redisClusterAsyncContext *acc;
+
     if (cad == NULL) {
         return;
     }
 
-    command_destroy(cad->command);
+    if (cad->hedge_ln != NULL) {
+        listDelNode(cad->acc->hedges, cad->hedge_ln);
+    }
+    if (cad->hedge != NULL) {
+        cad->hedge->hedge_of = NULL;
+    }
+    if (cad->hedge_of != NULL) {
+        cad->hedge_of->hedge = NULL;
+    }
+
+    /* A fragment is owned by the command it is part of */
+    if (cad->fragments != NULL) {
+        cad->command = NULL;
+    }
+
+    /* Keep the request state and its command for the next command */
+    acc = cad->acc;
+    if (acc != NULL && acc->pool_size < CLUSTER_ASYNC_POOL_SIZE) {
+        if (cad->command != NULL) {
+            command_reset(cad->command);
+        }
+        cluster_async_data_init(cad);
+        cad->next = acc->pool;
+        acc->pool = cad;
+        acc->pool_size++;
+        return;
+    }
 
+    command_destroy(cad->command);
     hi_free(cad);
 }
 
@@ -3685,33 +7709,24 @@ static void unlinkAsyncContextAndNode(void *data) {
     }
 }
 
-redisAsyncContext *actx_get_by_node(redisClusterAsyncContext *acc,
-                                    cluster_node *node) {
+/* Create an asynchronous connection that is authenticated when needed
+ * and attached to the event library when an adapter is given. The connect
+ * and command timeouts, when given, need an adapter with timer support and
+ * fail the connection with its pending callbacks when they expire.
+ */
+static redisAsyncContext *actx_connect(redisClusterAsyncContext *acc,
+                                       const char *host, int port,
+                                       const struct timeval *connect_timeout,
+                                       const struct timeval *command_timeout) {
     redisAsyncContext *ac;
+    redisOptions options = {0};
     int ret;
 
-    if (node == NULL) {
-        return NULL;
-    }
-
-    ac = node->acon;
-    if (ac != NULL) {
-        if (ac->c.err == 0) {
-            return ac;
-        } else {
-            NOT_REACHED();
-        }
-    }
-
-    // No async context exists, perform a connect
-
-    if (node->host == NULL || node->port <= 0) {
-        __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
-                                    "node host or port is error");
-        return NULL;
-    }
+    REDIS_OPTIONS_SET_TCP(&options, host, port);
+    options.connect_timeout = connect_timeout;
+    options.command_timeout = command_timeout;
 
-    ac = redisAsyncConnect(node->host, node->port);
+    ac = redisAsyncConnectWithOptions(&options);
     if (ac == NULL) {
         __redisClusterAsyncSetError(acc, REDIS_ERR_OOM, "Out of memory");
         return NULL;
@@ -3754,6 +7769,50 @@ redisAsyncContext *actx_get_by_node(redisClusterAsyncContext *acc,
         }
     }
 
+    return ac;
+}
+
+redisAsyncContext *actx_get_by_node(redisClusterAsyncContext *acc,
+                                    cluster_node *node) {
+    redisAsyncContext *ac;
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    ac = node->acon;
+    if (ac != NULL) {
+        if (ac->c.err == 0) {
+            return ac;
+        } else {
+            NOT_REACHED();
+        }
+    }
+
+    // No async context exists, perform a connect
+
+    if (node->host == NULL || node->port <= 0) {
+        __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
+                                    "node host or port is error");
+        return NULL;
+    }
+
+    ac = actx_connect(acc, node->host, node->port, NULL, NULL);
+    if (ac == NULL) {
+        /* Specific error already set */
+        return NULL;
+    }
+
+    // Enable reads on replicas
+    if (node->role == REDIS_ROLE_SLAVE) {
+        if (redisAsyncCommand(ac, NULL, NULL, REDIS_COMMAND_READONLY) !=
+            REDIS_OK) {
+            __redisClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+            redisAsyncFree(ac);
+            return NULL;
+        }
+    }
+
     if (acc->onConnect) {
         redisAsyncSetConnectCallback(ac, acc->onConnect);
     }
@@ -3769,48 +7828,336 @@ redisAsyncContext *actx_get_by_node(redisClusterAsyncContext *acc,
     return ac;
 }
 
-static redisAsyncContext *
-actx_get_after_update_route_by_slot(redisClusterAsyncContext *acc,
-                                    int slot_num) {
-    int ret;
+static void redisClusterAsyncRetryCallback(redisAsyncContext *ac, void *r,
+                                           void *privdata);
+
+/* Send a command using the current lookup table, and count it as in flight
+ * on the node until its reply is received. */
+static int cluster_async_send(redisAsyncContext *ac, cluster_async_data *cad) {
+    cluster_node *node = ac->data;
+
+    cad->route_version = cad->acc->cc->route_version;
+    if (redisAsyncFormattedCommand(ac, redisClusterAsyncRetryCallback, cad,
+                                   cad->command->cmd,
+                                   cad->command->clen) != REDIS_OK) {
+        return REDIS_ERR;
+    }
+
+    cad->sent_time = hi_usec_now();
+    cad->node = node;
+    if (node != NULL) {
+        node->in_flight++;
+    }
+    return REDIS_OK;
+}
+
+/* Park a command until the ongoing route update is done. */
+static int cluster_async_park_command(redisClusterAsyncContext *acc,
+                                      cluster_async_data *cad) {
+    int slot_num = cad->command->slot_num;
+
+    if (acc->parked == NULL) {
+        acc->parked = listCreate();
+        if (acc->parked == NULL) {
+            goto oom;
+        }
+    }
+
+    if (listAddNodeTail(acc->parked, cad) == NULL) {
+        goto oom;
+    }
+
+    acc->parked_slots[slot_num >> 3] |= 1 << (slot_num & 7);
+
+    return REDIS_OK;
+
+oom:
+    __redisClusterAsyncSetError(acc, REDIS_ERR_OOM, "Out of memory");
+    return REDIS_ERR;
+}
+
+/* Check if commands to a slot are parked, awaiting a route update. */
+static int cluster_async_slot_is_parked(redisClusterAsyncContext *acc,
+                                        int slot_num) {
+    return acc->route_ac != NULL &&
+           (acc->parked_slots[slot_num >> 3] & (1 << (slot_num & 7)));
+}
+
+/* Resend, or fail when resend is not possible, the parked commands in
+ * the order they were parked. */
+static void cluster_async_replay_parked(redisClusterAsyncContext *acc,
+                                        int resend) {
+    hilist *parked;
+    listNode *ln;
+    cluster_async_data *cad;
+    cluster_node *node;
+    redisAsyncContext *ac;
+
+    parked = acc->parked;
+    if (parked == NULL) {
+        return;
+    }
+
+    /* Commands parked during the replay will await the next route update */
+    acc->parked = NULL;
+    memset(acc->parked_slots, 0, sizeof(acc->parked_slots));
+
+    while ((ln = listFirst(parked)) != NULL) {
+        cad = listNodeValue(ln);
+        listDelNode(parked, ln);
+
+        if (cad->answered) {
+            cluster_async_data_free(cad);
+            continue;
+        }
+
+        if (!resend) {
+            goto error;
+        }
+
+        node = node_get_by_table(acc->cc, (uint32_t)cad->command->slot_num);
+        if (node == NULL) {
+            __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
+                                        "node get by table error");
+            goto error;
+        }
+
+        ac = actx_get_by_node(acc, node);
+        if (ac == NULL) {
+            /* Specific error already set */
+            goto error;
+        } else if (ac->err) {
+            __redisClusterAsyncSetError(acc, ac->err, ac->errstr);
+            goto error;
+        }
+
+        if (cluster_async_send(ac, cad) == REDIS_OK) {
+            continue;
+        }
+        __redisClusterAsyncSetError(acc, ac->err, ac->errstr);
+
+    error:
+        cad->callback(acc, NULL, cad->privdata);
+        cluster_async_data_free(cad);
+    }
+
+    if (acc->err) {
+        acc->err = 0;
+        memset(acc->errstr, '\0', strlen(acc->errstr));
+    }
+
+    listRelease(parked);
+}
+
+static int cluster_async_update_route(redisClusterAsyncContext *acc);
+
+/* End a round of asking the known nodes for the route. */
+static void cluster_async_route_addrs_free(redisClusterAsyncContext *acc) {
+    int i;
+
+    for (i = 0; i < acc->route_addrs_count; i++) {
+        sdsfree(acc->route_addrs[i]);
+    }
+    hi_free(acc->route_addrs);
+    acc->route_addrs = NULL;
+    acc->route_addrs_count = 0;
+    acc->route_update_attempt = 0;
+}
+
+/* Start a round of asking the known nodes for the route, in turn. The
+ * addresses are copied since the nodes can change between the attempts. */
+static int cluster_async_route_addrs_init(redisClusterAsyncContext *acc) {
+    redisClusterContext *cc = acc->cc;
+    dictEntry *de;
+
+    if (cc->nodes == NULL || dictSize(cc->nodes) == 0) {
+        return REDIS_OK;
+    }
+
+    acc->route_addrs = hi_calloc(dictSize(cc->nodes), sizeof(sds));
+    if (acc->route_addrs == NULL) {
+        goto oom;
+    }
+
+    dictIterator di;
+    dictInitIterator(&di, cc->nodes);
+
+    while ((de = dictNext(&di)) != NULL) {
+        acc->route_addrs[acc->route_addrs_count] = sdsdup(dictGetEntryKey(de));
+        if (acc->route_addrs[acc->route_addrs_count] == NULL) {
+            goto oom;
+        }
+        acc->route_addrs_count++;
+    }
+
+    return REDIS_OK;
+
+oom:
+    cluster_async_route_addrs_free(acc);
+    __redisClusterAsyncSetError(acc, REDIS_ERR_OOM, "Out of memory");
+    return REDIS_ERR;
+}
+
+/* Install the command table sent ahead of the routing table on the route
+ * update connection. Failures keep the current table. */
+static void clusterCommandsReplyCallback(redisAsyncContext *ac, void *r,
+                                         void *privdata) {
+    redisClusterAsyncContext *acc = privdata;
+    redisClusterContext *cc;
+    redisReply *reply = r;
+    dict *commands;
+
+    /* Ignore replies to an abandoned route update, the lost connection is
+     * handled by the route reply callback */
+    if (acc == NULL || acc->route_ac != ac || reply == NULL) {
+        return;
+    }
+
+    cc = acc->cc;
+    commands = cluster_parse_commands_reply(cc, reply);
+    if (commands == NULL ||
+        cluster_commands_install_specs(cc, commands) != REDIS_OK) {
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+}
+
+static void clusterRouteReplyCallback(redisAsyncContext *ac, void *r,
+                                      void *privdata) {
+    redisClusterAsyncContext *acc = privdata;
     redisClusterContext *cc;
+    redisReply *reply = r;
+
+    /* Ignore replies to an abandoned route update */
+    if (acc == NULL || acc->route_ac != ac) {
+        return;
+    }
+
+    acc->route_ac = NULL;
+    cc = acc->cc;
+
+    if (reply == NULL) {
+        __redisClusterSetError(cc, REDIS_ERR_OTHER,
+                               ac->err ? ac->errstr
+                                       : "route update connection lost");
+    } else {
+        /* The connection is only used for a single route update */
+        redisAsyncDisconnect(ac);
+
+        if (cluster_update_route_by_reply(cc, reply) == REDIS_OK) {
+            topology_file_save(cc);
+            if (cc->topology != NULL &&
+                cluster_topology_publish(cc) != REDIS_OK) {
+                /* Only other contexts miss the update */
+                cc->err = 0;
+                memset(cc->errstr, '\0', strlen(cc->errstr));
+            }
+            cluster_async_route_addrs_free(acc);
+            if (cc->err) {
+                cc->err = 0;
+                memset(cc->errstr, '\0', strlen(cc->errstr));
+            }
+
+            cluster_async_replay_parked(acc, 1);
+            return;
+        }
+    }
+
+    /* Ask the next known node */
+    cluster_async_update_route(acc);
+}
+
+/* Start a non-blocking route update using a separate connection, unless an
+ * update already is in progress. Each known node is asked in turn until a
+ * valid routing table is received. The parked commands are resent when the
+ * new routing table is installed.
+ */
+static int cluster_async_update_route(redisClusterAsyncContext *acc) {
+    redisClusterContext *cc = acc->cc;
     redisAsyncContext *ac;
     cluster_node *node;
+    dictEntry *de;
+    int ret;
 
-    if (acc == NULL || slot_num < 0) {
-        return NULL;
+    if (acc->route_ac != NULL) {
+        return REDIS_OK;
     }
 
-    cc = acc->cc;
-    if (cc == NULL) {
-        return NULL;
+    /* Another context sharing the topology already updated the route */
+    if (cluster_topology_changed(cc) && cluster_topology_sync(cc) == REDIS_OK) {
+        cluster_async_route_addrs_free(acc);
+        cluster_async_replay_parked(acc, 1);
+        return REDIS_OK;
     }
 
-    ret = cluster_update_route(cc);
-    if (ret != REDIS_OK) {
-        __redisClusterAsyncSetError(
-            acc, REDIS_ERR_OTHER,
-            "route update error, please recreate redisClusterContext!");
-        return NULL;
+    /* Without an event library only a blocking update is possible */
+    if (acc->adapter == NULL) {
+        if (cluster_update_route(cc) != REDIS_OK) {
+            __redisClusterAsyncSetError(
+                acc, REDIS_ERR_OTHER,
+                "route update error, please recreate redisClusterContext!");
+            cluster_async_replay_parked(acc, 0);
+            return REDIS_ERR;
+        }
+
+        cluster_async_replay_parked(acc, 1);
+        return REDIS_OK;
     }
 
-    node = node_get_by_table(cc, (uint32_t)slot_num);
-    if (node == NULL) {
-        __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
-                                    "node get by table error");
-        return NULL;
+    if (acc->route_update_attempt == 0 && acc->route_addrs == NULL &&
+        cluster_async_route_addrs_init(acc) != REDIS_OK) {
+        cluster_async_replay_parked(acc, 0);
+        return REDIS_ERR;
     }
 
-    ac = actx_get_by_node(acc, node);
-    if (ac == NULL) {
-        /* Specific error already set */
-        return NULL;
-    } else if (ac->err) {
-        __redisClusterAsyncSetError(acc, ac->err, ac->errstr);
-        return NULL;
+    while (cc->nodes != NULL &&
+           acc->route_update_attempt < acc->route_addrs_count) {
+        de = dictFind(cc->nodes,
+                      acc->route_addrs[acc->route_update_attempt++]);
+        if (de == NULL) {
+            continue; /* No longer known */
+        }
+        node = dictGetEntryVal(de);
+        if (node->host == NULL || node->port <= 0) {
+            continue;
+        }
+
+        /* An unresponsive node is given up after the configured timeouts,
+         * like in a blocking route update */
+        ac = actx_connect(acc, node->host, node->port, cc->connect_timeout,
+                          cc->command_timeout);
+        if (ac == NULL) {
+            continue;
+        }
+
+        if (cc->flags & HIRCLUSTER_FLAG_FETCH_COMMANDS) {
+            ret = redisAsyncCommand(ac, clusterCommandsReplyCallback, acc,
+                                    REDIS_COMMAND_COMMAND);
+            if (ret != REDIS_OK) {
+                __redisClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+                redisAsyncFree(ac);
+                continue;
+            }
+        }
+
+        ret = redisAsyncCommand(ac, clusterRouteReplyCallback, acc,
+                                cluster_route_command(cc));
+        if (ret != REDIS_OK) {
+            __redisClusterAsyncSetError(acc, ac->c.err, ac->c.errstr);
+            redisAsyncFree(ac);
+            continue;
+        }
+
+        acc->route_ac = ac;
+        return REDIS_OK;
     }
 
-    return ac;
+    cluster_async_route_addrs_free(acc);
+    __redisClusterAsyncSetError(
+        acc, REDIS_ERR_OTHER,
+        "route update error, please recreate redisClusterContext!");
+    cluster_async_replay_parked(acc, 0);
+    return REDIS_ERR;
 }
 
 redisClusterAsyncContext *redisClusterAsyncContextInit() {
@@ -3931,6 +8278,18 @@ static void redisClusterAsyncRetryCallback(redisAsyncContext *ac, void *r,
         goto error;
     }
 
+    node = (cluster_node *)(ac->data);
+    if (node != NULL) {
+        cluster_node_reply_received(
+            node, reply ? hi_usec_now() - cad->sent_time : -1);
+    }
+
+    /* The hedge of the read already replied */
+    if (cad->answered) {
+        cluster_async_data_free(cad);
+        return;
+    }
+
     if (reply == NULL) {
         // Note:
         // I can't decide which is the best way to deal with connect
@@ -3948,15 +8307,9 @@ static void redisClusterAsyncRetryCallback(redisAsyncContext *ac, void *r,
         if (cc->update_route_time != 0) {
             now = hi_usec_now();
             if (now >= cc->update_route_time) {
-                ret = cluster_update_route(cc);
-                if (ret != REDIS_OK) {
-                    __redisClusterAsyncSetError(
-                        acc, REDIS_ERR_OTHER,
-                        "route update error, please recreate "
-                        "redisClusterContext!");
-                }
-
                 cc->update_route_time = 0LL;
+                cc->last_route_update = now;
+                cluster_async_update_route(acc);
             }
 
             goto done;
@@ -3984,94 +8337,545 @@ static void redisClusterAsyncRetryCallback(redisAsyncContext *ac, void *r,
                 hi_atoi(cluster_timeout_str, cluster_timeout_str_len);
             hi_free(cluster_timeout_str);
 
-            if (cluster_timeout <= 0) {
-                __redisClusterAsyncSetError(
-                    acc, REDIS_ERR_OTHER,
-                    "cluster_timeout_str convert to integer error");
-                goto done;
-            }
+            if (cluster_timeout <= 0) {
+                __redisClusterAsyncSetError(
+                    acc, REDIS_ERR_OTHER,
+                    "cluster_timeout_str convert to integer error");
+                goto done;
+            }
+
+            now = hi_usec_now();
+            if (now < 0) {
+                __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
+                                            "get now usec time error");
+                goto done;
+            }
+
+            next = now + (cluster_timeout * 1000LL);
+
+            cc->update_route_time = next;
+        }
+
+        goto done;
+    }
+
+    error_type = cluster_reply_error_type(reply);
+
+    if (error_type > CLUSTER_NOT_ERR && error_type < CLUSTER_ERR_SENTINEL) {
+        cad->retry_count++;
+        if (cad->retry_count > cc->max_redirect_count) {
+            cad->retry_count = 0;
+            __redisClusterAsyncSetError(acc,
+                                        REDIS_ERR_CLUSTER_TOO_MANY_REDIRECT,
+                                        "too many cluster redirect");
+            goto done;
+        }
+
+        switch (error_type) {
+        case CLUSTER_ERR_MOVED:
+            cluster_ask_cache_forget(cc, command->slot_num);
+
+            /* A replica refusing the read redirects to its master */
+            node = (cluster_node *)(ac->data);
+            if (node != NULL && node->role == REDIS_ROLE_SLAVE) {
+                node = node_get_by_table(cc, (uint32_t)command->slot_num);
+                if (node != NULL && redirect_reply_to_node(reply, node)) {
+                    ac_retry = actx_get_by_node(acc, node);
+                    if (ac_retry == NULL) {
+                        /* Specific error already set */
+                        goto done;
+                    } else if (ac_retry->err) {
+                        __redisClusterAsyncSetError(acc, ac_retry->err,
+                                                    ac_retry->errstr);
+                        goto done;
+                    }
+                    break;
+                }
+            }
+
+            /* Subscribe to an ongoing route update */
+            if (acc->route_ac != NULL) {
+                if (cluster_async_park_command(acc, cad) != REDIS_OK) {
+                    goto done;
+                }
+                return;
+            }
+
+            ret = cluster_route_update_on_moved(cc, reply, cad->route_version);
+            if (ret == ROUTE_UPDATE_ERROR) {
+                __redisClusterAsyncSetError(acc, cc->err, cc->errstr);
+                goto done;
+            } else if (ret == ROUTE_UPDATE_FETCH) {
+                /* Resent when the non-blocking route update is done */
+                if (cluster_async_park_command(acc, cad) != REDIS_OK) {
+                    goto done;
+                }
+                cluster_async_update_route(acc);
+                return;
+            }
+
+            node = node_get_by_table(cc, (uint32_t)command->slot_num);
+            if (node == NULL) {
+                __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
+                                            "node get by table error");
+                goto done;
+            }
+
+            ac_retry = actx_get_by_node(acc, node);
+            if (ac_retry == NULL) {
+                /* Specific error already set */
+                goto done;
+            } else if (ac_retry->err) {
+                __redisClusterAsyncSetError(acc, ac_retry->err,
+                                            ac_retry->errstr);
+                goto done;
+            }
+
+            break;
+        case CLUSTER_ERR_ASK:
+            node = node_get_by_redirect_reply(cc, reply, NULL);
+            if (node == NULL) {
+                __redisClusterAsyncSetError(acc, cc->err, cc->errstr);
+                goto done;
+            }
+
+            cluster_ask_cache_add(cc, command, node);
+
+            ac_retry = actx_get_by_node(acc, node);
+            if (ac_retry == NULL) {
+                /* Specific error already set */
+                goto done;
+            } else if (ac_retry->err) {
+                __redisClusterAsyncSetError(acc, ac_retry->err,
+                                            ac_retry->errstr);
+                goto done;
+            }
+
+            /* Queued ahead of the retried command, both are written
+             * together */
+            ret = redisAsyncFormattedCommand(ac_retry, NULL, NULL,
+                                             REDIS_PROTOCOL_ASKING,
+                                             strlen(REDIS_PROTOCOL_ASKING));
+            if (ret != REDIS_OK) {
+                goto error;
+            }
+
+            break;
+        case CLUSTER_ERR_TRYAGAIN:
+        case CLUSTER_ERR_CROSSSLOT:
+        case CLUSTER_ERR_CLUSTERDOWN:
+            ac_retry = ac;
+
+            break;
+        default:
+
+            goto done;
+            break;
+        }
+
+        goto retry;
+    }
+
+done:
+
+    if (acc->err) {
+        cad->callback(acc, NULL, cad->privdata);
+    } else {
+        cad->callback(acc, r, cad->privdata);
+    }
+
+    if (cc->err) {
+        cc->err = 0;
+        memset(cc->errstr, '\0', strlen(cc->errstr));
+    }
+
+    if (acc->err) {
+        acc->err = 0;
+        memset(acc->errstr, '\0', strlen(acc->errstr));
+    }
+
+    cluster_async_data_free(cad);
+
+    return;
+
+retry:
+
+    ret = cluster_async_send(ac_retry, cad);
+    if (ret != REDIS_OK) {
+        goto error;
+    }
+
+    return;
+
+error:
+
+    cluster_async_data_free(cad);
+}
+
+/* Set the delay after which a read-only command that has not been replied
+ * to is also sent to another node serving the slot, preferably a replica.
+ * The first reply is given to the callback and the other is discarded.
+ * A zero delay hedges reads when they take longer than the usual latency of
+ * the node, roughly its 95th percentile. The budget is the percentage of
+ * reads that may be hedged, zero disables hedging. Requires an adapter that
+ * provides a timer. */
+int redisClusterAsyncSetOptionHedgedReads(redisClusterAsyncContext *acc,
+                                          const struct timeval delay,
+                                          int budget) {
+    if (acc == NULL || delay.tv_sec < 0 || delay.tv_usec < 0 || budget < 0 ||
+        budget > 100) {
+        return REDIS_ERR;
+    }
+
+    acc->hedge_delay = delay.tv_sec * 1000000LL + delay.tv_usec;
+    acc->hedge_budget = budget;
+    if (budget > 0) {
+        acc->cc->flags |= HIRCLUSTER_FLAG_ADD_SLAVE;
+    }
+
+    return REDIS_OK;
+}
+
+/* Make sure that the timer fires at the given time at the latest. */
+static void cluster_async_schedule_timer(redisClusterAsyncContext *acc,
+                                         int64_t when) {
+    int64_t now;
+
+    if (acc->timer_time != 0 && acc->timer_time <= when) {
+        return;
+    }
+
+    now = hi_usec_now();
+    if (acc->timer_fn(acc, when > now ? when - now : 0) == REDIS_OK) {
+        acc->timer_time = when;
+    }
+}
+
+/* Let a read be hedged if it is not replied to in time. The reads awaiting
+ * their hedge are kept sorted by the time they are hedged. */
+static void cluster_async_hedge_add(redisClusterAsyncContext *acc,
+                                    cluster_async_data *cad,
+                                    cluster_node *node) {
+    int64_t delay;
+    listNode *ln;
+
+    if (acc->hedge_budget == 0 || acc->timer_fn == NULL) {
+        return;
+    }
+
+    acc->hedge_tokens += acc->hedge_budget;
+    if (acc->hedge_tokens > CLUSTER_HEDGE_BURST * 100) {
+        acc->hedge_tokens = CLUSTER_HEDGE_BURST * 100;
+    }
+
+    delay = acc->hedge_delay;
+    if (delay == 0) {
+        if (node->latency == 0) {
+            return; /* Nothing known about the node yet */
+        }
+        delay = node->latency + 2 * node->latency_dev;
+    }
+
+    if (acc->hedges == NULL) {
+        acc->hedges = listCreate();
+        if (acc->hedges == NULL) {
+            return;
+        }
+    }
+
+    cad->hedge_time = cad->sent_time + delay;
+    for (ln = listLast(acc->hedges); ln != NULL; ln = listPrevNode(ln)) {
+        if (((cluster_async_data *)listNodeValue(ln))->hedge_time <=
+            cad->hedge_time) {
+            break;
+        }
+    }
+
+    if (ln == NULL) {
+        if (listAddNodeHead(acc->hedges, cad) == NULL) {
+            return;
+        }
+        cad->hedge_ln = listFirst(acc->hedges);
+    } else {
+        if (listInsertNode(acc->hedges, ln, cad, 1) == NULL) {
+            return;
+        }
+        cad->hedge_ln = listNextNode(ln);
+    }
+
+    cluster_async_schedule_timer(acc, cad->hedge_time);
+}
+
+static void redisClusterAsyncHedgeCallback(redisAsyncContext *ac, void *r,
+                                           void *privdata) {
+    redisReply *reply = r;
+    cluster_async_data *hcad = privdata;
+    cluster_async_data *cad = hcad->hedge_of;
+    cluster_node *node = (cluster_node *)(ac->data);
+
+    if (node != NULL) {
+        cluster_node_reply_received(
+            node, reply ? hi_usec_now() - hcad->sent_time : -1);
+    }
+
+    /* Only a proper reply wins, the read may still succeed otherwise */
+    if (cad != NULL && !cad->answered && reply != NULL &&
+        reply->type != REDIS_REPLY_ERROR) {
+        cad->answered = 1;
+        cad->callback(cad->acc, r, cad->privdata);
+    }
+
+    cluster_async_data_free(hcad);
+}
+
+/* Send the hedge of a read to the cheapest other node serving the slot. */
+static void cluster_async_send_hedge(redisClusterAsyncContext *acc,
+                                     cluster_async_data *cad) {
+    cluster_node *master, *node, *target = NULL;
+    cluster_async_data *hcad;
+    redisAsyncContext *ac;
+    listIter li;
+    listNode *ln;
+
+    master = node_get_by_table(acc->cc, (uint32_t)cad->command->slot_num);
+    if (master == NULL || master->slaves == NULL) {
+        return;
+    }
+
+    if (master != cad->node) {
+        target = master;
+    }
+    listRewind(master->slaves, &li);
+    while ((ln = listNext(&li)) != NULL) {
+        node = listNodeValue(ln);
+        if (node != cad->node &&
+            (target == NULL || target == master ||
+             cluster_node_cost(node) < cluster_node_cost(target))) {
+            target = node;
+        }
+    }
+
+    if (target == NULL) {
+        return;
+    }
+
+    ac = actx_get_by_node(acc, target);
+    if (ac == NULL || ac->err) {
+        return;
+    }
+
+    hcad = cluster_async_data_get();
+    if (hcad == NULL) {
+        return;
+    }
+    hcad->acc = acc;
+
+    if (redisAsyncFormattedCommand(ac, redisClusterAsyncHedgeCallback, hcad,
+                                   cad->command->cmd,
+                                   cad->command->clen) != REDIS_OK) {
+        hi_free(hcad);
+        return;
+    }
+
+    hcad->sent_time = hi_usec_now();
+    target->in_flight++;
+    hcad->hedge_of = cad;
+    cad->hedge = hcad;
+    acc->hedge_tokens -= 100;
+}
+
+/* Called by the adapter when the timer fires. Sends the hedges that are due
+ * and schedules the timer for the next hedge. */
+void redisClusterAsyncHandleTimer(redisClusterAsyncContext *acc) {
+    cluster_async_data *cad;
+    listNode *ln;
+    int64_t now;
+
+    if (acc == NULL) {
+        return;
+    }
+
+    acc->timer_time = 0;
+    if (acc->hedges == NULL) {
+        return;
+    }
+
+    now = hi_usec_now();
+    while ((ln = listFirst(acc->hedges)) != NULL) {
+        cad = listNodeValue(ln);
+        if (cad->hedge_time > now) {
+            cluster_async_schedule_timer(acc, cad->hedge_time);
+            break;
+        }
+
+        listDelNode(acc->hedges, ln);
+        cad->hedge_ln = NULL;
+        if (acc->hedge_tokens >= 100) {
+            cluster_async_send_hedge(acc, cad);
+        }
+    }
+
+    if (acc->err) {
+        acc->err = 0;
+        memset(acc->errstr, '\0', strlen(acc->errstr));
+    }
+}
+
+/* Send a command to the node serving its slot, or park it while the slot
+ * awaits a route update. The given request state, or new request state when
+ * NULL, takes over the command when it is sent. Otherwise the command is
+ * left to the caller and the request state is freed. */
+static int cluster_async_dispatch(redisClusterAsyncContext *acc,
+                                  cluster_async_data *cad, struct cmd *command,
+                                  redisClusterCallbackFn *fn, void *privdata,
+                                  cluster_async_fragments *fragments) {
+    redisClusterContext *cc = acc->cc;
+    cluster_node *node = NULL, *ask_node = NULL;
+    redisAsyncContext *ac = NULL;
+
+    /* Keep the command order for slots awaiting a route update */
+    if (!cluster_async_slot_is_parked(acc, command->slot_num)) {
+        node = node_get_by_table(cc, (uint32_t)command->slot_num);
+        if (node == NULL) {
+            __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
+                                        "node get by table error");
+            goto error;
+        }
 
-            now = hi_usec_now();
-            if (now < 0) {
-                __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
-                                            "get now usec time error");
-                goto done;
-            }
+        /* A key known to be moved by an ongoing slot migration */
+        ask_node = cluster_ask_cache_lookup(cc, command);
+        if (ask_node != NULL) {
+            node = ask_node;
+        } else if (command->readonly) {
+            node = node_get_for_read(cc, node);
+        }
 
-            next = now + (cluster_timeout * 1000LL);
+        ac = actx_get_by_node(acc, node);
+        if (ac == NULL) {
+            /* Specific error already set */
+            goto error;
+        } else if (ac->err) {
+            __redisClusterAsyncSetError(acc, ac->err, ac->errstr);
+            goto error;
+        }
 
-            cc->update_route_time = next;
+        if (ask_node != NULL &&
+            redisAsyncFormattedCommand(ac, NULL, NULL, REDIS_PROTOCOL_ASKING,
+                                       strlen(REDIS_PROTOCOL_ASKING)) !=
+                REDIS_OK) {
+            __redisClusterAsyncSetError(acc, ac->err, ac->errstr);
+            goto error;
         }
+    }
 
-        goto done;
+    if (cad == NULL) {
+        cad = cluster_async_data_get();
+        if (cad == NULL) {
+            __redisClusterAsyncSetError(acc, REDIS_ERR_OOM, "Out of memory");
+            return REDIS_ERR;
+        }
     }
 
-    error_type = cluster_reply_error_type(reply);
+    cad->acc = acc;
+    cad->command = command;
+    cad->callback = fn;
+    cad->privdata = fragments != NULL ? cad : privdata;
+    cad->fragments = fragments;
 
-    if (error_type > CLUSTER_NOT_ERR && error_type < CLUSTER_ERR_SENTINEL) {
-        cad->retry_count++;
-        if (cad->retry_count > cc->max_redirect_count) {
-            cad->retry_count = 0;
-            __redisClusterAsyncSetError(acc,
-                                        REDIS_ERR_CLUSTER_TOO_MANY_REDIRECT,
-                                        "too many cluster redirect");
-            goto done;
+    if (ac == NULL) {
+        if (cluster_async_park_command(acc, cad) != REDIS_OK) {
+            goto error;
         }
+        return REDIS_OK;
+    }
 
-        switch (error_type) {
-        case CLUSTER_ERR_MOVED:
-            ac_retry =
-                actx_get_after_update_route_by_slot(acc, command->slot_num);
-            if (ac_retry == NULL) {
-                goto done;
-            }
+    if (cluster_async_send(ac, cad) != REDIS_OK) {
+        goto error;
+    }
 
-            break;
-        case CLUSTER_ERR_ASK:
-            node = node_get_by_ask_error_reply(cc, reply);
-            if (node == NULL) {
-                __redisClusterAsyncSetError(acc, cc->err, cc->errstr);
-                goto done;
-            }
+    if (command->readonly && ask_node == NULL) {
+        cluster_async_hedge_add(acc, cad, node);
+    }
 
-            ac_retry = actx_get_by_node(acc, node);
-            if (ac_retry == NULL) {
-                /* Specific error already set */
-                goto done;
-            } else if (ac_retry->err) {
-                __redisClusterAsyncSetError(acc, ac_retry->err,
-                                            ac_retry->errstr);
-                goto done;
-            }
+    return REDIS_OK;
 
-            ret = redisAsyncCommand(ac_retry, NULL, NULL, REDIS_COMMAND_ASKING);
-            if (ret != REDIS_OK) {
-                goto error;
-            }
+error:
+    hi_free(cad);
+    return REDIS_ERR;
+}
 
-            break;
-        case CLUSTER_ERR_TRYAGAIN:
-        case CLUSTER_ERR_CROSSSLOT:
-        case CLUSTER_ERR_CLUSTERDOWN:
-            ac_retry = ac;
+/* Take over the contents of a reply that hiredis frees when the callback
+ * returns, leaving an empty reply behind. */
+static redisReply *cluster_reply_take(redisReply *reply) {
+    redisReply *taken;
 
-            break;
-        default:
+    taken = hi_malloc(sizeof(*taken));
+    if (taken == NULL) {
+        return NULL;
+    }
+
+    memcpy(taken, reply, sizeof(*taken));
+    reply->str = NULL;
+    reply->len = 0;
+    reply->element = NULL;
+    reply->elements = 0;
+
+    return taken;
+}
+
+/* Keep the first error that replaces the reply to a fragment. */
+static void cluster_async_fragments_error(cluster_async_fragments *fragments,
+                                          int type, const char *str) {
+    size_t len;
+
+    if (fragments->err) {
+        return;
+    }
+
+    fragments->err = type;
+    len = strlen(str);
+    len = len < sizeof(fragments->errstr) - 1 ? len
+                                              : sizeof(fragments->errstr) - 1;
+    memcpy(fragments->errstr, str, len);
+    fragments->errstr[len] = '\0';
+}
 
+/* Give the reply to a multi-key command to its callback, once all of its
+ * fragments are replied to. An error reply to a fragment is the reply to
+ * the command, otherwise the fragment replies are merged. */
+static void cluster_async_fragments_done(cluster_async_fragments *fragments) {
+    redisClusterAsyncContext *acc = fragments->acc;
+    redisClusterContext *cc = acc->cc;
+    struct cmd *command = fragments->command;
+    struct cmd *sub_command;
+    redisReply *reply = NULL, *merged = NULL;
+    listNode *list_node;
+    listIter li;
+
+    if (fragments->err) {
+        __redisClusterAsyncSetError(acc, fragments->err, fragments->errstr);
+        goto done;
+    }
+
+    listRewind(command->sub_commands, &li);
+    while ((list_node = listNext(&li)) != NULL) {
+        sub_command = list_node->value;
+        if (sub_command->reply->type == REDIS_REPLY_ERROR) {
+            reply = sub_command->reply;
             goto done;
-            break;
         }
+    }
 
-        goto retry;
+    merged = command_post_fragment(cc, command, command->sub_commands);
+    if (merged == NULL) {
+        __redisClusterAsyncSetError(acc, cc->err, cc->errstr);
     }
+    reply = merged;
 
 done:
+    fragments->callback(acc, reply, fragments->privdata);
 
-    if (acc->err) {
-        cad->callback(acc, NULL, cad->privdata);
-    } else {
-        cad->callback(acc, r, cad->privdata);
-    }
+    freeReplyObject(merged);
 
     if (cc->err) {
         cc->err = 0;
@@ -4083,41 +8887,107 @@ done:
         memset(acc->errstr, '\0', strlen(acc->errstr));
     }
 
-    cluster_async_data_free(cad);
+    command_destroy(command);
+    hi_free(fragments);
+}
 
-    return;
+/* Called with the reply to a fragment, given after any redirects. */
+static void cluster_async_fragment_callback(redisClusterAsyncContext *acc,
+                                            void *r, void *privdata) {
+    cluster_async_data *cad = privdata;
+    cluster_async_fragments *fragments = cad->fragments;
+    struct cmd *sub_command = cad->command;
+    redisReply *reply = r;
 
-retry:
+    if (reply == NULL) {
+        cluster_async_fragments_error(fragments, acc->err, acc->errstr);
+    } else {
+        sub_command->reply = cluster_reply_take(reply);
+        if (sub_command->reply == NULL) {
+            cluster_async_fragments_error(fragments, REDIS_ERR_OOM,
+                                          "Out of memory");
+        }
+    }
 
-    ret = redisAsyncFormattedCommand(ac_retry, redisClusterAsyncRetryCallback,
-                                     cad, command->cmd, command->clen);
-    if (ret != REDIS_OK) {
-        goto error;
+    if (--fragments->pending == 0) {
+        cluster_async_fragments_done(fragments);
+    }
+}
+
+/* Send every fragment of a multi-key command, each redirected and retried
+ * on its own. The callback is called once, when all fragments are replied
+ * to. Takes over the command. */
+static int cluster_async_fragments_send(redisClusterAsyncContext *acc,
+                                        struct cmd *command,
+                                        redisClusterCallbackFn *fn,
+                                        void *privdata) {
+    cluster_async_fragments *fragments;
+    listNode *list_node;
+    listIter li;
+
+    fragments = hi_malloc(sizeof(*fragments));
+    if (fragments == NULL) {
+        __redisClusterAsyncSetError(acc, REDIS_ERR_OOM, "Out of memory");
+        command_destroy(command);
+        return REDIS_ERR;
     }
 
-    return;
+    fragments->acc = acc;
+    fragments->command = command;
+    fragments->callback = fn;
+    fragments->privdata = privdata;
+    fragments->pending = 1; /* Held until all fragments are sent */
+    fragments->err = 0;
+    fragments->errstr[0] = '\0';
 
-error:
+    listRewind(command->sub_commands, &li);
+    while ((list_node = listNext(&li)) != NULL) {
+        if (cluster_async_dispatch(acc, NULL, list_node->value,
+                                   cluster_async_fragment_callback, NULL,
+                                   fragments) != REDIS_OK) {
+            break;
+        }
+        fragments->pending++;
+    }
 
-    cluster_async_data_free(cad);
+    if (list_node != NULL) {
+        /* Nothing is sent, fail the command right away */
+        if (fragments->pending == 1) {
+            command_destroy(command);
+            hi_free(fragments);
+            return REDIS_ERR;
+        }
+
+        /* The callback is given the error when the sent fragments are
+         * replied to */
+        cluster_async_fragments_error(fragments, acc->err, acc->errstr);
+        acc->err = 0;
+        memset(acc->errstr, '\0', strlen(acc->errstr));
+    }
+
+    if (--fragments->pending == 0) {
+        cluster_async_fragments_done(fragments);
+    }
+
+    return REDIS_OK;
 }
 
-int redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc,
-                                      redisClusterCallbackFn *fn,
-                                      void *privdata, char *cmd, int len) {
+/* Send a command, taking over the formatted command buffer. Request state
+ * and commands of completed requests are reused, so a single-key command
+ * needs no allocations of its own once the pool is warm. The command is
+ * classified using the arguments it was formatted from when args is not
+ * NULL. */
+static int __redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc,
+                                               redisClusterCallbackFn *fn,
+                                               void *privdata, char *cmd,
+                                               int len,
+                                               const struct cmd_args *args) {
 
     redisClusterContext *cc;
-    int status = REDIS_OK;
     int slot_num;
-    cluster_node *node;
-    redisAsyncContext *ac;
-    struct cmd *command = NULL;
-    hilist *commands = NULL;
     cluster_async_data *cad;
-
-    if (acc == NULL) {
-        return REDIS_ERR;
-    }
+    struct cmd *command = NULL;
+    hilist commands, *sub_commands;
 
     cc = acc->cc;
 
@@ -4131,26 +9001,39 @@ int redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc,
         memset(acc->errstr, '\0', strlen(acc->errstr));
     }
 
-    command = command_get();
-    if (command == NULL) {
-        goto oom;
+    if (acc->route_ac == NULL) {
+        cluster_topology_sync_when_changed(cc);
     }
 
-    command->cmd = hi_malloc(len * sizeof(*command->cmd));
-    if (command->cmd == NULL) {
-        goto oom;
+    if (cluster_route_update_is_due(cc) && acc->route_ac == NULL) {
+        cc->update_route_time = 0LL;
+        cc->last_route_update = hi_usec_now();
+        if (cluster_async_update_route(acc) != REDIS_OK) {
+            /* Keep using the current lookup table */
+            acc->err = 0;
+            memset(acc->errstr, '\0', strlen(acc->errstr));
+        }
     }
-    memcpy(command->cmd, cmd, len);
-    command->clen = len;
 
-    commands = listCreate();
-    if (commands == NULL) {
-        goto oom;
+    listInit(&commands);
+    commands.free = listCommandFree;
+
+    cad = cluster_async_pool_get(acc);
+    if (cad != NULL && cad->command != NULL) {
+        command = cad->command;
+        cad->command = NULL;
+    } else {
+        command = command_get();
+        if (command == NULL) {
+            hi_free(cmd);
+            goto oom;
+        }
     }
 
-    commands->free = listCommandFree;
+    command->cmd = cmd;
+    command->clen = len;
 
-    slot_num = command_format_by_slot(cc, command, commands);
+    slot_num = command_format_by_slot(cc, command, args, &commands);
 
     if (slot_num < 0) {
         __redisClusterAsyncSetError(acc, cc->err, cc->errstr);
@@ -4162,51 +9045,27 @@ int redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc,
     }
 
     // all keys not belong to one slot
-    if (listLength(commands) > 0) {
-        ASSERT(listLength(commands) != 1);
-
-        __redisClusterAsyncSetError(
-            acc, REDIS_ERR_OTHER,
-            "Asynchronous API now not support multi-key command");
-        goto error;
-    }
-
-    node = node_get_by_table(cc, (uint32_t)slot_num);
-    if (node == NULL) {
-        __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
-                                    "node get by table error");
-        goto error;
-    }
+    if (listLength(&commands) > 0) {
+        ASSERT(listLength(&commands) != 1);
 
-    ac = actx_get_by_node(acc, node);
-    if (ac == NULL) {
-        /* Specific error already set */
-        goto error;
-    } else if (ac->err) {
-        __redisClusterAsyncSetError(acc, ac->err, ac->errstr);
-        goto error;
-    }
+        sub_commands = listCreate();
+        if (sub_commands == NULL) {
+            goto oom;
+        }
+        *sub_commands = commands;
+        listInit(&commands);
 
-    cad = cluster_async_data_get();
-    if (cad == NULL) {
-        goto oom;
+        hi_free(cad);
+        command->sub_commands = sub_commands;
+        return cluster_async_fragments_send(acc, command, fn, privdata);
     }
 
-    cad->acc = acc;
-    cad->command = command;
-    cad->callback = fn;
-    cad->privdata = privdata;
-
-    status = redisAsyncFormattedCommand(ac, redisClusterAsyncRetryCallback, cad,
-                                        cmd, len);
-    if (status != REDIS_OK) {
+    if (cluster_async_dispatch(acc, cad, command, fn, privdata, NULL) !=
+        REDIS_OK) {
+        cad = NULL; /* Freed */
         goto error;
     }
 
-    if (commands != NULL) {
-        listRelease(commands);
-    }
-
     return REDIS_OK;
 
 oom:
@@ -4214,17 +9073,35 @@ oom:
     // passthrough
 
 error:
+    hi_free(cad);
     command_destroy(command);
-    if (commands != NULL) {
-        listRelease(commands);
-    }
+    listEmpty(&commands);
     return REDIS_ERR;
 }
 
+int redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc,
+                                      redisClusterCallbackFn *fn,
+                                      void *privdata, char *cmd, int len) {
+    char *copy;
+
+    if (acc == NULL) {
+        return REDIS_ERR;
+    }
+
+    copy = hi_malloc(len * sizeof(*copy));
+    if (copy == NULL) {
+        __redisClusterAsyncSetError(acc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+    memcpy(copy, cmd, len);
+
+    return __redisClusterAsyncFormattedCommand(acc, fn, privdata, copy, len,
+                                               NULL);
+}
+
 int redisClustervAsyncCommand(redisClusterAsyncContext *acc,
                               redisClusterCallbackFn *fn, void *privdata,
                               const char *format, va_list ap) {
-    int ret;
     char *cmd;
     int len;
 
@@ -4242,11 +9119,8 @@ int redisClustervAsyncCommand(redisClusterAsyncContext *acc,
         return REDIS_ERR;
     }
 
-    ret = redisClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len);
-
-    hi_free(cmd);
-
-    return ret;
+    return __redisClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len,
+                                               NULL);
 }
 
 int redisClusterAsyncCommand(redisClusterAsyncContext *acc,
@@ -4334,7 +9208,7 @@ int redisClusterAsyncCommandArgv(redisClusterAsyncContext *acc,
                                  redisClusterCallbackFn *fn, void *privdata,
                                  int argc, const char **argv,
                                  const size_t *argvlen) {
-    int ret;
+    struct cmd_args args = {argc, argv, argvlen};
     char *cmd;
     int len;
 
@@ -4344,11 +9218,8 @@ int redisClusterAsyncCommandArgv(redisClusterAsyncContext *acc,
         return REDIS_ERR;
     }
 
-    ret = redisClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len);
-
-    hi_free(cmd);
-
-    return ret;
+    return __redisClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len,
+                                               &args);
 }
 
 void redisClusterAsyncDisconnect(redisClusterAsyncContext *acc) {
@@ -4387,6 +9258,8 @@ void redisClusterAsyncDisconnect(redisClusterAsyncContext *acc) {
 
 void redisClusterAsyncFree(redisClusterAsyncContext *acc) {
     redisClusterContext *cc;
+    redisAsyncContext *ac;
+    cluster_async_data *cad;
 
     if (acc == NULL) {
         return;
@@ -4394,8 +9267,33 @@ void redisClusterAsyncFree(redisClusterAsyncContext *acc) {
 
     cc = acc->cc;
 
+    if (acc->route_ac != NULL) {
+        ac = acc->route_ac;
+        acc->route_ac = NULL;
+        redisAsyncFree(ac);
+    }
+    cluster_async_route_addrs_free(acc);
+
+    if (acc->parked != NULL) {
+        __redisClusterAsyncSetError(acc, REDIS_ERR_OTHER,
+                                    "context freed during route update");
+        cluster_async_replay_parked(acc, 0);
+    }
+
     redisClusterFree(cc);
 
+    if (acc->timer != NULL) {
+        acc->timer_fn(acc, -1);
+    }
+    if (acc->hedges != NULL) {
+        listRelease(acc->hedges);
+    }
+
+    while ((cad = cluster_async_pool_get(acc)) != NULL) {
+        command_destroy(cad->command);
+        hi_free(cad);
+    }
+
     hi_free(acc);
 }
 
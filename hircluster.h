@@ -12,9 +12,9 @@
 #define UNUSED(x) (void)(x)
 
 #define HIREDIS_CLUSTER_MAJOR 0
-#define HIREDIS_CLUSTER_MINOR 5
+#define HIREDIS_CLUSTER_MINOR 7
 #define HIREDIS_CLUSTER_PATCH 0
-#define HIREDIS_CLUSTER_SONAME 0.5
+#define HIREDIS_CLUSTER_SONAME 0.7
 
 #define REDIS_CLUSTER_SLOTS 16384
 
@@ -35,6 +35,25 @@
 /* Flag to enable routing table updates using the command 'cluster slots'.
  * Default is the 'cluster nodes' command. */
 #define HIRCLUSTER_FLAG_ROUTE_USE_SLOTS 0x4000
+/* Flag to enable updating the slot lookup table directly from the target
+ * given in a MOVED reply. A full routing table update is then only performed
+ * lazily, at most once per route update interval. */
+#define HIRCLUSTER_FLAG_UPDATE_SLOT_ON_MOVED 0x8000
+/* Flag to enable routing table updates using the command 'cluster shards',
+ * available since Redis 7.0. Takes precedence over 'cluster slots'. */
+#define HIRCLUSTER_FLAG_ROUTE_USE_SHARDS 0x10000
+/* Flag to enable collecting pipelined replies by polling all node
+ * connections, rather than blocking on one connection at a time. */
+#define HIRCLUSTER_FLAG_PIPELINE_POLL 0x20000
+/* Flag to enable fetching the key positions of all commands using the
+ * command 'command' with each routing table update, for routing commands
+ * missing from the compiled-in command table. */
+#define HIRCLUSTER_FLAG_FETCH_COMMANDS 0x40000
+
+/* Read preferences, where read-only commands are sent */
+#define HIRCLUSTER_READ_MASTER 0         /* Master only (default) */
+#define HIRCLUSTER_READ_PREFER_REPLICA 1 /* Fastest replica, else master */
+#define HIRCLUSTER_READ_ROUND_ROBIN 2    /* Master and replicas in turn */
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,9 +61,13 @@ extern "C" {
 
 struct dict;
 struct hilist;
+struct cluster_route;
+struct cluster_ask_slot;
+struct redisClusterTopology;
 struct redisClusterAsyncContext;
 
 typedef int(adapterAttachFn)(redisAsyncContext *, void *);
+typedef int(adapterTimerFn)(struct redisClusterAsyncContext *, int64_t);
 typedef void(redisClusterCallbackFn)(struct redisClusterAsyncContext *, void *,
                                      void *);
 typedef struct cluster_node {
@@ -58,8 +81,15 @@ typedef struct cluster_node {
     struct hilist *slots;
     struct hilist *slaves;
     int failure_count;         /* consecutive failing attempts in async */
+    int in_flight;             /* Commands awaiting a reply */
+    int64_t latency;           /* Moving average of reply latency in usec */
+    int64_t latency_dev;       /* Mean deviation of the latency in usec */
     struct hiarray *migrating; /* copen_slot[] */
     struct hiarray *importing; /* copen_slot[] */
+
+    /* Listed in the context's pipeline_nodes */
+    int in_pipeline;
+    struct cluster_node *pipeline_next;
 } cluster_node;
 
 typedef struct cluster_slot {
@@ -75,6 +105,9 @@ typedef struct copen_slot {
     cluster_node *node; /* master that this slot belong to */
 } copen_slot;
 
+/* Routing table shared by contexts, which may be used in different threads */
+typedef struct redisClusterTopology redisClusterTopology;
+
 /* Context for accessing a Redis Cluster */
 typedef struct redisClusterContext {
     int err;          /* Error flags, 0 when there is no error */
@@ -85,19 +118,36 @@ typedef struct redisClusterContext {
     struct timeval *connect_timeout;            /* TCP connect timeout */
     struct timeval *command_timeout;            /* Receive and send timeout */
     int max_redirect_count;                     /* Allowed retry attempts */
+    int route_probes;    /* Nodes probed concurrently for the routing table */
+    int route_quorum;    /* Nodes that must agree on the routing table */
+    int read_preference; /* Where read-only commands are sent */
+    int64_t route_update_interval; /* Min usec between route updates */
     char password[CONFIG_AUTHPASS_MAX_LEN + 1]; /* Include a null terminator */
-
-    struct dict *nodes;     /* Known cluster_nodes*/
-    struct hiarray *slots;  /* Sorted array of cluster_slots */
-    uint64_t route_version; /* Increased when the node lookup table changes */
-    cluster_node *table[REDIS_CLUSTER_SLOTS]; /* cluster_node lookup table */
-
-    struct hilist *requests; /* Outstanding commands (Pipelining) */
+    char *topology_file; /* Cache file for the routing table or NULL */
+
+    struct dict *nodes;          /* Known cluster_nodes*/
+    struct dict *seed_nodes;     /* Given nodes while using cached ones */
+    struct hiarray *slots;       /* Sorted array of cluster_slots */
+    uint64_t route_version;      /* Increased when the lookup table changes */
+    struct cluster_route *route; /* Slot to cluster_node lookup snapshot */
+    struct cluster_ask_slot **ask_slots;   /* Moved keys per slot, or NULL */
+    struct redisClusterTopology *topology; /* Shared routing table or NULL */
+    uint64_t topology_version;         /* Version of the shared table in use */
+    struct cluster_commands *commands; /* Command table or NULL */
+
+    struct hilist *requests;             /* Outstanding commands (Pipelining) */
+    struct cluster_node *pipeline_nodes; /* Nodes given pipelined commands */
+    struct pollfd *poll_fds;             /* Space for polling connections */
+    redisContext **poll_ctxs;            /* The connections to poll */
+    unsigned long poll_size;             /* Room in poll_fds and poll_ctxs */
 
     int retry_count;           /* Current number of failing attempts */
     int need_update_route;     /* Indicator for redisClusterReset() (Pipel.) */
-    int64_t update_route_time; /* Timestamp for next required route update
-                                  (Async mode only) */
+    int64_t update_route_time; /* Timestamp for next required route update */
+    int64_t last_route_update; /* Timestamp of last redirect triggered update */
+
+    unsigned long read_counter; /* Selects the replica of the next read */
+    uint64_t read_random;       /* Random state for replica selection */
 #ifdef SSL_SUPPORT
     redisSSLContext *ssl;
 #endif
@@ -113,6 +163,9 @@ typedef struct redisClusterAsyncContext {
 
     void *adapter;              /* Adapter to the async event library */
     adapterAttachFn *attach_fn; /* Func ptr for attaching the async library */
+    adapterTimerFn *timer_fn;   /* Func ptr for scheduling a timer, or NULL */
+    void *timer;                /* Timer of the async library */
+    int64_t timer_time;         /* When the scheduled timer fires, or 0 */
 
     /* Called when either the connection is terminated due to an error or per
      * user request. The status is set accordingly (REDIS_OK, REDIS_ERR). */
@@ -121,6 +174,24 @@ typedef struct redisClusterAsyncContext {
     /* Called when the first write event was received. */
     redisConnectCallback *onConnect;
 
+    /* Non-blocking route update */
+    redisAsyncContext *route_ac; /* Connection used for the route update */
+    int route_update_attempt;    /* Number of nodes asked for the route */
+    sds *route_addrs;            /* Addresses of the nodes to ask */
+    int route_addrs_count;       /* Number of addresses to ask */
+    struct hilist *parked;       /* Commands waiting for the route update */
+    uint8_t parked_slots[REDIS_CLUSTER_SLOTS / 8]; /* Slots with parked cmds */
+
+    /* Hedged reads */
+    int64_t hedge_delay;   /* Usec until a read is hedged, 0 when adaptive */
+    int hedge_budget;      /* Percentage of reads that may be hedged */
+    int hedge_tokens;      /* Hedges currently allowed, times 100 */
+    struct hilist *hedges; /* Reads awaiting their hedge, by deadline */
+
+    /* Request state of completed commands, kept for reuse */
+    struct cluster_async_data *pool;
+    int pool_size;
+
 } redisClusterAsyncContext;
 
 typedef struct nodeIterator {
@@ -144,6 +215,10 @@ int redisClusterConnect2(redisClusterContext *cc);
 redisClusterContext *redisClusterContextInit(void);
 void redisClusterFree(redisClusterContext *cc);
 
+/* Shared topology */
+redisClusterTopology *redisClusterTopologyCreate(void);
+void redisClusterTopologyFree(redisClusterTopology *topology);
+
 /* Configuration options */
 int redisClusterSetOptionAddNode(redisClusterContext *cc, const char *addr);
 int redisClusterSetOptionAddNodes(redisClusterContext *cc, const char *addrs);
@@ -154,6 +229,20 @@ int redisClusterSetOptionPassword(redisClusterContext *cc,
 int redisClusterSetOptionParseSlaves(redisClusterContext *cc);
 int redisClusterSetOptionParseOpenSlots(redisClusterContext *cc);
 int redisClusterSetOptionRouteUseSlots(redisClusterContext *cc);
+int redisClusterSetOptionRouteUseShards(redisClusterContext *cc);
+int redisClusterSetOptionTopologyFile(redisClusterContext *cc,
+                                      const char *path);
+int redisClusterSetOptionUpdateSlotOnMoved(redisClusterContext *cc);
+int redisClusterSetOptionPipelinePoll(redisClusterContext *cc);
+int redisClusterSetOptionFetchCommands(redisClusterContext *cc);
+int redisClusterSetOptionRouteUpdateInterval(redisClusterContext *cc,
+                                             const struct timeval tv);
+int redisClusterSetOptionTopology(redisClusterContext *cc,
+                                  redisClusterTopology *topology);
+int redisClusterSetOptionRouteProbes(redisClusterContext *cc, int probes);
+int redisClusterSetOptionRouteQuorum(redisClusterContext *cc, int quorum);
+int redisClusterSetOptionReadPreference(redisClusterContext *cc,
+                                        int preference);
 int redisClusterSetOptionConnectTimeout(redisClusterContext *cc,
                                         const struct timeval tv);
 int redisClusterSetOptionTimeout(redisClusterContext *cc,
@@ -219,6 +308,8 @@ struct dict *parse_cluster_nodes(redisClusterContext *cc, char *str,
                                  int str_len, int flags);
 struct dict *parse_cluster_slots(redisClusterContext *cc, redisReply *reply,
                                  int flags);
+struct dict *parse_cluster_shards(redisClusterContext *cc, redisReply *reply,
+                                  int flags);
 
 /*
  * Asynchronous API
@@ -231,6 +322,10 @@ int redisClusterAsyncSetConnectCallback(redisClusterAsyncContext *acc,
                                         redisConnectCallback *fn);
 int redisClusterAsyncSetDisconnectCallback(redisClusterAsyncContext *acc,
                                            redisDisconnectCallback *fn);
+int redisClusterAsyncSetOptionHedgedReads(redisClusterAsyncContext *acc,
+                                          const struct timeval delay,
+                                          int budget);
+void redisClusterAsyncHandleTimer(redisClusterAsyncContext *acc);
 
 redisClusterAsyncContext *redisClusterAsyncConnect(const char *addrs,
                                                    int flags);
@@ -121,6 +121,42 @@ ssize_t _hi_sendn(int sd, const void *vptr, size_t n);
 ssize_t _hi_recvn(int sd, void *vptr, size_t n);
 #endif
 
+/*
+ * Wrappers for mutexes and atomic operations used by state that is
+ * shared between threads.
+ */
+#ifdef _WIN32
+#include <windows.h>
+
+typedef SRWLOCK hi_mutex_t;
+
+#define hi_mutex_init(_m) InitializeSRWLock(_m)
+#define hi_mutex_destroy(_m) ((void)(_m))
+#define hi_mutex_lock(_m) AcquireSRWLockExclusive(_m)
+#define hi_mutex_unlock(_m) ReleaseSRWLockExclusive(_m)
+
+#define hi_atomic_incr(_p) InterlockedIncrement((volatile LONG *)(_p))
+#define hi_atomic_decr(_p) InterlockedDecrement((volatile LONG *)(_p))
+#define hi_atomic_load64(_p)                                                   \
+    ((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(_p), 0, 0))
+#define hi_atomic_store64(_p, _v)                                              \
+    InterlockedExchange64((volatile LONG64 *)(_p), (LONG64)(_v))
+#else
+#include <pthread.h>
+
+typedef pthread_mutex_t hi_mutex_t;
+
+#define hi_mutex_init(_m) pthread_mutex_init(_m, NULL)
+#define hi_mutex_destroy(_m) pthread_mutex_destroy(_m)
+#define hi_mutex_lock(_m) pthread_mutex_lock(_m)
+#define hi_mutex_unlock(_m) pthread_mutex_unlock(_m)
+
+#define hi_atomic_incr(_p) __atomic_add_fetch(_p, 1, __ATOMIC_ACQ_REL)
+#define hi_atomic_decr(_p) __atomic_sub_fetch(_p, 1, __ATOMIC_ACQ_REL)
+#define hi_atomic_load64(_p) __atomic_load_n(_p, __ATOMIC_ACQUIRE)
+#define hi_atomic_store64(_p, _v) __atomic_store_n(_p, _v, __ATOMIC_RELEASE)
+#endif
+
 /*
  * Wrappers for defining custom assert based on whether macro
  * HI_ASSERT_PANIC or HI_ASSERT_LOG was defined at the moment
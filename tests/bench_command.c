@@ -0,0 +1,122 @@
+/*
+ * Benchmark of the per-call overhead of the synchronous API.
+ *
+ * Sends the same single-key GET through redisClusterCommand and directly
+ * through hiredis on the connection to the node serving the key. For both
+ * the time per call and the number of allocations per call are printed,
+ * the difference is the overhead added by the cluster client.
+ *
+ * Usage: bench_command [HOST:PORT] [iterations]
+ */
+#include "hircluster.h"
+#include <assert.h>
+#include <hiredis/alloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CLUSTER_NODE "127.0.0.1:7000"
+#define KEY "bench:key"
+
+static long long allocations = 0;
+
+static void *counting_malloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+static void *counting_calloc(size_t nmemb, size_t size) {
+    allocations++;
+    return calloc(nmemb, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+    allocations++;
+    return realloc(ptr, size);
+}
+
+static char *counting_strdup(const char *s) {
+    allocations++;
+    return strdup(s);
+}
+
+static long long usec_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void print_result(const char *name, long long time,
+                         long long call_allocations, int iterations) {
+    printf("%-20s %12.2f %14.2f\n", name, (double)time / iterations,
+           (double)call_allocations / iterations);
+}
+
+int main(int argc, char **argv) {
+    const char *addr = argc > 1 ? argv[1] : CLUSTER_NODE;
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+    long long start, cluster_time, hiredis_time;
+    long long cluster_allocations, hiredis_allocations;
+    redisReply *reply;
+
+    assert(iterations > 0);
+
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+    redisClusterSetOptionAddNodes(cc, addr);
+    if (redisClusterConnect2(cc) != REDIS_OK) {
+        fprintf(stderr, "Connect error: %s\n", cc->errstr);
+        exit(1);
+    }
+
+    reply = redisClusterCommand(cc, "SET %s %s", KEY, "value");
+    assert(reply != NULL && reply->type == REDIS_REPLY_STATUS);
+    freeReplyObject(reply);
+
+    cluster_node *node = redisClusterGetNodeByKey(cc, (char *)KEY);
+    assert(node && node->con);
+
+    hiredisAllocFuncs ha = {
+        .mallocFn = counting_malloc,
+        .callocFn = counting_calloc,
+        .reallocFn = counting_realloc,
+        .strdupFn = counting_strdup,
+        .freeFn = free,
+    };
+    hiredisSetAllocators(&ha);
+
+    allocations = 0;
+    start = usec_now();
+    for (int i = 0; i < iterations; i++) {
+        reply = redisClusterCommand(cc, "GET %s", KEY);
+        assert(reply != NULL && reply->type == REDIS_REPLY_STRING);
+        freeReplyObject(reply);
+    }
+    cluster_time = usec_now() - start;
+    cluster_allocations = allocations;
+
+    allocations = 0;
+    start = usec_now();
+    for (int i = 0; i < iterations; i++) {
+        reply = redisCommand(node->con, "GET %s", KEY);
+        assert(reply != NULL && reply->type == REDIS_REPLY_STRING);
+        freeReplyObject(reply);
+    }
+    hiredis_time = usec_now() - start;
+    hiredis_allocations = allocations;
+
+    hiredisResetAllocators();
+
+    printf("%d calls of GET\n", iterations);
+    printf("%-20s %12s %14s\n", "", "us/call", "allocs/call");
+    print_result("redisClusterCommand", cluster_time, cluster_allocations,
+                 iterations);
+    print_result("redisCommand", hiredis_time, hiredis_allocations,
+                 iterations);
+    print_result("overhead", cluster_time - hiredis_time,
+                 cluster_allocations - hiredis_allocations, iterations);
+
+    redisClusterFree(cc);
+    return 0;
+}
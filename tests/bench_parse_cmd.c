@@ -0,0 +1,136 @@
+/*
+ * Benchmark of the command parser.
+ *
+ * Parses a mix of commands resembling the traffic of a cache, mostly single
+ * key reads and writes with some multi-key and script commands, using both
+ * redis_parse_cmd() on the formatted commands and redis_parse_cmd_argv() on
+ * the arguments they were formatted from. The time per parsed command is
+ * printed.
+ *
+ * Usage: bench_parse_cmd [iterations]
+ */
+#include "command.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_ARGS 8
+
+/* A command and the number of times it is included in the mix */
+struct mix_command {
+    int weight;
+    int argc;
+    const char *argv[MAX_ARGS];
+};
+
+static const struct mix_command mix[] = {
+    {40, 2, {"GET", "user:1000:session"}},
+    {15, 3, {"SET", "user:1000:session", "0123456789abcdef"}},
+    {5, 5, {"SET", "page:/index", "<html></html>", "EX", "60"}},
+    {8, 3, {"HGET", "user:1000", "name"}},
+    {4, 4, {"HSET", "user:1000", "name", "Alice"}},
+    {6, 2, {"INCR", "counter:visits"}},
+    {4, 3, {"EXPIRE", "user:1000:session", "3600"}},
+    {4, 4, {"MGET", "user:1000", "user:1001", "user:1002"}},
+    {3, 4, {"ZADD", "leaderboard", "100", "user:1000"}},
+    {3, 3, {"lpush", "queue:jobs", "job:42"}},
+    {3, 2, {"Del", "user:999:session"}},
+    {2, 5, {"ZRANGEBYSCORE", "leaderboard", "0", "100", "WITHSCORES"}},
+    {2, 5, {"EVALSHA", "e0e1f9fabfc9d4800c877a703b823ac0578ff831", "1",
+            "lock:1000", "30"}},
+    {1, 5, {"MSET", "user:1000:a", "1", "user:1000:b", "2"}},
+};
+
+struct parsed_command {
+    char *cmd;
+    int len;
+    int argc;
+    const char **argv;
+    size_t argvlen[MAX_ARGS];
+};
+
+static long long nsec_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    struct parsed_command *commands;
+    struct cmd *command;
+    long long start, parse_time, parse_argv_time;
+    int count = 0, round, i, j, k;
+
+    assert(iterations > 0);
+
+    for (i = 0; i < (int)(sizeof(mix) / sizeof(mix[0])); i++) {
+        count += mix[i].weight;
+    }
+
+    /* The commands are interleaved, as they would be sent */
+    commands = calloc(count, sizeof(*commands));
+    assert(commands);
+    for (round = 0, k = 0; k < count; round++) {
+        for (i = 0; i < (int)(sizeof(mix) / sizeof(mix[0])); i++) {
+            if (mix[i].weight <= round) {
+                continue;
+            }
+            struct parsed_command *c = &commands[k++];
+            c->argc = mix[i].argc;
+            c->argv = (const char **)mix[i].argv;
+            for (j = 0; j < c->argc; j++) {
+                c->argvlen[j] = strlen(c->argv[j]);
+            }
+            c->len = redisFormatCommandArgv(&c->cmd, c->argc, c->argv,
+                                            c->argvlen);
+            assert(c->len > 0);
+        }
+    }
+
+    command = command_get();
+    assert(command);
+
+    start = nsec_now();
+    for (i = 0; i < iterations; i++) {
+        for (k = 0; k < count; k++) {
+            command->cmd = commands[k].cmd;
+            command->clen = commands[k].len;
+            redis_parse_cmd(command);
+            assert(command->result == CMD_PARSE_OK);
+            command->cmd = NULL;
+            command_reset(command);
+        }
+    }
+    parse_time = nsec_now() - start;
+
+    start = nsec_now();
+    for (i = 0; i < iterations; i++) {
+        for (k = 0; k < count; k++) {
+            command->cmd = commands[k].cmd;
+            command->clen = commands[k].len;
+            redis_parse_cmd_argv(command, commands[k].argc, commands[k].argv,
+                                 commands[k].argvlen);
+            assert(command->result == CMD_PARSE_OK);
+            command->cmd = NULL;
+            command_reset(command);
+        }
+    }
+    parse_argv_time = nsec_now() - start;
+
+    printf("%d commands parsed %d times\n", count, iterations);
+    printf("%-22s %10s\n", "", "ns/command");
+    printf("%-22s %10.1f\n", "redis_parse_cmd",
+           (double)parse_time / iterations / count);
+    printf("%-22s %10.1f\n", "redis_parse_cmd_argv",
+           (double)parse_argv_time / iterations / count);
+
+    command_destroy(command);
+    for (k = 0; k < count; k++) {
+        hi_free(commands[k].cmd);
+    }
+    free(commands);
+    return 0;
+}
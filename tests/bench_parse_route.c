@@ -0,0 +1,271 @@
+/*
+ * Benchmark of the routing table reply parsers.
+ *
+ * Generates the replies of CLUSTER NODES, CLUSTER SLOTS and CLUSTER SHARDS
+ * for a cluster of 500 masters with one replica each, where the slots are
+ * spread over the masters in small ranges. For each reply the size in bytes,
+ * the time to decode and parse it, and the number of allocations per parse
+ * are printed.
+ *
+ * Usage: bench_parse_route [iterations] [slots-per-range]
+ */
+#include "dict.h"
+#include "hircluster.h"
+#include <assert.h>
+#include <hiredis/alloc.h>
+#include <hiredis/read.h>
+#include <hiredis/sds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_MASTERS 500
+
+static long long allocations = 0;
+
+static void *counting_malloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+static void *counting_calloc(size_t nmemb, size_t size) {
+    allocations++;
+    return calloc(nmemb, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+    allocations++;
+    return realloc(ptr, size);
+}
+
+static char *counting_strdup(const char *s) {
+    allocations++;
+    return strdup(s);
+}
+
+static long long usec_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static sds cat_bulk(sds s, const char *str) {
+    return sdscatprintf(s, "$%zu\r\n%s\r\n", strlen(str), str);
+}
+
+static sds cat_int(sds s, int value) {
+    return sdscatprintf(s, ":%d\r\n", value);
+}
+
+static void node_id(char *buf, size_t size, int id) {
+    snprintf(buf, size, "%040d", id);
+}
+
+static void node_ip(char *buf, size_t size, int id) {
+    snprintf(buf, size, "10.%d.%d.%d", id / NUM_MASTERS,
+             (id % NUM_MASTERS) / 256, id % 256);
+}
+
+/* Slot ranges are given to the masters in turn. */
+static int range_count(int range_size) {
+    return (REDIS_CLUSTER_SLOTS + range_size - 1) / range_size;
+}
+
+static int range_end(int range, int range_size) {
+    int end = (range + 1) * range_size - 1;
+    return end < REDIS_CLUSTER_SLOTS ? end : REDIS_CLUSTER_SLOTS - 1;
+}
+
+/* The CLUSTER NODES reply, as a RESP bulk string. */
+static sds generate_nodes(int range_size) {
+    char id[41], master_id[41], ip[16];
+    sds text = sdsempty();
+
+    for (int i = 0; i < NUM_MASTERS * 2; i++) {
+        node_id(id, sizeof(id), i);
+        node_ip(ip, sizeof(ip), i);
+        if (i < NUM_MASTERS) {
+            text = sdscatprintf(text,
+                                "%s %s:6379@16379 %s - 0 1426238317239 %d "
+                                "connected",
+                                id, ip, i == 0 ? "myself,master" : "master",
+                                i + 1);
+            for (int r = i; r < range_count(range_size); r += NUM_MASTERS) {
+                text = sdscatprintf(text, " %d-%d", r * range_size,
+                                    range_end(r, range_size));
+            }
+        } else {
+            node_id(master_id, sizeof(master_id), i - NUM_MASTERS);
+            text = sdscatprintf(text,
+                                "%s %s:6379@16379 slave %s 0 1426238316232 "
+                                "%d connected",
+                                id, ip, master_id, i - NUM_MASTERS + 1);
+        }
+        text = sdscat(text, "\n");
+    }
+
+    sds resp = sdscatprintf(sdsempty(), "$%zu\r\n", sdslen(text));
+    resp = sdscatsds(resp, text);
+    resp = sdscat(resp, "\r\n");
+    sdsfree(text);
+    return resp;
+}
+
+static sds cat_slots_node(sds s, int id) {
+    char buf[41];
+
+    s = sdscat(s, "*3\r\n");
+    node_ip(buf, sizeof(buf), id);
+    s = cat_bulk(s, buf);
+    s = cat_int(s, 6379);
+    node_id(buf, sizeof(buf), id);
+    return cat_bulk(s, buf);
+}
+
+/* The CLUSTER SLOTS reply, repeating the nodes for each slot range. */
+static sds generate_slots(int range_size) {
+    int ranges = range_count(range_size);
+    sds resp = sdscatprintf(sdsempty(), "*%d\r\n", ranges);
+
+    for (int r = 0; r < ranges; r++) {
+        int master = r % NUM_MASTERS;
+
+        resp = sdscat(resp, "*4\r\n");
+        resp = cat_int(resp, r * range_size);
+        resp = cat_int(resp, range_end(r, range_size));
+        resp = cat_slots_node(resp, master);
+        resp = cat_slots_node(resp, master + NUM_MASTERS);
+    }
+
+    return resp;
+}
+
+static sds cat_shards_node(sds s, int id, const char *role) {
+    char buf[41];
+
+    s = sdscat(s, "*14\r\n");
+    node_id(buf, sizeof(buf), id);
+    s = cat_bulk(cat_bulk(s, "id"), buf);
+    s = cat_int(cat_bulk(s, "port"), 6379);
+    node_ip(buf, sizeof(buf), id);
+    s = cat_bulk(cat_bulk(s, "ip"), buf);
+    s = cat_bulk(cat_bulk(s, "endpoint"), buf);
+    s = cat_bulk(cat_bulk(s, "role"), role);
+    s = cat_int(cat_bulk(s, "replication-offset"), 72156);
+    return cat_bulk(cat_bulk(s, "health"), "online");
+}
+
+/* The CLUSTER SHARDS reply, listing the nodes once per shard. */
+static sds generate_shards(int range_size) {
+    sds resp = sdscatprintf(sdsempty(), "*%d\r\n", NUM_MASTERS);
+
+    for (int i = 0; i < NUM_MASTERS; i++) {
+        int count = 0;
+        for (int r = i; r < range_count(range_size); r += NUM_MASTERS) {
+            count++;
+        }
+
+        resp = sdscat(resp, "*4\r\n");
+        resp = cat_bulk(resp, "slots");
+        resp = sdscatprintf(resp, "*%d\r\n", count * 2);
+        for (int r = i; r < range_count(range_size); r += NUM_MASTERS) {
+            resp = cat_int(resp, r * range_size);
+            resp = cat_int(resp, range_end(r, range_size));
+        }
+        resp = cat_bulk(resp, "nodes");
+        resp = sdscat(resp, "*2\r\n");
+        resp = cat_shards_node(resp, i, "master");
+        resp = cat_shards_node(resp, i + NUM_MASTERS, "replica");
+    }
+
+    return resp;
+}
+
+static redisReply *decode(sds resp) {
+    redisReader *reader = redisReaderCreate();
+    void *reply = NULL;
+    int status;
+
+    assert(reader);
+    status = redisReaderFeed(reader, resp, sdslen(resp));
+    assert(status == REDIS_OK);
+    status = redisReaderGetReply(reader, &reply);
+    assert(status == REDIS_OK && reply);
+    redisReaderFree(reader);
+    return reply;
+}
+
+static dict *parse(redisClusterContext *cc, int type, redisReply *reply,
+                   int flags) {
+    switch (type) {
+    case 0:
+        return parse_cluster_nodes(cc, reply->str, reply->len, flags);
+    case 1:
+        return parse_cluster_slots(cc, reply, flags);
+    default:
+        return parse_cluster_shards(cc, reply, flags);
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    int range_size = argc > 2 ? atoi(argv[2]) : 8;
+    const char *names[] = {"CLUSTER NODES", "CLUSTER SLOTS", "CLUSTER SHARDS"};
+    sds resp[3];
+
+    assert(iterations > 0 && range_size > 0);
+    resp[0] = generate_nodes(range_size);
+    resp[1] = generate_slots(range_size);
+    resp[2] = generate_shards(range_size);
+
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+
+    hiredisAllocFuncs ha = {
+        .mallocFn = counting_malloc,
+        .callocFn = counting_calloc,
+        .reallocFn = counting_realloc,
+        .strdupFn = counting_strdup,
+        .freeFn = free,
+    };
+    hiredisSetAllocators(&ha);
+
+    printf("%d masters and %d replicas, %d slots per range\n", NUM_MASTERS,
+           NUM_MASTERS, range_size);
+    printf("%-16s %10s %14s %14s %16s\n", "", "bytes", "decode us",
+           "parse us", "allocs/parse");
+
+    for (int type = 0; type < 3; type++) {
+        long long decode_time = 0, parse_time = 0, parse_allocations = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            long long start = usec_now();
+            redisReply *reply = decode(resp[type]);
+            long long decoded = usec_now();
+
+            allocations = 0;
+            dict *nodes = parse(cc, type, reply, HIRCLUSTER_FLAG_ADD_SLAVE);
+            parse_allocations += allocations;
+            parse_time += usec_now() - decoded;
+            decode_time += decoded - start;
+
+            assert(nodes);
+            assert(dictSize(nodes) == NUM_MASTERS);
+            dictRelease(nodes);
+            freeReplyObject(reply);
+        }
+
+        printf("%-16s %10zu %14.1f %14.1f %16lld\n", names[type],
+               sdslen(resp[type]), (double)decode_time / iterations,
+               (double)parse_time / iterations,
+               parse_allocations / iterations);
+    }
+
+    hiredisResetAllocators();
+    redisClusterFree(cc);
+    for (int type = 0; type < 3; type++) {
+        sdsfree(resp[type]);
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 /*
  * This program connects to a cluster and then reads commands from stdin, such
  * as "SET foo bar", one per line and prints the results to stdout.
+ * Using --pipeline all commands are appended before the replies are read.
  */
 
 #include "hircluster.h"
@@ -9,18 +10,85 @@
 #include <string.h>
 
 int main(int argc, char **argv) {
-    if (argc <= 1) {
-        fprintf(stderr, "Usage: clusterclient HOST:PORT\n");
+    int update_slot_on_moved = 0;
+    int use_shards = 0;
+    int read_replica = 0;
+    int pipeline = 0;
+    int pipeline_poll = 0;
+    int fetch_commands = 0;
+    const char *topology_file = NULL;
+    int route_probes = 1, route_quorum = 1;
+    int argindex;
+
+    for (argindex = 1; argindex < argc && argv[argindex][0] == '-';
+         argindex++) {
+        if (strcmp(argv[argindex], "--update-slot-on-moved") == 0) {
+            update_slot_on_moved = 1;
+        } else if (strcmp(argv[argindex], "--use-shards") == 0) {
+            use_shards = 1;
+        } else if (strcmp(argv[argindex], "--read-replica") == 0) {
+            read_replica = 1;
+        } else if (strcmp(argv[argindex], "--pipeline") == 0) {
+            pipeline = 1;
+        } else if (strcmp(argv[argindex], "--pipeline-poll") == 0) {
+            pipeline = 1;
+            pipeline_poll = 1;
+        } else if (strcmp(argv[argindex], "--fetch-commands") == 0) {
+            fetch_commands = 1;
+        } else if (strcmp(argv[argindex], "--topology-file") == 0 &&
+                   argindex + 1 < argc) {
+            topology_file = argv[++argindex];
+        } else if (strcmp(argv[argindex], "--route-probes") == 0 &&
+                   argindex + 1 < argc) {
+            route_probes = atoi(argv[++argindex]);
+        } else if (strcmp(argv[argindex], "--route-quorum") == 0 &&
+                   argindex + 1 < argc) {
+            route_quorum = atoi(argv[++argindex]);
+        } else {
+            fprintf(stderr, "Unknown argument: '%s'\n", argv[argindex]);
+            exit(1);
+        }
+    }
+
+    if (argindex >= argc) {
+        fprintf(stderr, "Usage: clusterclient [--update-slot-on-moved] "
+                        "[--use-shards] [--read-replica] [--pipeline] "
+                        "[--pipeline-poll] [--fetch-commands] "
+                        "[--topology-file FILE] "
+                        "[--route-probes N] [--route-quorum N] "
+                        "HOST:PORT[,HOST:PORT..]\n");
         exit(1);
     }
-    const char *initnode = argv[1];
+    const char *initnode = argv[argindex];
 
     struct timeval timeout = {1, 500000}; // 1.5s
 
     redisClusterContext *cc = redisClusterContextInit();
     redisClusterSetOptionAddNodes(cc, initnode);
     redisClusterSetOptionConnectTimeout(cc, timeout);
-    redisClusterSetOptionRouteUseSlots(cc);
+    if (use_shards) {
+        redisClusterSetOptionRouteUseShards(cc);
+    } else {
+        redisClusterSetOptionRouteUseSlots(cc);
+    }
+    if (update_slot_on_moved) {
+        redisClusterSetOptionUpdateSlotOnMoved(cc);
+    }
+    if (read_replica) {
+        redisClusterSetOptionReadPreference(cc,
+                                            HIRCLUSTER_READ_PREFER_REPLICA);
+    }
+    if (pipeline_poll) {
+        redisClusterSetOptionPipelinePoll(cc);
+    }
+    if (fetch_commands) {
+        redisClusterSetOptionFetchCommands(cc);
+    }
+    if (topology_file) {
+        redisClusterSetOptionTopologyFile(cc, topology_file);
+    }
+    redisClusterSetOptionRouteProbes(cc, route_probes);
+    redisClusterSetOptionRouteQuorum(cc, route_quorum);
     redisClusterConnect2(cc);
     if (cc && cc->err) {
         fprintf(stderr, "Connect error: %s\n", cc->errstr);
@@ -32,6 +100,14 @@ int main(int argc, char **argv) {
         size_t len = strlen(command);
         if (command[len - 1] == '\n') // Chop trailing line break
             command[len - 1] = '\0';
+        if (pipeline) {
+            if (redisClusterAppendCommand(cc, command) != REDIS_OK) {
+                fprintf(stderr, "redisClusterAppendCommand error: %s\n",
+                        cc->errstr);
+                exit(102);
+            }
+            continue;
+        }
         redisReply *reply = (redisReply *)redisClusterCommand(cc, command);
         if (cc->err) {
             fprintf(stderr, "redisClusterCommand error: %s\n", cc->errstr);
@@ -41,6 +117,18 @@ int main(int argc, char **argv) {
         freeReplyObject(reply);
     }
 
+    /* Print the replies to the pipelined commands, in order */
+    redisReply *reply;
+    while (pipeline && redisClusterGetReply(cc, (void **)&reply) == REDIS_OK &&
+           reply != NULL) {
+        printf("%s\n", reply->str);
+        freeReplyObject(reply);
+    }
+    if (cc->err) {
+        fprintf(stderr, "redisClusterGetReply error: %s\n", cc->errstr);
+        exit(103);
+    }
+
     redisClusterFree(cc);
     return 0;
 }
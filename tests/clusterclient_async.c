@@ -65,11 +65,26 @@ void disconnectCallback(const redisAsyncContext *ac, int status) {
 }
 
 int main(int argc, char **argv) {
-    if (argc <= 1) {
-        fprintf(stderr, "Usage: clusterclient_async HOST:PORT\n");
+    int hedge_delay_ms = -1;
+    int argindex;
+
+    for (argindex = 1; argindex < argc && argv[argindex][0] == '-';
+         argindex++) {
+        if (strcmp(argv[argindex], "--hedge-delay") == 0 &&
+            argindex + 1 < argc) {
+            hedge_delay_ms = atoi(argv[++argindex]);
+        } else {
+            fprintf(stderr, "Unknown argument: '%s'\n", argv[argindex]);
+            exit(1);
+        }
+    }
+
+    if (argindex >= argc) {
+        fprintf(stderr, "Usage: clusterclient_async [--hedge-delay MS] "
+                        "HOST:PORT\n");
         exit(1);
     }
-    const char *initnode = argv[1];
+    const char *initnode = argv[argindex];
 
     redisClusterAsyncContext *acc = redisClusterAsyncContextInit();
     assert(acc);
@@ -77,6 +92,11 @@ int main(int argc, char **argv) {
     redisClusterAsyncSetDisconnectCallback(acc, disconnectCallback);
     redisClusterSetOptionAddNodes(acc->cc, initnode);
     redisClusterSetOptionRouteUseSlots(acc->cc);
+    if (hedge_delay_ms >= 0) {
+        struct timeval delay = {hedge_delay_ms / 1000,
+                                (hedge_delay_ms % 1000) * 1000};
+        redisClusterAsyncSetOptionHedgedReads(acc, delay, 100);
+    }
     redisClusterConnect2(acc->cc);
     if (acc->err) {
         printf("Connect error: %s\n", acc->errstr);
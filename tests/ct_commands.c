@@ -201,6 +201,49 @@ void test_eval(redisClusterContext *cc) {
     assert(reply == NULL);
 }
 
+// Commands given as arguments are classified without being parsed
+void test_argv(redisClusterContext *cc) {
+    redisReply *reply;
+
+    // Keys in different slots, a value containing a protocol terminator
+    const char *mset_argv[] = {"MSET", "key1", "argv1", "key2", "ar\r\ngv2"};
+    const size_t mset_argvlen[] = {4, 4, 5, 4, 6};
+    reply = (redisReply *)redisClusterCommandArgv(cc, 5, mset_argv,
+                                                  mset_argvlen);
+    CHECK_REPLY_OK(cc, reply);
+    freeReplyObject(reply);
+
+    const char *mget_argv[] = {"MGET", "key1", "key2"};
+    const size_t mget_argvlen[] = {4, 4, 4};
+    reply = (redisReply *)redisClusterCommandArgv(cc, 3, mget_argv,
+                                                  mget_argvlen);
+    CHECK_REPLY_ARRAY(cc, reply, 2);
+    CHECK_REPLY_STR(cc, reply->element[0], "argv1");
+    CHECK_REPLY_STR(cc, reply->element[1], "ar\r\ngv2");
+    freeReplyObject(reply);
+
+    const char *eval_argv[] = {"EVAL", "return KEYS[1]", "1", "key2"};
+    const size_t eval_argvlen[] = {4, 14, 1, 4};
+    reply = (redisReply *)redisClusterCommandArgv(cc, 4, eval_argv,
+                                                  eval_argvlen);
+    CHECK_REPLY_STR(cc, reply, "key2");
+    freeReplyObject(reply);
+
+    // Wrong number of arguments
+    const char *get_argv[] = {"GET", "key1", "key2"};
+    const size_t get_argvlen[] = {3, 4, 4};
+    reply = (redisReply *)redisClusterCommandArgv(cc, 3, get_argv,
+                                                  get_argvlen);
+    assert(reply == NULL);
+
+    // A key without a value
+    const char *mset_key_argv[] = {"MSET", "key1"};
+    const size_t mset_key_argvlen[] = {4, 4};
+    reply = (redisReply *)redisClusterCommandArgv(cc, 2, mset_key_argv,
+                                                  mset_key_argvlen);
+    assert(reply == NULL);
+}
+
 int main() {
     struct timeval timeout = {0, 500000};
 
@@ -218,6 +261,7 @@ int main() {
     test_mget(cc);
     test_hset_hget_hdel_hexists(cc);
     test_eval(cc);
+    test_argv(cc);
 
     redisClusterFree(cc);
     return 0;
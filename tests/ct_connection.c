@@ -1,4 +1,5 @@
 #include "adapters/libevent.h"
+#include "adlist.h"
 #include "hircluster.h"
 #include "test_utils.h"
 #include <assert.h>
@@ -6,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define CLUSTER_NODE "127.0.0.1:7000"
 #define CLUSTER_NODE_WITH_PASSWORD "127.0.0.1:7100"
 #define CLUSTER_PASSWORD "secretword"
 
@@ -30,6 +32,78 @@ void test_password_ok() {
     redisClusterFree(cc);
 }
 
+// Refreshing an unchanged routing table keeps the nodes and their
+// connections, using both CLUSTER NODES and CLUSTER SLOTS.
+void test_route_refresh_keeps_nodes(int use_slots) {
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+    redisClusterSetOptionAddNodes(cc, CLUSTER_NODE);
+    if (use_slots) {
+        redisClusterSetOptionRouteUseSlots(cc);
+    }
+
+    int status;
+    status = redisClusterConnect2(cc);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    redisReply *reply;
+    reply = (redisReply *)redisClusterCommand(cc, "SET key1 Hello");
+    CHECK_REPLY_OK(cc, reply);
+    freeReplyObject(reply);
+
+    cluster_node *node = redisClusterGetNodeByKey(cc, "key1");
+    assert(node);
+    redisContext *con = node->con;
+    assert(con);
+
+    status = cluster_update_route(cc);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    assert(redisClusterGetNodeByKey(cc, "key1") == node);
+    assert(node->con == con);
+
+    reply = (redisReply *)redisClusterCommand(cc, "GET key1");
+    CHECK_REPLY_STR(cc, reply, "Hello");
+    freeReplyObject(reply);
+
+    redisClusterFree(cc);
+}
+
+// Reads are sent to a replica, which gets a latency estimate
+void test_read_from_replica() {
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+    redisClusterSetOptionAddNodes(cc, CLUSTER_NODE);
+    redisClusterSetOptionReadPreference(cc, HIRCLUSTER_READ_PREFER_REPLICA);
+
+    int status;
+    status = redisClusterConnect2(cc);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    redisReply *reply;
+    reply = (redisReply *)redisClusterCommand(cc, "SET key1 Hello");
+    CHECK_REPLY_OK(cc, reply);
+    freeReplyObject(reply);
+
+    for (int i = 0; i < 10; i++) {
+        reply = (redisReply *)redisClusterCommand(cc, "STRLEN key1");
+        CHECK_REPLY_TYPE(reply, REDIS_REPLY_INTEGER);
+        freeReplyObject(reply);
+    }
+
+    cluster_node *node = redisClusterGetNodeByKey(cc, "key1");
+    assert(node);
+    assert(node->slaves && listLength(node->slaves) > 0);
+    assert(node->latency > 0); // The SET
+
+    cluster_node *replica = listNodeValue(listFirst(node->slaves));
+    assert(replica->con != NULL);
+    assert(replica->latency > 0);
+    assert(replica->in_flight == 0);
+
+    redisClusterFree(cc);
+}
+
 // Connecting to a password protected cluster and
 // providing wrong password.
 void test_password_wrong() {
@@ -182,6 +256,10 @@ void test_async_password_missing() {
 
 int main() {
 
+    test_route_refresh_keeps_nodes(0);
+    test_route_refresh_keeps_nodes(1);
+    test_read_from_replica();
+
     test_password_ok();
     test_password_wrong();
     test_password_missing();
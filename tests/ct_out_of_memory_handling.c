@@ -134,13 +134,13 @@ void test_alloc_failure_handling() {
 
     // Connect
     {
-        for (int i = 0; i < 128; ++i) {
+        for (int i = 0; i < 63; ++i) {
             prepare_allocation_test(cc, i);
             result = redisClusterConnect2(cc);
             assert(result == REDIS_ERR);
         }
 
-        prepare_allocation_test(cc, 128);
+        prepare_allocation_test(cc, 63);
         result = redisClusterConnect2(cc);
         assert(result == REDIS_OK);
     }
@@ -150,14 +150,14 @@ void test_alloc_failure_handling() {
         redisReply *reply;
         const char *cmd = "SET key value";
 
-        for (int i = 0; i < 36; ++i) {
+        for (int i = 0; i < 32; ++i) {
             prepare_allocation_test(cc, i);
             reply = (redisReply *)redisClusterCommand(cc, cmd);
             assert(reply == NULL);
             ASSERT_STR_EQ(cc->errstr, "Out of memory");
         }
 
-        prepare_allocation_test(cc, 36);
+        prepare_allocation_test(cc, 32);
         reply = (redisReply *)redisClusterCommand(cc, cmd);
         CHECK_REPLY_OK(cc, reply);
         freeReplyObject(reply);
@@ -416,13 +416,13 @@ void test_alloc_failure_handling_async() {
 
     // Connect
     {
-        for (int i = 0; i < 127; ++i) {
+        for (int i = 0; i < 62; ++i) {
             prepare_allocation_test(acc->cc, i);
             result = redisClusterConnect2(acc->cc);
             assert(result == REDIS_ERR);
         }
 
-        prepare_allocation_test(acc->cc, 127);
+        prepare_allocation_test(acc->cc, 62);
         result = redisClusterConnect2(acc->cc);
         assert(result == REDIS_OK);
     }
@@ -439,18 +439,18 @@ void test_alloc_failure_handling_async() {
     {
         const char *cmd1 = "SET foo one";
 
-        for (int i = 0; i < 38; ++i) {
+        for (int i = 0; i < 36; ++i) {
             prepare_allocation_test_async(acc, i);
             result = redisClusterAsyncCommand(acc, commandCallback, &r1, cmd1);
             assert(result == REDIS_ERR);
-            if (i != 36) {
+            if (i != 34) {
                 ASSERT_STR_EQ(acc->errstr, "Out of memory");
             } else {
                 ASSERT_STR_EQ(acc->errstr, "Failed to attach event adapter");
             }
         }
 
-        prepare_allocation_test_async(acc, 38);
+        prepare_allocation_test_async(acc, 36);
         result = redisClusterAsyncCommand(acc, commandCallback, &r1, cmd1);
         ASSERT_MSG(result == REDIS_OK, acc->errstr);
     }
@@ -461,18 +461,18 @@ void test_alloc_failure_handling_async() {
     {
         const char *cmd2 = "GET foo";
 
-        for (int i = 0; i < 15; ++i) {
+        for (int i = 0; i < 13; ++i) {
             prepare_allocation_test_async(acc, i);
             result = redisClusterAsyncCommand(acc, commandCallback, &r2, cmd2);
             assert(result == REDIS_ERR);
             ASSERT_STR_EQ(acc->errstr, "Out of memory");
         }
 
-        /* Due to an issue in hiredis 1.0.0 iteration 15 is avoided.
+        /* Due to an issue in hiredis 1.0.0 iteration 13 is avoided.
            The issue (that triggers an assert) is corrected on master:
            https://github.com/redis/hiredis/commit/4bba72103c93eaaa8a6e07176e60d46ab277cf8a
          */
-        prepare_allocation_test_async(acc, 16);
+        prepare_allocation_test_async(acc, 14);
         result = redisClusterAsyncCommand(acc, commandCallback, &r2, cmd2);
         ASSERT_MSG(result == REDIS_OK, acc->errstr);
     }
@@ -483,10 +483,88 @@ void test_alloc_failure_handling_async() {
     event_base_free(base);
 }
 
+void replyCallbackCountdown(redisClusterAsyncContext *acc, void *r,
+                            void *privdata) {
+    UNUSED(acc);
+    assert(r != NULL);
+    --*(int *)privdata;
+}
+
+void redisReplyCallbackCountdown(redisAsyncContext *ac, void *r,
+                                 void *privdata) {
+    UNUSED(ac);
+    assert(r != NULL);
+    --*(int *)privdata;
+}
+
+// Test that a single-key command needs no allocations of its own once the
+// request state of a completed command can be reused. The allocations are
+// compared with those of hiredis sending the same command on the connection.
+void test_alloc_steady_state_async() {
+    const int allowed = 1000000;
+    int result, pending, cluster_allocations, hiredis_allocations;
+    hiredisAllocFuncs ha = {
+        .mallocFn = hi_malloc_fail,
+        .callocFn = hi_calloc_fail,
+        .reallocFn = hi_realloc_fail,
+        .strdupFn = strdup,
+        .freeFn = free,
+    };
+    // Override allocators
+    hiredisSetAllocators(&ha);
+    successfulAllocations = allowed;
+
+    redisClusterAsyncContext *acc = redisClusterAsyncContextInit();
+    assert(acc);
+    redisClusterSetOptionAddNodes(acc->cc, CLUSTER_NODE);
+    result = redisClusterConnect2(acc->cc);
+    ASSERT_MSG(result == REDIS_OK, acc->errstr);
+
+    struct event_base *base = event_base_new();
+    assert(base);
+    result = redisClusterLibeventAttach(acc, base);
+    assert(result == REDIS_OK);
+
+    // Warm up the connection and the pool of request state
+    pending = 1;
+    result = redisClusterAsyncCommand(acc, replyCallbackCountdown, &pending,
+                                      "GET foo");
+    ASSERT_MSG(result == REDIS_OK, acc->errstr);
+    while (pending > 0)
+        event_base_loop(base, EVLOOP_ONCE);
+
+    pending = 1;
+    successfulAllocations = allowed;
+    result = redisClusterAsyncCommand(acc, replyCallbackCountdown, &pending,
+                                      "GET foo");
+    ASSERT_MSG(result == REDIS_OK, acc->errstr);
+    cluster_allocations = allowed - successfulAllocations;
+    while (pending > 0)
+        event_base_loop(base, EVLOOP_ONCE);
+
+    cluster_node *node = redisClusterGetNodeByKey(acc->cc, (char *)"foo");
+    assert(node && node->acon);
+
+    pending = 1;
+    successfulAllocations = allowed;
+    result = redisAsyncCommand(node->acon, redisReplyCallbackCountdown,
+                               &pending, "GET foo");
+    assert(result == REDIS_OK);
+    hiredis_allocations = allowed - successfulAllocations;
+    while (pending > 0)
+        event_base_loop(base, EVLOOP_ONCE);
+
+    assert(cluster_allocations == hiredis_allocations);
+
+    redisClusterAsyncFree(acc);
+    event_base_free(base);
+}
+
 int main() {
 
     test_alloc_failure_handling();
     test_alloc_failure_handling_async();
+    test_alloc_steady_state_async();
 
     return 0;
 }
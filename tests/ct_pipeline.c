@@ -84,6 +84,40 @@ void test_pipeline_with_multinode_commands() {
     redisClusterFree(cc);
 }
 
+// Test that a pipeline only connects to the nodes it sends commands to
+void test_pipeline_reset_connects_used_nodes_only() {
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+
+    int status;
+    status = redisClusterSetOptionAddNodes(cc, CLUSTER_NODE);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    status = redisClusterConnect2(cc);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    status = redisClusterAppendCommand(cc, "SET foo one");
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    redisClusterReset(cc);
+    ASSERT_MSG(cc->err == 0, cc->errstr);
+
+    nodeIterator ni;
+    initNodeIterator(&ni, cc);
+
+    int connected = 0;
+    cluster_node *node;
+    while ((node = nodeNext(&ni)) != NULL) {
+        if (node->con != NULL) {
+            connected++;
+        }
+    }
+    assert(connected == 1);
+    assert(cc->pipeline_nodes == NULL);
+
+    redisClusterFree(cc);
+}
+
 //------------------------------------------------------------------------------
 // Async API
 //------------------------------------------------------------------------------
@@ -155,13 +189,57 @@ void test_async_pipeline() {
     event_base_free(base);
 }
 
+// Callback for async MGET, verifies the merged reply
+void mgetCallback(redisClusterAsyncContext *cc, void *r, void *privdata) {
+    redisReply *reply = (redisReply *)r;
+    UNUSED(privdata);
+    assert(reply != NULL);
+    assert(reply->type == REDIS_REPLY_ARRAY);
+    assert(reply->elements == 2);
+    assert(strcmp(reply->element[0]->str, "one") == 0);
+    assert(strcmp(reply->element[1]->str, "two") == 0);
+
+    redisClusterAsyncDisconnect(cc);
+}
+
+// Test of multi-key commands spanning nodes using async API
+void test_async_pipeline_with_multinode_commands() {
+    redisClusterAsyncContext *acc = redisClusterAsyncContextInit();
+    assert(acc);
+    redisClusterAsyncSetConnectCallback(acc, callbackExpectOk);
+    redisClusterAsyncSetDisconnectCallback(acc, callbackExpectOk);
+    redisClusterSetOptionAddNodes(acc->cc, CLUSTER_NODE);
+
+    int status;
+    status = redisClusterConnect2(acc->cc);
+    ASSERT_MSG(status == REDIS_OK, acc->errstr);
+
+    struct event_base *base = event_base_new();
+    status = redisClusterLibeventAttach(acc, base);
+    assert(status == REDIS_OK);
+
+    ExpectedResult r1 = {.type = REDIS_REPLY_STATUS, .str = "OK"};
+    status = redisClusterAsyncCommand(acc, commandCallback, &r1,
+                                      "MSET foo one bar two");
+    ASSERT_MSG(status == REDIS_OK, acc->errstr);
+
+    status = redisClusterAsyncCommand(acc, mgetCallback, NULL, "MGET foo bar");
+    ASSERT_MSG(status == REDIS_OK, acc->errstr);
+
+    event_base_dispatch(base);
+
+    redisClusterAsyncFree(acc);
+    event_base_free(base);
+}
+
 int main() {
 
     test_pipeline();
     test_pipeline_with_multinode_commands();
+    test_pipeline_reset_connects_used_nodes_only();
 
     test_async_pipeline();
-    // Asynchronous API does not support multi-key commands
+    test_async_pipeline_with_multinode_commands();
 
     return 0;
 }
@@ -0,0 +1,152 @@
+#include "adlist.h"
+#include "hircluster.h"
+#include "test_utils.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CLUSTER_NODE "127.0.0.1:7000"
+#define NUM_THREADS 8
+
+typedef struct thread_data {
+    redisClusterTopology *topology;
+    int id;
+} thread_data;
+
+// Connect a context using the shared topology and run some commands
+void *worker(void *arg) {
+    thread_data *data = arg;
+    redisReply *reply;
+    char key[32];
+
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+    redisClusterSetOptionAddNodes(cc, CLUSTER_NODE);
+    redisClusterSetOptionTopology(cc, data->topology);
+
+    int status = redisClusterConnect2(cc);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+
+    // The routing table was fetched by the main thread
+    assert(cc->topology_version == 1);
+
+    snprintf(key, sizeof(key), "topology-key%d", data->id);
+    for (int i = 0; i < 100; i++) {
+        reply = (redisReply *)redisClusterCommand(cc, "SET %s %d", key, i);
+        CHECK_REPLY_OK(cc, reply);
+        freeReplyObject(reply);
+
+        reply = (redisReply *)redisClusterCommand(cc, "GET %s", key);
+        CHECK_REPLY_TYPE(reply, REDIS_REPLY_STRING);
+        assert(atoi(reply->str) == i);
+        freeReplyObject(reply);
+    }
+
+    redisClusterFree(cc);
+    return NULL;
+}
+
+// Contexts in different threads sharing the routing table
+void test_threads_share_topology() {
+    pthread_t threads[NUM_THREADS];
+    thread_data data[NUM_THREADS];
+
+    redisClusterTopology *topology = redisClusterTopologyCreate();
+    assert(topology);
+
+    // The first connect fetches and publishes the routing table
+    redisClusterContext *cc = redisClusterContextInit();
+    assert(cc);
+    redisClusterSetOptionAddNodes(cc, CLUSTER_NODE);
+    redisClusterSetOptionTopology(cc, topology);
+
+    int status = redisClusterConnect2(cc);
+    ASSERT_MSG(status == REDIS_OK, cc->errstr);
+    assert(cc->topology_version == 1);
+
+    for (int i = 0; i < NUM_THREADS; i++) {
+        data[i].topology = topology;
+        data[i].id = i;
+        status = pthread_create(&threads[i], NULL, worker, &data[i]);
+        assert(status == 0);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    redisClusterFree(cc);
+    redisClusterTopologyFree(topology);
+}
+
+// A context without seed nodes can connect using the shared topology,
+// and a route update is picked up by the other context.
+void test_update_route_is_shared() {
+    redisClusterTopology *topology = redisClusterTopologyCreate();
+    assert(topology);
+
+    redisClusterContext *cc1 = redisClusterContextInit();
+    assert(cc1);
+    redisClusterSetOptionAddNodes(cc1, CLUSTER_NODE);
+    redisClusterSetOptionTopology(cc1, topology);
+    int status = redisClusterConnect2(cc1);
+    ASSERT_MSG(status == REDIS_OK, cc1->errstr);
+
+    redisClusterContext *cc2 = redisClusterContextInit();
+    assert(cc2);
+    redisClusterSetOptionTopology(cc2, topology);
+    status = redisClusterConnect2(cc2);
+    ASSERT_MSG(status == REDIS_OK, cc2->errstr);
+
+    // The topology is kept alive by the attached contexts
+    redisClusterTopologyFree(topology);
+
+    status = cluster_update_route(cc1);
+    ASSERT_MSG(status == REDIS_OK, cc1->errstr);
+    assert(cc1->topology_version == 2);
+
+    redisReply *reply = (redisReply *)redisClusterCommand(cc2, "SET foo bar");
+    CHECK_REPLY_OK(cc2, reply);
+    freeReplyObject(reply);
+    assert(cc2->topology_version == 2);
+
+    redisClusterFree(cc1);
+    redisClusterFree(cc2);
+}
+
+// Replicas are shared also when the publishing context doesn't use them
+void test_replicas_are_shared() {
+    redisClusterTopology *topology = redisClusterTopologyCreate();
+    assert(topology);
+
+    redisClusterContext *cc1 = redisClusterContextInit();
+    assert(cc1);
+    redisClusterSetOptionAddNodes(cc1, CLUSTER_NODE);
+    redisClusterSetOptionTopology(cc1, topology);
+    int status = redisClusterConnect2(cc1);
+    ASSERT_MSG(status == REDIS_OK, cc1->errstr);
+
+    redisClusterContext *cc2 = redisClusterContextInit();
+    assert(cc2);
+    redisClusterSetOptionParseSlaves(cc2);
+    redisClusterSetOptionTopology(cc2, topology);
+    status = redisClusterConnect2(cc2);
+    ASSERT_MSG(status == REDIS_OK, cc2->errstr);
+    assert(cc2->topology_version == 1);
+
+    cluster_node *node = redisClusterGetNodeByKey(cc2, "key1");
+    assert(node);
+    assert(node->slaves && listLength(node->slaves) > 0);
+
+    redisClusterFree(cc1);
+    redisClusterFree(cc2);
+    redisClusterTopologyFree(topology);
+}
+
+int main() {
+    test_threads_share_topology();
+    test_update_route_is_shared();
+    test_replicas_are_shared();
+    return 0;
+}
@@ -0,0 +1,77 @@
+#!/bin/sh
+
+# Verify that a key redirected by ASK is sent directly to the importing node
+# the next time, while other keys in the slot still go to the migrating node.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=ask-cache-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, migrating slot 12182
+timeout 5s ./simulated-redis.pl -p 7422 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7422, "nodeid7422"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND -ASK 12182 127.0.0.1:7423
+EXPECT ["GET", "{foo}2"]
+SEND "notmoved"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2, importing slot 12182
+timeout 5s ./simulated-redis.pl -p 7423 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["ASKING"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT ["ASKING"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND "baz"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+printf 'GET foo\nGET foo\nGET {foo}2\n' |
+    timeout 3s "$clientprog" 127.0.0.1:7422 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\nbaz\nnotmoved\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,70 @@
+#!/bin/sh
+
+# Verify that the routing table can be fetched using CLUSTER SHARDS,
+# with a shard serving more than one slot range, and a shard listing its
+# failed old master before the new one, as around a failover.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=cluster-shards-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1
+timeout 5s ./simulated-redis.pl -p 7414 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SHARDS"]
+SEND [["slots", [0, 8000, 12000, 16383], "nodes", [["id", "nodeid7414", "port", 7414, "ip", "127.0.0.1", "endpoint", "127.0.0.1", "role", "master", "replication-offset", 0, "health", "online"], ["id", "nodeid7416", "port", 7416, "ip", "127.0.0.1", "endpoint", "127.0.0.1", "role", "replica", "replication-offset", 0, "health", "online"]]], ["slots", [8001, 11999], "nodes", [["id", "nodeid7434", "port", 7434, "ip", "127.0.0.1", "endpoint", "127.0.0.1", "role", "master", "replication-offset", 0, "health", "failed"], ["id", "nodeid7415", "port", 7415, "ip", "127.0.0.1", "endpoint", "127.0.0.1", "role", "master", "replication-offset", 0, "health", "online"]]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2
+timeout 5s ./simulated-redis.pl -p 7415 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "d"]
+SEND "e"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+printf 'GET foo\nGET d\n' |
+    timeout 3s "$clientprog" --use-shards 127.0.0.1:7414 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\ne\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,63 @@
+#!/bin/sh
+
+# Verify that commands missing from the compiled-in command table are sent
+# using the key positions learned from the command 'command', given by the
+# legacy key positions, by a subcommand or by a key spec with a key count.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=command-table-test
+
+# Sync process waiting for CONT signal.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!;
+
+# Start simulated redis node
+timeout 5s ./simulated-redis.pl -p 7430 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7430, "nodeid7430"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["COMMAND"]
+SEND [["getex", -2, ["write", "fast"], 1, 1, 1], ["xinfo", -2, [], 0, 0, 0, [], [], [], [["xinfo|stream", -3, ["readonly"], 2, 2, 1]]], ["zunion", -3, ["readonly"], 0, 0, 0, [], [], [["flags", ["RO"], "begin_search", ["type", "index", "spec", ["index", 1]], "find_keys", ["type", "keynum", "spec", ["keynumidx", 0, "firstkey", 1, "keystep", 1]]]]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GETEX", "foo", "EX", "10"]
+SEND "getex"
+EXPECT ["XINFO", "STREAM", "foo"]
+SEND "xinfo"
+EXPECT ["ZUNION", "1", "bar"]
+SEND "zunion"
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client
+printf 'GETEX foo EX 10\nXINFO STREAM foo\nZUNION 1 bar\n' |
+    timeout 3s "$clientprog" --fetch-commands 127.0.0.1:7430 > "$testname.out"
+clientexit=$?
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit status on server
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+# Check exit status on client
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'getex\nxinfo\nzunion\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
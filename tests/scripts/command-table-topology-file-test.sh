@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# Verify that the command table is fetched also when the routing table is
+# loaded from a topology file, which only holds the routing table.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=command-table-topology-file-test
+topologyfile="$testname.topology"
+
+rm -f "$topologyfile"
+
+# Sync process waiting for CONT signal.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid=$!;
+
+# Start simulated redis node
+timeout 5s ./simulated-redis.pl -p 7436 -d --sigcont $syncpid <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7436, "nodeid7436"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["COMMAND"]
+SEND [["getex", -2, ["write", "fast"], 1, 1, 1]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GETEX", "foo", "EX", "10"]
+SEND "bar"
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["COMMAND"]
+SEND [["getex", -2, ["write", "fast"], 1, 1, 1]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GETEX", "foo", "EX", "10"]
+SEND "baz"
+EXPECT CLOSE
+EOF
+server=$!
+
+# Wait until server is ready to accept client connection
+wait $syncpid;
+
+# Run client, which fetches the routing table and saves it
+echo 'GETEX foo EX 10' |
+    timeout 3s "$clientprog" --fetch-commands --topology-file "$topologyfile" 127.0.0.1:7436 > "$testname.out"
+clientexit=$?
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Run client again, using the saved routing table
+echo 'GETEX foo EX 10' |
+    timeout 3s "$clientprog" --fetch-commands --topology-file "$topologyfile" 127.0.0.1:7436 >> "$testname.out"
+clientexit=$?
+
+# Wait for server to exit
+wait $server; serverexit=$?
+
+# Check exit status on server
+if [ $serverexit -ne 0 ]; then
+    echo "Simulated server exited with status $serverexit"
+    exit $serverexit
+fi
+# Check exit status on client
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\nbaz\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out" "$topologyfile"
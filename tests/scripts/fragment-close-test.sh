@@ -0,0 +1,68 @@
+#!/bin/sh
+
+# Verify that a multi-key command fails, instead of waiting forever, when
+# the node of one fragment closes its connection while the reply to another
+# fragment is awaited.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=fragment-close-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, slow to reply
+timeout 5s ./simulated-redis.pl -p 7432 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8000, ["127.0.0.1", 7432, "nodeid7432"]], [8001, 16383, ["127.0.0.1", 7433, "nodeid7433"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["MGET", "bar"]
+SLEEP 1
+SEND ["bar"]
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2, closing the connection instead of replying
+timeout 5s ./simulated-redis.pl -p 7433 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["MGET", "foo"]
+CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+echo 'MGET bar foo' |
+    timeout 3s "$clientprog" 127.0.0.1:7432 > "$testname.out" 2> /dev/null
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+# The command fails, see the redisClusterCommand error in clusterclient
+if [ $clientexit -ne 101 ]; then
+    echo "$clientprog exited with status $clientexit, expected 101"
+    exit 99
+fi
+
+# Clean up
+rm "$testname.out"
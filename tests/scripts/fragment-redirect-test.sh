@@ -0,0 +1,75 @@
+#!/bin/sh
+
+# Verify that the fragments of a multi-key command are sent to their nodes
+# before any reply is read, and that a fragment redirected by ASK is then
+# sent directly to the importing node.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=fragment-redirect-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, slow to reply and importing slot 12182
+timeout 5s ./simulated-redis.pl -p 7428 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8000, ["127.0.0.1", 7428, "nodeid7428"]], [8001, 16383, ["127.0.0.1", 7429, "nodeid7429"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["MSET", "bar", "1"]
+SLEEP 1
+SEND +OK
+EXPECT ["ASKING"]
+SEND +OK
+EXPECT ["MSET", "foo", "2"]
+SEND +OK
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2, migrating slot 12182
+timeout 5s ./simulated-redis.pl -p 7429 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["MSET", "foo", "2"]
+SEND -ASK 12182 127.0.0.1:7428
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+echo 'MSET bar 1 foo 2' |
+    timeout 3s "$clientprog" 127.0.0.1:7428 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'OK\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
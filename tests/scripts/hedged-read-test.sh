@@ -0,0 +1,72 @@
+#!/bin/sh
+
+# Verify that a read which is not replied to in time is also sent to a
+# replica, that the first reply is used and that the late reply is discarded.
+#
+# Usage: $0 /path/to/clusterclient_async-binary
+
+clientprog=${1:-./clusterclient_async}
+testname=hedged-read-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, the slow master
+timeout 5s ./simulated-redis.pl -p 7420 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7420, "nodeid7420"], ["127.0.0.1", 7421, "nodeid7421"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SLEEP 1
+SEND "slow"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2, the replica
+timeout 5s ./simulated-redis.pl -p 7421 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["READONLY"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND "fast"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client, hedging reads after 100 ms
+echo 'GET foo' |
+    timeout 3s "$clientprog" --hedge-delay 100 127.0.0.1:7420 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient_async
+printf 'fast\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
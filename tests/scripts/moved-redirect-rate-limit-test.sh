@@ -0,0 +1,74 @@
+#!/bin/sh
+
+# Verify that the routing table is fetched at most once per route update
+# interval. A second MOVED within the interval updates the slot directly.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=moved-redirect-rate-limit-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, which returns a stale routing table
+timeout 5s ./simulated-redis.pl -p 7407 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7407, "nodeid7407"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND -MOVED 12182 127.0.0.1:7408
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7407, "nodeid7407"]]]
+EXPECT CLOSE
+EXPECT ["GET", "foo"]
+SEND -MOVED 12182 127.0.0.1:7408
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2
+timeout 5s ./simulated-redis.pl -p 7408 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+echo 'GET foo' | timeout 3s "$clientprog" 127.0.0.1:7407 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+echo 'bar' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,74 @@
+#!/bin/sh
+
+# Verify that pipelined replies collected by polling all node connections are
+# returned in request order, also when the first node is slow to reply.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=pipeline-poll-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, the slow node
+timeout 5s ./simulated-redis.pl -p 7426 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8000, ["127.0.0.1", 7426, "nodeid7426"]], [8001, 16383, ["127.0.0.1", 7427, "nodeid7427"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "bar"]
+SLEEP 1
+SEND "bar"
+EXPECT ["GET", "{bar}2"]
+SEND "bar2"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2
+timeout 5s ./simulated-redis.pl -p 7427 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "foo"
+EXPECT ["GET", "{foo}2"]
+SEND "foo2"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+printf 'GET bar\nGET foo\nGET {bar}2\nGET {foo}2\n' |
+    timeout 3s "$clientprog" --pipeline-poll 127.0.0.1:7426 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\nfoo\nbar2\nfoo2\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
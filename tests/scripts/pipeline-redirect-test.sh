@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# Verify that pipelined commands redirected by MOVED or ASK are re-issued to
+# the given node, and that the replies are returned in the order the commands
+# were appended.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=pipeline-redirect-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, which has lost slot 5061
+timeout 5s ./simulated-redis.pl -p 7424 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 8000, ["127.0.0.1", 7424, "nodeid7424"]], [8001, 16383, ["127.0.0.1", 7425, "nodeid7425"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "bar"]
+SEND -MOVED 5061 127.0.0.1:7425
+EXPECT ["GET", "{bar}2"]
+SEND -ASK 5061 127.0.0.1:7425
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2
+timeout 5s ./simulated-redis.pl -p 7425 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "foo"
+EXPECT ["GET", "bar"]
+SEND "bar"
+EXPECT ["ASKING"]
+SEND +OK
+EXPECT ["GET", "{bar}2"]
+SEND "bar2"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+printf 'GET bar\nGET foo\nGET {bar}2\n' |
+    timeout 3s "$clientprog" --pipeline 127.0.0.1:7424 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\nfoo\nbar2\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
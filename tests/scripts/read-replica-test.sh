@@ -0,0 +1,76 @@
+#!/bin/sh
+
+# Verify that reads are sent to a replica in READONLY mode, while writes are
+# sent to the master. A MOVED reply from the replica to its own master makes
+# the client retry the read on the master, without a routing table update.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=read-replica-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+
+# Start simulated redis node #1, the master
+timeout 5s ./simulated-redis.pl -p 7418 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7418, "nodeid7418"], ["127.0.0.1", 7419, "nodeid7419"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["SET", "foo", "bar"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND "baz"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2, the replica
+timeout 5s ./simulated-redis.pl -p 7419 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["READONLY"]
+SEND +OK
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT ["GET", "foo"]
+SEND -MOVED 12182 127.0.0.1:7418
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Wait until both nodes are ready to accept client connections
+wait $syncpid1 $syncpid2;
+
+# Run client
+printf 'SET foo bar\nGET foo\nGET foo\n' |
+    timeout 3s "$clientprog" --read-replica 127.0.0.1:7418 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'OK\nbar\nbaz\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
@@ -0,0 +1,85 @@
+#!/bin/sh
+
+# Verify that a routing table is only used when a quorum of nodes agree on
+# it. Node #1 replies with a stale routing table, which is not used.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=route-quorum-test
+
+# Sync processes waiting for CONT signals.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid3=$!;
+
+# Start simulated redis node #1, with a stale view of the cluster
+timeout 5s ./simulated-redis.pl -p 7411 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7411, "nodeid7411"]]]
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Start simulated redis node #2
+timeout 5s ./simulated-redis.pl -p 7412 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7412, "nodeid7412"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EOF
+server2=$!
+
+# Start simulated redis node #3
+timeout 5s ./simulated-redis.pl -p 7413 -d --sigcont $syncpid3 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7412, "nodeid7412"]]]
+EXPECT CLOSE
+EOF
+server3=$!
+
+# Wait until all nodes are ready to accept client connections
+wait $syncpid1 $syncpid2 $syncpid3;
+
+# Run client
+echo 'GET foo' | timeout 3s "$clientprog" --route-probes 3 --route-quorum 2 \
+    127.0.0.1:7411,127.0.0.1:7412,127.0.0.1:7413 > "$testname.out"
+clientexit=$?
+
+# Wait for servers to exit
+wait $server1; server1exit=$?
+wait $server2; server2exit=$?
+wait $server3; server3exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $server3exit -ne 0 ]; then
+    echo "Simulated server #3 exited with status $server3exit"
+    exit $server3exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out"
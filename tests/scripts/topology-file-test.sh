@@ -0,0 +1,103 @@
+#!/bin/sh
+
+# Verify that the routing table is saved to a topology file, and that a
+# client started later uses the file instead of fetching the routing table.
+# When the cluster has moved to new addresses, the seed node is asked.
+#
+# Usage: $0 /path/to/clusterclient-binary
+
+clientprog=${1:-./clusterclient}
+testname=topology-file-test
+topologyfile="$testname.topology"
+
+rm -f "$topologyfile"
+
+# Sync process waiting for CONT signal.
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid1=$!;
+
+# Start simulated redis node
+timeout 5s ./simulated-redis.pl -p 7417 -d --sigcont $syncpid1 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7417, "nodeid7417"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "bar"
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "baz"
+EXPECT CLOSE
+EOF
+server1=$!
+
+# Wait until the node is ready to accept client connections
+wait $syncpid1;
+
+# Run client, which fetches the routing table and saves it
+echo 'GET foo' |
+    timeout 3s "$clientprog" --topology-file "$topologyfile" 127.0.0.1:7417 > "$testname.out"
+clientexit=$?
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Run client again, using the saved routing table
+echo 'GET foo' |
+    timeout 3s "$clientprog" --topology-file "$topologyfile" 127.0.0.1:7417 >> "$testname.out"
+clientexit=$?
+
+# Wait for server to exit
+wait $server1; server1exit=$?
+
+# Check exit statuses
+if [ $server1exit -ne 0 ]; then
+    echo "Simulated server #1 exited with status $server1exit"
+    exit $server1exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Start simulated redis node at a new address, the cached one is gone
+perl -we 'use sigtrap "handler", sub{exit}, "CONT"; sleep 1; die "timeout"' &
+syncpid2=$!;
+timeout 5s ./simulated-redis.pl -p 7435 -d --sigcont $syncpid2 <<'EOF' &
+EXPECT CONNECT
+EXPECT ["CLUSTER", "SLOTS"]
+SEND [[0, 16383, ["127.0.0.1", 7435, "nodeid7435"]]]
+EXPECT CLOSE
+EXPECT CONNECT
+EXPECT ["GET", "foo"]
+SEND "qux"
+EXPECT CLOSE
+EOF
+server2=$!
+wait $syncpid2;
+
+# Run client using the outdated file, seeded with the new address
+echo 'GET foo' |
+    timeout 3s "$clientprog" --topology-file "$topologyfile" 127.0.0.1:7435 >> "$testname.out"
+clientexit=$?
+
+# Wait for server to exit
+wait $server2; server2exit=$?
+
+if [ $server2exit -ne 0 ]; then
+    echo "Simulated server #2 exited with status $server2exit"
+    exit $server2exit
+fi
+if [ $clientexit -ne 0 ]; then
+    echo "$clientprog exited with status $clientexit"
+    exit $clientexit
+fi
+
+# Check the output from clusterclient
+printf 'bar\nbaz\nqux\n' | cmp "$testname.out" - || exit 99
+
+# Clean up
+rm "$testname.out" "$topologyfile"